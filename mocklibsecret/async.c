@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test of the asynchronous API: every call is run on a GMainLoop and its
+ * _finish() result is compared with what the synchronous API reads from the
+ * store. Also covers the errors that are reported before a task is started and
+ * tasks that are cancelled before they run.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsecret/secret.h>
+
+#include "mocklibsecret.h"
+
+#define SERVICE "async"
+
+#define SEARCH_FLAGS                                                           \
+  (SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS)
+
+static const SecretSchema schema = {
+    "org.freedesktop.Secret.Generic",
+    SECRET_SCHEMA_NONE,
+    {{"service", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {"account", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {NULL, 0}},
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+/* The state of one pending call, the callback stops the loop. */
+typedef struct {
+  GMainLoop *loop;
+  GAsyncResult *result;
+} pending_t;
+
+static void pending_init(pending_t *pending) {
+  pending->loop = g_main_loop_new(NULL, FALSE);
+  pending->result = NULL;
+}
+
+static void pending_clear(pending_t *pending) {
+  g_clear_object(&pending->result);
+  g_clear_pointer(&pending->loop, g_main_loop_unref);
+}
+
+static void on_ready(GObject *source, GAsyncResult *result, gpointer data) {
+  pending_t *pending = data;
+  g_assert_null(source);
+  g_assert_null(pending->result);
+  pending->result = g_object_ref(result);
+  g_main_loop_quit(pending->loop);
+}
+
+/*
+ * Runs the loop until the callback was invoked and returns its result, which
+ * stays owned by pending. The callback must never run before the call
+ * returns, not even for errors that are detected right away.
+ */
+static GAsyncResult *wait_for(pending_t *pending) {
+  g_assert_null(pending->result);
+  g_main_loop_run(pending->loop);
+  g_assert_nonnull(pending->result);
+  return pending->result;
+}
+
+static gboolean store_async(const gchar *account, const gchar *password,
+                            GCancellable *cancellable, GError **error) {
+  pending_t pending;
+  pending_init(&pending);
+  secret_password_store(&schema, NULL, "label", password, cancellable,
+                        on_ready, &pending, "service", SERVICE, "account",
+                        account, NULL);
+  const gboolean res = secret_password_store_finish(wait_for(&pending), error);
+  pending_clear(&pending);
+  return res;
+}
+
+static gchar *lookup_async(const gchar *account, GCancellable *cancellable,
+                           GError **error) {
+  pending_t pending;
+  pending_init(&pending);
+  secret_password_lookup(&schema, cancellable, on_ready, &pending, "service",
+                         SERVICE, "account", account, NULL);
+  gchar *password = secret_password_lookup_finish(wait_for(&pending), error);
+  pending_clear(&pending);
+  return password;
+}
+
+static gboolean clear_async(const gchar *account, GCancellable *cancellable,
+                            GError **error) {
+  pending_t pending;
+  pending_init(&pending);
+  secret_password_clear(&schema, cancellable, on_ready, &pending, "service",
+                        SERVICE, "account", account, NULL);
+  const gboolean res = secret_password_clear_finish(wait_for(&pending), error);
+  pending_clear(&pending);
+  return res;
+}
+
+static GList *search_async(GHashTable *attributes, SecretSearchFlags flags,
+                           GCancellable *cancellable, GError **error) {
+  pending_t pending;
+  pending_init(&pending);
+  secret_service_search(NULL, &schema, attributes, flags, cancellable,
+                        on_ready, &pending);
+  GList *items = secret_service_search_finish(NULL, wait_for(&pending), error);
+  pending_clear(&pending);
+  return items;
+}
+
+/* What the synchronous API finds, for comparing the async results with. */
+static gchar *lookup_sync(const gchar *account) {
+  g_autoptr(GError) error = NULL;
+  gchar *password = secret_password_lookup_sync(
+      &schema, NULL, &error, "service", SERVICE, "account", account, NULL);
+  g_assert_no_error(error);
+  return password;
+}
+
+static void assert_stored(const gchar *account, const gchar *expected) {
+  gchar *password = lookup_sync(account);
+  g_assert_cmpstr(password, ==, expected);
+  secret_password_free(password);
+}
+
+static GHashTable *service_attributes(void) {
+  GHashTable *attributes = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_insert(attributes, "service", SERVICE);
+  return attributes;
+}
+
+static void test_store_lookup_clear(void) {
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true(store_async("first", "secret", NULL, &error));
+  g_assert_no_error(error);
+  assert_stored("first", "secret");
+
+  // overwriting an existing password
+  g_assert_true(store_async("first", "changed", NULL, &error));
+  g_assert_no_error(error);
+  assert_stored("first", "changed");
+
+  gchar *password = lookup_async("first", NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(password, ==, "changed");
+  secret_password_free(password);
+
+  // a missing password is not an error
+  password = lookup_async("missing", NULL, &error);
+  g_assert_no_error(error);
+  g_assert_null(password);
+
+  g_assert_true(clear_async("first", NULL, &error));
+  g_assert_no_error(error);
+  assert_stored("first", NULL);
+
+  // neither is clearing it again
+  g_assert_false(clear_async("first", NULL, &error));
+  g_assert_no_error(error);
+}
+
+static void test_search(void) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GHashTable) attributes = service_attributes();
+
+  GList *items = search_async(attributes, SEARCH_FLAGS, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_null(items);
+
+  g_assert_true(store_async("first", "one", NULL, &error));
+  g_assert_no_error(error);
+  g_assert_true(store_async("second", "two", NULL, &error));
+  g_assert_no_error(error);
+
+  items = search_async(attributes, SEARCH_FLAGS, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(g_list_length(items), ==, 2);
+  for (GList *l = items; l != NULL; l = l->next) {
+    GHashTable *item_attributes = secret_item_get_attributes(l->data);
+    g_assert_cmpstr(g_hash_table_lookup(item_attributes, "service"), ==,
+                    SERVICE);
+    const gchar *account = g_hash_table_lookup(item_attributes, "account");
+    SecretValue *value = secret_item_get_secret(l->data);
+
+    gchar *password = lookup_sync(account);
+    g_assert_nonnull(password);
+    g_assert_cmpstr(secret_value_get_text(value), ==, password);
+    secret_password_free(password);
+
+    secret_value_unref(value);
+    g_hash_table_unref(item_attributes);
+  }
+  g_list_free(items);
+
+  // narrowed down to one account
+  g_hash_table_insert(attributes, "account", "second");
+  items = search_async(attributes, SEARCH_FLAGS, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(g_list_length(items), ==, 1);
+  SecretValue *value = secret_item_get_secret(items->data);
+  g_assert_cmpstr(secret_value_get_text(value), ==, "two");
+  secret_value_unref(value);
+  g_list_free(items);
+
+  // the mock only supports the flags that keytar passes, which is checked in
+  // the worker thread
+  items = search_async(attributes, SECRET_SEARCH_ALL, NULL, &error);
+  g_assert_nonnull(error);
+  g_assert_null(items);
+  g_clear_error(&error);
+
+  g_assert_true(clear_async("first", NULL, &error));
+  g_assert_no_error(error);
+  g_assert_true(clear_async("second", NULL, &error));
+  g_assert_no_error(error);
+}
+
+/* Errors detected before a task is created go through g_task_report_error(). */
+static void test_invalid_attributes(void) {
+  g_autoptr(GError) error = NULL;
+  pending_t pending;
+
+  // storing and clearing require both service and account
+  pending_init(&pending);
+  secret_password_store(&schema, NULL, "label", "secret", NULL, on_ready,
+                        &pending, "service", SERVICE, NULL);
+  g_assert_false(secret_password_store_finish(wait_for(&pending), &error));
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+  pending_clear(&pending);
+
+  pending_init(&pending);
+  secret_password_clear(&schema, NULL, on_ready, &pending, "account", "first",
+                        NULL);
+  g_assert_false(secret_password_clear_finish(wait_for(&pending), &error));
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+  pending_clear(&pending);
+
+  // unknown attribute names
+  pending_init(&pending);
+  secret_password_store(&schema, NULL, "label", "secret", NULL, on_ready,
+                        &pending, "service", SERVICE, "account", "first",
+                        "colour", "blue", NULL);
+  g_assert_false(secret_password_store_finish(wait_for(&pending), &error));
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+  pending_clear(&pending);
+  assert_stored("first", NULL);
+
+  pending_init(&pending);
+  secret_password_lookup(&schema, NULL, on_ready, &pending, "service",
+                         SERVICE, "colour", "blue", NULL);
+  g_assert_null(secret_password_lookup_finish(wait_for(&pending), &error));
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+  pending_clear(&pending);
+
+  g_autoptr(GHashTable) attributes = service_attributes();
+  g_hash_table_insert(attributes, "colour", "blue");
+  g_assert_null(search_async(attributes, SEARCH_FLAGS, NULL, &error));
+  g_assert_nonnull(error);
+  g_clear_error(&error);
+}
+
+/* Tasks that are cancelled before they run do not touch the store. */
+static void test_cancelled(void) {
+  g_autoptr(GError) error = NULL;
+  g_assert_true(store_async("first", "secret", NULL, &error));
+  g_assert_no_error(error);
+
+  g_autoptr(GCancellable) cancellable = g_cancellable_new();
+  g_cancellable_cancel(cancellable);
+
+  g_assert_false(store_async("first", "changed", cancellable, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+  assert_stored("first", "secret");
+
+  g_assert_false(store_async("second", "two", cancellable, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+  assert_stored("second", NULL);
+
+  g_assert_null(lookup_async("first", cancellable, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+
+  g_autoptr(GHashTable) attributes = service_attributes();
+  g_assert_null(search_async(attributes, SEARCH_FLAGS, cancellable, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+
+  g_assert_false(clear_async("first", cancellable, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+  assert_stored("first", "secret");
+
+  g_assert_true(clear_async("first", NULL, &error));
+  g_assert_no_error(error);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  guint pending;
+} overlapping_t;
+
+static void on_stored(GObject *source, GAsyncResult *result, gpointer data) {
+  (void)source;
+  overlapping_t *overlapping = data;
+  g_autoptr(GError) error = NULL;
+  g_assert_true(secret_password_store_finish(result, &error));
+  g_assert_no_error(error);
+  if (--overlapping->pending == 0) {
+    g_main_loop_quit(overlapping->loop);
+  }
+}
+
+/* Many calls in flight at once, like keytar issues them from JavaScript. */
+static void test_overlapping(void) {
+  overlapping_t overlapping = {g_main_loop_new(NULL, FALSE), 0};
+  for (guint i = 0; i < 32; ++i) {
+    g_autofree gchar *account = g_strdup_printf("account-%u", i);
+    g_autofree gchar *password = g_strdup_printf("password-%u", i);
+    secret_password_store(&schema, NULL, "label", password, NULL, on_stored,
+                          &overlapping, "service", SERVICE, "account", account,
+                          NULL);
+    ++overlapping.pending;
+  }
+  g_main_loop_run(overlapping.loop);
+  g_main_loop_unref(overlapping.loop);
+
+  g_autoptr(GError) error = NULL;
+  for (guint i = 0; i < 32; ++i) {
+    g_autofree gchar *account = g_strdup_printf("account-%u", i);
+    g_autofree gchar *password = g_strdup_printf("password-%u", i);
+    assert_stored(account, password);
+    g_assert_true(clear_async(account, NULL, &error));
+    g_assert_no_error(error);
+  }
+}
+
+/* Double frees are caught instead of putting a buffer twice into the pool. */
+static void test_double_free(void) {
+  g_autoptr(GError) error = NULL;
+  g_assert_true(store_async("first", "secret", NULL, &error));
+  g_assert_no_error(error);
+
+  gchar *password = lookup_async("first", NULL, &error);
+  g_assert_no_error(error);
+  secret_password_free(password);
+  g_test_expect_message(NULL, G_LOG_LEVEL_CRITICAL, "*already freed*");
+  secret_password_free(password);
+  g_test_assert_expected_messages();
+
+  gchar *a = lookup_async("first", NULL, &error);
+  gchar *b = lookup_async("first", NULL, &error);
+  g_assert_no_error(error);
+  g_assert_true(a != b);
+  g_assert_cmpstr(a, ==, "secret");
+  g_assert_cmpstr(b, ==, "secret");
+  secret_password_free(a);
+  secret_password_free(b);
+
+  g_assert_true(clear_async("first", NULL, &error));
+  g_assert_no_error(error);
+}
+
+/* Removes everything the mock created in dir, including passwords.d. */
+static void remove_files(const gchar *dir) {
+  GDir *d = g_dir_open(dir, 0, NULL);
+  if (d == NULL) {
+    return;
+  }
+  const gchar *name;
+  while ((name = g_dir_read_name(d)) != NULL) {
+    g_autofree gchar *path = g_build_filename(dir, name, NULL);
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+      remove_files(path);
+      g_rmdir(path);
+    } else {
+      g_unlink(path);
+    }
+  }
+  g_dir_close(d);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *home = g_dir_make_tmp("mocklibsecret-async-XXXXXX", &error);
+  if (home == NULL) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_setenv("HOME", home, TRUE);
+
+  g_test_add_func("/async/store-lookup-clear", test_store_lookup_clear);
+  g_test_add_func("/async/search", test_search);
+  g_test_add_func("/async/invalid-attributes", test_invalid_attributes);
+  g_test_add_func("/async/cancelled", test_cancelled);
+  g_test_add_func("/async/overlapping", test_overlapping);
+  g_test_add_func("/async/double-free", test_double_free);
+  const int res = g_test_run();
+
+  // write deferred changes now and not once the library gets unloaded
+  mocklibsecret_reinit();
+
+  remove_files(home);
+  g_rmdir(home);
+
+  return res;
+}
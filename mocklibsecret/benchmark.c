@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Benchmark of the mock's exported functions, linked directly against
+ * libsecret.so from this directory.
+ *
+ * For every store size, operation and cache state one JSON object is printed
+ * per line (the same format as benchmark.js):
+ * {"driver": "c", "operation": "lookup", "size": 100, "cache": "warm",
+ *  "samples": 1000, "ops_per_sec": ..., "p50_us": ..., "p99_us": ...}
+ *
+ * "cold" runs bump the mtime of passwords.ini before every operation, so that
+ * the mock has to reload the file. With MOCKLIBSECRET_BACKEND=binary
+ * passwords.bin is touched instead, so that the image gets mapped again. With
+ * MOCKLIBSECRET_SHARDING=service these are the files of the benchmark service
+ * in passwords.d.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsecret/secret.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SERVICE "benchmark"
+
+/* searches of large stores allocate a lot, don't return more items than that */
+#define SEARCH_ITEM_BUDGET 2000000
+
+static const SecretSchema schema = {
+    "org.freedesktop.Secret.Generic",
+    SECRET_SCHEMA_NONE,
+    {{"service", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {"account", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {NULL, 0}},
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+static gchar *ini_path = NULL;
+/* the file that is touched to invalidate the mock's cache */
+static gchar *store_path = NULL;
+
+static gint iterations = 1000;
+static gdouble max_seconds = 5.0;
+static gchar *sizes_arg = NULL;
+
+static GOptionEntry entries[] = {
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+     "Maximum number of samples per measurement (default: 1000)", "N"},
+    {"max-seconds", 't', 0, G_OPTION_ARG_DOUBLE, &max_seconds,
+     "Stop sampling a measurement after this time (default: 5)", "SECONDS"},
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &sizes_arg,
+     "Comma separated list of store sizes (default: 1,100,10000,100000)",
+     "SIZES"},
+    {NULL, 0, 0, 0, NULL, NULL, NULL}};
+
+typedef enum { OP_LOOKUP, OP_STORE, OP_CLEAR, OP_SEARCH } operation_t;
+
+static const char *const operation_names[] = {"lookup", "store", "clear",
+                                              "search"};
+
+static gint64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static void account_name(gchar *buf, gsize len, guint i) {
+  snprintf(buf, len, "account%07u", i);
+}
+
+/*
+ * Writes passwords.ini with size entries directly, storing them one by one
+ * would rewrite the file size times.
+ */
+static void populate(guint size) {
+  GString *data = g_string_new("[" SERVICE "]\n");
+  for (guint i = 0; i < size; ++i) {
+    g_string_append_printf(data, "account%07u=password%07u\n", i, i);
+  }
+  g_autoptr(GError) error = NULL;
+  if (!g_file_set_contents(ini_path, data->str, (gssize)data->len, &error)) {
+    g_error("could not write %s: %s", ini_path, error->message);
+  }
+  g_string_free(data, TRUE);
+}
+
+/* Makes the mock's cached copy of passwords.ini stale. */
+static void invalidate_cache(void) {
+  // the mock compares the mtime with nanosecond precision, but the file
+  // system might not support that
+  static time_t counter = 1000000;
+  const struct timespec times[2] = {{0, UTIME_OMIT}, {counter++, 0}};
+  if (utimensat(AT_FDCWD, store_path, times, 0) != 0) {
+    g_error("could not touch %s: %s", store_path, g_strerror(errno));
+  }
+}
+
+static void check_error(const char *what, GError *error) {
+  if (error != NULL) {
+    g_error("%s failed: %s", what, error->message);
+  }
+}
+
+static void run_operation(operation_t op, guint size, guint i,
+                          GHashTable *search_attributes) {
+  gchar account[32];
+  account_name(account, sizeof(account), i % size);
+  g_autoptr(GError) error = NULL;
+
+  switch (op) {
+  case OP_LOOKUP: {
+    gchar *password = secret_password_lookup_sync(
+        &schema, NULL, &error, "service", SERVICE, "account", account, NULL);
+    check_error("lookup", error);
+    g_assert_nonnull(password);
+    secret_password_free(password);
+    break;
+  }
+  case OP_STORE:
+    // replace an existing password, so that the store keeps its size
+    secret_password_store_sync(&schema, NULL, "label", "new password", NULL,
+                               &error, "service", SERVICE, "account", account,
+                               NULL);
+    check_error("store", error);
+    break;
+  case OP_CLEAR:
+    g_assert_true(secret_password_clear_sync(&schema, NULL, &error, "service",
+                                             SERVICE, "account", account,
+                                             NULL));
+    check_error("clear", error);
+    break;
+  case OP_SEARCH: {
+    GList *items = secret_service_search_sync(
+        NULL, &schema, search_attributes,
+        SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS,
+        NULL, &error);
+    check_error("search", error);
+    g_assert_cmpuint(g_list_length(items), ==, size);
+    g_list_free(items);
+    break;
+  }
+  }
+}
+
+/* Undoes the effect of a clear, outside of the measurement. */
+static void restore_entry(guint size, guint i) {
+  gchar account[32];
+  account_name(account, sizeof(account), i % size);
+  g_autoptr(GError) error = NULL;
+  secret_password_store_sync(&schema, NULL, "label", "password", NULL, &error,
+                             "service", SERVICE, "account", account, NULL);
+  check_error("store", error);
+}
+
+static int compare_gint64(gconstpointer a, gconstpointer b) {
+  const gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void measure(operation_t op, guint size, gboolean cold,
+                    GHashTable *search_attributes) {
+  guint max_samples = (guint)MAX(iterations, 1);
+  if (op == OP_SEARCH) {
+    max_samples = MIN(max_samples, MAX(SEARCH_ITEM_BUDGET / size, 5));
+  }
+
+  g_autofree gint64 *samples = g_new(gint64, max_samples);
+  const gint64 deadline = now_ns() + (gint64)(max_seconds * 1e9);
+  gint64 total = 0;
+  guint n = 0;
+
+  // one untimed run to get the file into the cache
+  if (!cold) {
+    run_operation(OP_LOOKUP, size, 0, NULL);
+  }
+
+  while (n < max_samples && (n < 5 || now_ns() < deadline)) {
+    if (cold) {
+      invalidate_cache();
+    }
+    const gint64 start = now_ns();
+    run_operation(op, size, n, search_attributes);
+    samples[n] = now_ns() - start;
+    total += samples[n];
+    ++n;
+
+    if (op == OP_CLEAR) {
+      restore_entry(size, n - 1);
+    }
+  }
+
+  qsort(samples, n, sizeof(gint64), compare_gint64);
+  printf("{\"driver\": \"c\", \"operation\": \"%s\", \"size\": %u, "
+         "\"cache\": \"%s\", \"samples\": %u, \"ops_per_sec\": %.1f, "
+         "\"p50_us\": %.2f, \"p99_us\": %.2f}\n",
+         operation_names[op], size, cold ? "cold" : "warm", n,
+         n / (total / 1e9), samples[n / 2] / 1e3,
+         samples[MIN(n - 1, (n * 99) / 100)] / 1e3);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- benchmark mocklibsecret");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+
+  g_auto(GStrv) sizes =
+      g_strsplit(sizes_arg != NULL ? sizes_arg : "1,100,10000,100000", ",", 0);
+
+  // don't touch the passwords of whoever runs the benchmark
+  g_autofree gchar *home = g_dir_make_tmp("mocklibsecret-bench-XXXXXX", &error);
+  if (home == NULL) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_setenv("HOME", home, TRUE);
+  const gboolean sharded =
+      g_strcmp0(g_getenv("MOCKLIBSECRET_SHARDING"), "service") == 0;
+  g_autofree gchar *store_dir =
+      sharded ? g_build_filename(home, "passwords.d", NULL) : g_strdup(home);
+  const gchar *base_name = sharded ? SERVICE : "passwords";
+  g_mkdir_with_parents(store_dir, 0700);
+
+  ini_path = g_strdup_printf("%s/%s.ini", store_dir, base_name);
+  const gboolean binary =
+      g_strcmp0(g_getenv("MOCKLIBSECRET_BACKEND"), "binary") == 0;
+  store_path = binary ? g_strdup_printf("%s/%s.bin", store_dir, base_name)
+                      : g_strdup(ini_path);
+
+  GHashTable *search_attributes = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_insert(search_attributes, "service", SERVICE);
+
+  for (gchar **size_str = sizes; *size_str != NULL; ++size_str) {
+    const guint size = (guint)g_ascii_strtoull(*size_str, NULL, 10);
+    if (size == 0) {
+      g_printerr("invalid store size: '%s'\n", *size_str);
+      return EXIT_FAILURE;
+    }
+    populate(size);
+    // let the binary backend import passwords.ini
+    run_operation(OP_LOOKUP, size, 0, NULL);
+
+    for (operation_t op = OP_LOOKUP; op <= OP_SEARCH; ++op) {
+      measure(op, size, FALSE, search_attributes);
+      measure(op, size, TRUE, search_attributes);
+    }
+  }
+
+  g_hash_table_unref(search_attributes);
+  g_unlink(ini_path);
+  if (binary) {
+    g_unlink(store_path);
+  }
+  g_autofree gchar *lock_path = g_strconcat(ini_path, ".lock", NULL);
+  g_unlink(lock_path);
+  g_autofree gchar *journal_path =
+      g_strdup_printf("%s/%s.journal", store_dir, base_name);
+  g_unlink(journal_path);
+  if (sharded) {
+    g_rmdir(store_dir);
+  }
+  g_rmdir(home);
+  g_free(ini_path);
+  g_free(store_path);
+
+  return EXIT_SUCCESS;
+}
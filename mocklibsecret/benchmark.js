@@ -0,0 +1,194 @@
+#!/usr/bin/env node
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Benchmark of mocklibsecret through keytar, the counterpart of benchmark.c.
+ *
+ * Prints one JSON object per line and measurement in the same format as the C
+ * harness, with "driver": "keytar".
+ *
+ * Usage: benchmark.js [--iterations N] [--max-seconds S] [--sizes 1,100,...]
+ */
+
+"use strict";
+
+const keytar = require("keytar");
+const assert = require("assert");
+const fs = require("fs");
+const { tmpdir } = require("os");
+const { join } = require("path");
+
+const SERVICE_NAME = "benchmark";
+
+const parseArgs = () => {
+  const opts = {
+    iterations: 1000,
+    maxSeconds: 5,
+    sizes: [1, 100, 10000, 100000]
+  };
+  const args = process.argv.slice(2);
+  for (let i = 0; i < args.length; i += 2) {
+    const value = args[i + 1];
+    if (args[i] === "--iterations") {
+      opts.iterations = parseInt(value, 10);
+    } else if (args[i] === "--max-seconds") {
+      opts.maxSeconds = parseFloat(value);
+    } else if (args[i] === "--sizes") {
+      opts.sizes = value.split(",").map((s) => parseInt(s, 10));
+    } else {
+      throw new Error(`unknown argument: ${args[i]}`);
+    }
+  }
+  assert(opts.sizes.every((size) => size > 0));
+  return opts;
+};
+
+/** searches of large stores allocate a lot, limit the number of results */
+const SEARCH_ITEM_BUDGET = 2000000;
+
+const accountName = (i) => `account${String(i).padStart(7, "0")}`;
+
+/** Write passwords.ini directly, storing one by one would be way too slow */
+const populate = (iniPath, size) => {
+  const lines = [`[${SERVICE_NAME}]`];
+  for (let i = 0; i < size; i++) {
+    lines.push(`${accountName(i)}=password${String(i).padStart(7, "0")}`);
+  }
+  fs.writeFileSync(iniPath, lines.join("\n") + "\n");
+};
+
+let mtimeCounter = 1000000;
+
+/**
+ * Make the mock's cached copy of the store stale, storePath is passwords.bin
+ * with the binary backend and passwords.ini otherwise
+ */
+const invalidateCache = (storePath) => {
+  const mtime = mtimeCounter++;
+  fs.utimesSync(storePath, mtime, mtime);
+};
+
+const operations = {
+  lookup: async (size, i) => {
+    const account = accountName(i % size);
+    assert((await keytar.getPassword(SERVICE_NAME, account)) !== null);
+  },
+  // replace an existing password, so that the store keeps its size
+  store: (size, i) =>
+    keytar.setPassword(SERVICE_NAME, accountName(i % size), "new password"),
+  clear: async (size, i) => {
+    assert(await keytar.deletePassword(SERVICE_NAME, accountName(i % size)));
+  },
+  search: async (size) => {
+    assert((await keytar.findCredentials(SERVICE_NAME)).length === size);
+  }
+};
+
+const measure = async (opts, storePath, operation, size, cold) => {
+  let maxSamples = Math.max(opts.iterations, 1);
+  if (operation === "search") {
+    maxSamples = Math.min(
+      maxSamples,
+      Math.max(Math.floor(SEARCH_ITEM_BUDGET / size), 5)
+    );
+  }
+
+  const samples = [];
+  const deadline = process.hrtime.bigint() + BigInt(opts.maxSeconds * 1e9);
+
+  // one untimed run to get the file into the cache
+  if (!cold) {
+    await operations.lookup(size, 0);
+  }
+
+  while (
+    samples.length < maxSamples &&
+    (samples.length < 5 || process.hrtime.bigint() < deadline)
+  ) {
+    if (cold) {
+      invalidateCache(storePath);
+    }
+    const start = process.hrtime.bigint();
+    await operations[operation](size, samples.length);
+    samples.push(Number(process.hrtime.bigint() - start));
+
+    if (operation === "clear") {
+      await keytar.setPassword(
+        SERVICE_NAME,
+        accountName((samples.length - 1) % size),
+        "password"
+      );
+    }
+  }
+
+  samples.sort((a, b) => a - b);
+  const total = samples.reduce((sum, s) => sum + s, 0);
+  const n = samples.length;
+  console.log(
+    JSON.stringify({
+      driver: "keytar",
+      operation,
+      size,
+      cache: cold ? "cold" : "warm",
+      samples: n,
+      ops_per_sec: n / (total / 1e9),
+      p50_us: samples[Math.floor(n / 2)] / 1e3,
+      p99_us: samples[Math.min(n - 1, Math.floor((n * 99) / 100))] / 1e3
+    })
+  );
+};
+
+(async () => {
+  const opts = parseArgs();
+
+  // don't touch the passwords of whoever runs the benchmark
+  const home = fs.mkdtempSync(join(tmpdir(), "mocklibsecret-bench-"));
+  process.env.HOME = home;
+  // with sharding the benchmark service has its own files in passwords.d
+  const sharded = process.env.MOCKLIBSECRET_SHARDING === "service";
+  const storeDir = sharded ? join(home, "passwords.d") : home;
+  const baseName = sharded ? SERVICE_NAME : "passwords";
+  fs.mkdirSync(storeDir, { recursive: true });
+  const iniPath = join(storeDir, `${baseName}.ini`);
+  const storePath =
+    process.env.MOCKLIBSECRET_BACKEND === "binary"
+      ? join(storeDir, `${baseName}.bin`)
+      : iniPath;
+
+  try {
+    for (const size of opts.sizes) {
+      populate(iniPath, size);
+      // let the binary backend import passwords.ini
+      await operations.lookup(size, 0);
+      for (const operation of Object.keys(operations)) {
+        await measure(opts, storePath, operation, size, false);
+        await measure(opts, storePath, operation, size, true);
+      }
+    }
+  } finally {
+    fs.rmdirSync(home, { recursive: true });
+  }
+})().catch((err) => {
+  console.error(`Benchmark failed with: ${err}`);
+  console.error(`${err.stack}`);
+  process.exitCode = 1;
+});
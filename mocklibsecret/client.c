@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "protocol.h"
+
+/*
+ * Requests are written while holding the lock and numbered in the order in
+ * which they were sent. The daemon answers in the same order, so after
+ * sending request n a thread waits until the responses to 0..n-1 have been
+ * read by their threads and then reads its own without holding the lock.
+ * Thus many requests can be in flight at once, while only one thread reads
+ * at a time.
+ *
+ * If anything goes wrong the connection is shut down, which makes all
+ * threads waiting for a response fail, and the next request reconnects once
+ * all of them are done.
+ */
+static struct {
+  GMutex lock;
+  GCond cond;
+  gchar *socket_path;
+  int fd;
+  protocol_reader_t reader;
+  guint64 sent;
+  guint64 received;
+  gboolean broken;
+  gboolean disabled;
+} client = {{0}, {0}, NULL, -1, {-1, NULL, 0}, 0, 0, FALSE, FALSE};
+
+void client_disable(void) { client.disabled = TRUE; }
+
+gboolean client_enabled(void) {
+  // read on first use and not when the library is loaded, so that test
+  // harnesses can start a daemon and set the variable in main()
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+    const gchar *path = g_getenv("MOCKLIBSECRET_DAEMON");
+    if (!client.disabled && path != NULL && *path != '\0') {
+      client.socket_path = g_strdup(path);
+    }
+    g_once_init_leave(&initialized, 1);
+  }
+  return client.socket_path != NULL;
+}
+
+static void close_connection_locked(void) {
+  if (client.fd != -1) {
+    close(client.fd);
+    client.fd = -1;
+  }
+  protocol_reader_clear(&client.reader);
+  client.sent = client.received = 0;
+  client.broken = FALSE;
+}
+
+static void mark_broken_locked(void) {
+  if (!client.broken) {
+    client.broken = TRUE;
+    shutdown(client.fd, SHUT_RDWR);
+  }
+}
+
+static gboolean connect_locked(GError **error) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(client.socket_path) >= sizeof(addr.sun_path)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FILENAME_TOO_LONG,
+                "Failed to connect to mocklibsecret daemon at %s: %s",
+                client.socket_path, g_strerror(ENAMETOOLONG));
+    return FALSE;
+  }
+  strcpy(addr.sun_path, client.socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    const int errsv = errno;
+    if (fd != -1) {
+      close(fd);
+    }
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                "Failed to connect to mocklibsecret daemon at %s: %s",
+                client.socket_path, g_strerror(errsv));
+    return FALSE;
+  }
+
+  client.fd = fd;
+  protocol_reader_init(&client.reader, fd);
+  return TRUE;
+}
+
+/*
+ * Sends the request and waits for its response, whose payload is appended to
+ * payload. Daemon side errors are turned into error.
+ */
+static gboolean roundtrip(const GString *request, message_header_t *header,
+                          GString *payload, GError **error) {
+  g_mutex_lock(&client.lock);
+  while (client.broken && client.received != client.sent) {
+    g_cond_wait(&client.cond, &client.lock);
+  }
+  if (client.broken) {
+    close_connection_locked();
+  }
+  if (client.fd == -1 && !connect_locked(error)) {
+    g_mutex_unlock(&client.lock);
+    return FALSE;
+  }
+  if (!protocol_write_all(client.fd, request->str, request->len, error)) {
+    mark_broken_locked();
+    g_cond_broadcast(&client.cond);
+    g_mutex_unlock(&client.lock);
+    return FALSE;
+  }
+  const guint64 ticket = client.sent++;
+  while (client.received != ticket) {
+    g_cond_wait(&client.cond, &client.lock);
+  }
+  g_mutex_unlock(&client.lock);
+
+  // nobody else touches the reader until received is incremented
+  const gchar *data = NULL;
+  GError *read_error = NULL;
+  gboolean ok =
+      protocol_reader_next(&client.reader, header, &data, &read_error);
+  if (ok) {
+    g_string_append_len(payload, data, header->length);
+  } else if (read_error == NULL) {
+    read_error = g_error_new(G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                             "mocklibsecret daemon at %s closed the "
+                             "connection",
+                             client.socket_path);
+  }
+
+  g_mutex_lock(&client.lock);
+  if (!ok) {
+    mark_broken_locked();
+  }
+  ++client.received;
+  g_cond_broadcast(&client.cond);
+  g_mutex_unlock(&client.lock);
+
+  if (!ok) {
+    g_propagate_error(error, read_error);
+    return FALSE;
+  }
+  if (header->code == PROTOCOL_ERROR) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%.*s",
+                (int)header->length, payload->str);
+    return FALSE;
+  }
+  if (header->code != PROTOCOL_OK && header->code != PROTOCOL_NOT_FOUND) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Invalid response status %u from mocklibsecret daemon",
+                header->code);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static guint8 present_bits(const gchar *service, const gchar *account,
+                           const gchar *password) {
+  return (service != NULL ? PROTOCOL_HAS_SERVICE : 0) |
+         (account != NULL ? PROTOCOL_HAS_ACCOUNT : 0) |
+         (password != NULL ? PROTOCOL_HAS_PASSWORD : 0);
+}
+
+/* Performs op, returns whether the status was PROTOCOL_OK. */
+static gboolean request(protocol_op_t op, const gchar *service,
+                        const gchar *account, const gchar *password,
+                        GString *payload, GError **error) {
+  const gchar *const strings[] = {service, account, password};
+  g_autoptr(GString) message = g_string_sized_new(
+      sizeof(message_header_t) + 32 +
+      (password != NULL ? strlen(password) : 0));
+  protocol_append_message(message, (guint8)op,
+                          present_bits(service, account, password), strings,
+                          G_N_ELEMENTS(strings));
+
+  message_header_t header = {0};
+  return roundtrip(message, &header, payload, error) &&
+         header.code == PROTOCOL_OK;
+}
+
+gboolean client_store(const gchar *service, const gchar *account,
+                      const gchar *password, GError **error) {
+  g_autoptr(GString) payload = g_string_new(NULL);
+  request(PROTOCOL_STORE, service, account, password, payload, error);
+  return *error == NULL;
+}
+
+gchar *client_lookup(const store_query_t *query, GError **error) {
+  g_autoptr(GString) payload = g_string_new(NULL);
+  if (!request(PROTOCOL_LOOKUP, query->service, query->account, NULL,
+               payload, error)) {
+    return NULL;
+  }
+  if (payload->len == 0 || payload->str[payload->len - 1] != '\0') {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Invalid lookup response from mocklibsecret daemon");
+    return NULL;
+  }
+  return g_string_free(g_steal_pointer(&payload), FALSE);
+}
+
+gboolean client_clear(const gchar *service, const gchar *account,
+                      GError **error) {
+  g_autoptr(GString) payload = g_string_new(NULL);
+  return request(PROTOCOL_CLEAR, service, account, NULL, payload, error);
+}
+
+GBytes *client_search(const store_query_t *query, GError **error) {
+  g_autoptr(GString) payload = g_string_new(NULL);
+  if (!request(PROTOCOL_SEARCH, query->service, query->account, NULL, payload,
+               error) &&
+      *error != NULL) {
+    return NULL;
+  }
+
+  gsize n_strings = 0;
+  for (gsize i = 0; i < payload->len; ++i) {
+    n_strings += payload->str[i] == '\0';
+  }
+  if (n_strings % 3 != 0 ||
+      (payload->len > 0 && payload->str[payload->len - 1] != '\0')) {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Invalid search response from mocklibsecret daemon");
+    return NULL;
+  }
+  return g_string_free_to_bytes(g_steal_pointer(&payload));
+}
+
+/*
+ * A forked child must not use the parent's connection: the responses to its
+ * requests could be read by the parent.
+ */
+void client_atfork_prepare(void) { g_mutex_lock(&client.lock); }
+
+void client_atfork_parent(void) { g_mutex_unlock(&client.lock); }
+
+void client_atfork_child(void) {
+  close_connection_locked();
+  g_mutex_unlock(&client.lock);
+}
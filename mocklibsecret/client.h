@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "store.h"
+
+/*
+ * Forwarding of all operations to mocklibsecretd (see server.h) if
+ * MOCKLIBSECRET_DAEMON contains the path of its socket.
+ *
+ * All threads of a process share one connection and pipeline their requests
+ * on it, the connection is reestablished after errors and in forked
+ * children.
+ */
+
+/*
+ * Used by the daemon, which must not forward requests to itself. Has to be
+ * called before any other function of the client.
+ */
+void client_disable(void);
+
+gboolean client_enabled(void);
+
+gboolean client_store(const gchar *service, const gchar *account,
+                      const gchar *password, GError **error);
+
+/* Returns NULL without setting error if there is no matching password. */
+gchar *client_lookup(const store_query_t *query, GError **error);
+
+/* Returns FALSE without setting error if there was nothing to remove. */
+gboolean client_clear(const gchar *service, const gchar *account,
+                      GError **error);
+
+/*
+ * Returns the service, account and password triples of all matches as
+ * consecutive NUL terminated strings, an empty buffer if there are none.
+ */
+GBytes *client_search(const store_query_t *query, GError **error);
+
+void client_atfork_prepare(void);
+void client_atfork_parent(void);
+void client_atfork_child(void);
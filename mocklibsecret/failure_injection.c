@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "failure_injection.h"
+
+#define ERROR_FILE_NAME "mocklibsecret_error_message"
+#define DEFAULT_ERROR_MESSAGE "libsecret call failed"
+
+static struct {
+  GMutex lock;
+  /* TMPDIR/mocklibsecret_error_message */
+  gchar *path;
+  /* -1 if inotify is not available => use stat() */
+  int inotify_fd;
+  /* whether the error file exists and its contents */
+  gboolean active;
+  gchar *message;
+  /* stat of the error file, only used without inotify */
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+} failure = {{0}, NULL, -1, FALSE, NULL, 0, 0, {0, 0}};
+
+static void reload_error_file_locked(void) {
+  g_clear_pointer(&failure.message, g_free);
+  gsize length = 0;
+  // don't care why reading failed
+  failure.active =
+      g_file_get_contents(failure.path, &failure.message, &length, NULL);
+  if (failure.active && length == 0) {
+    g_clear_pointer(&failure.message, g_free);
+  }
+}
+
+static void setup_inotify_locked(void) {
+  failure.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (failure.inotify_fd == -1) {
+    return;
+  }
+
+  // watch the directory and not the file, so that we notice it appearing
+  g_autofree gchar *dir = g_path_get_dirname(failure.path);
+  if (inotify_add_watch(failure.inotify_fd, dir,
+                        IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR) == -1) {
+    close(failure.inotify_fd);
+    failure.inotify_fd = -1;
+  }
+}
+
+/*
+ * Drains the inotify queue and returns whether any of the events concerned the
+ * error file.
+ */
+static gboolean error_file_changed_inotify_locked(void) {
+  gboolean changed = FALSE;
+  _Alignas(struct inotify_event) char buf[sizeof(struct inotify_event) +
+                                           NAME_MAX + 1];
+
+  for (;;) {
+    const ssize_t len = read(failure.inotify_fd, buf, sizeof(buf));
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      // EAGAIN: no more events
+      break;
+    }
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      if ((event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) != 0 ||
+          (event->len > 0 && strcmp(event->name, ERROR_FILE_NAME) == 0)) {
+        changed = TRUE;
+      }
+      if ((event->mask & IN_IGNORED) != 0) {
+        // the directory is gone, we can't rely on inotify anymore
+        close(failure.inotify_fd);
+        failure.inotify_fd = -1;
+        return TRUE;
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return changed;
+}
+
+static gboolean error_file_changed_stat_locked(void) {
+  struct stat st;
+  if (stat(failure.path, &st) != 0) {
+    return failure.active;
+  }
+  const gboolean changed = !failure.active || st.st_ino != failure.ino ||
+                           st.st_size != failure.size ||
+                           st.st_mtim.tv_sec != failure.mtime.tv_sec ||
+                           st.st_mtim.tv_nsec != failure.mtime.tv_nsec;
+  failure.ino = st.st_ino;
+  failure.size = st.st_size;
+  failure.mtime = st.st_mtim;
+  return changed;
+}
+
+void failure_injection_init(void) {
+  g_mutex_lock(&failure.lock);
+  g_free(failure.path);
+  failure.path = g_build_filename(g_get_tmp_dir(), ERROR_FILE_NAME, NULL);
+  setup_inotify_locked();
+  if (failure.inotify_fd == -1) {
+    error_file_changed_stat_locked();
+  }
+  reload_error_file_locked();
+  g_mutex_unlock(&failure.lock);
+}
+
+gchar *failure_injection_get_message(void) {
+  // this can be modified at runtime by the process itself (test.js does that)
+  // so we have to check it every time, it is cheap though
+  const char *env_message = secure_getenv("MOCKLIBSECRET_ERROR_MESSAGE");
+  if (env_message != NULL) {
+    return g_strdup(env_message);
+  }
+
+  g_mutex_lock(&failure.lock);
+  const gboolean changed = failure.inotify_fd != -1
+                               ? error_file_changed_inotify_locked()
+                               : error_file_changed_stat_locked();
+  if (changed) {
+    reload_error_file_locked();
+  }
+
+  gchar *message = NULL;
+  if (failure.active) {
+    message = g_strdup(failure.message != NULL ? failure.message
+                                               : DEFAULT_ERROR_MESSAGE);
+  }
+  g_mutex_unlock(&failure.lock);
+
+  return message;
+}
+
+void failure_injection_atfork_prepare(void) { g_mutex_lock(&failure.lock); }
+
+void failure_injection_atfork_parent(void) { g_mutex_unlock(&failure.lock); }
+
+void failure_injection_atfork_child(void) {
+  // the inotify queue is shared with the parent, so one of us would miss
+  // events
+  if (failure.inotify_fd != -1) {
+    close(failure.inotify_fd);
+    failure.inotify_fd = -1;
+  }
+  setup_inotify_locked();
+  if (failure.inotify_fd == -1) {
+    error_file_changed_stat_locked();
+  }
+  reload_error_file_locked();
+  g_mutex_unlock(&failure.lock);
+}
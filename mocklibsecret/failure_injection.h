@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Failure injection for the tests.
+ *
+ * All libsecret calls fail if the environment variable
+ * MOCKLIBSECRET_ERROR_MESSAGE is set (its value is used as the error message)
+ * or if the file TMPDIR/mocklibsecret_error_message exists (its contents are
+ * used as the error message, or a generic message if it is empty).
+ *
+ * The file is watched via inotify, so that checking for it does not cost an
+ * open() on every call. If inotify is not available, we fall back to checking
+ * the file with stat().
+ */
+
+/* Resolves the path to the error file and starts watching it. */
+void failure_injection_init(void);
+
+/*
+ * Returns the error message if the current call should fail or NULL
+ * otherwise. The result must be freed with g_free().
+ */
+gchar *failure_injection_get_message(void);
+
+/* pthread_atfork() handlers, the child needs its own inotify instance */
+void failure_injection_atfork_prepare(void);
+void failure_injection_atfork_parent(void);
+void failure_injection_atfork_child(void);
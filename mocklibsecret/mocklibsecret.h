@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Extensions of the mock that are not part of the libsecret API.
+ *
+ * They can be resolved via dlsym() by test harnesses that preload the mock.
+ */
+
+/*
+ * Reresolves the location of passwords.ini from HOME and drops all cached
+ * data. Pending changes are written to the previous location first.
+ *
+ * This happens automatically on the next call into the library once HOME
+ * changes, this function only makes it explicit.
+ */
+void mocklibsecret_reinit(void);
+
+/*
+ * Writes the current contents of the store to path in the format of
+ * passwords.ini, e.g. to convert passwords.bin of the binary backend (see
+ * MOCKLIBSECRET_BACKEND in secret.c) back. Importing happens automatically.
+ */
+gboolean mocklibsecret_export_ini(const char *path, GError **error);
+
+/*
+ * Serves the store of this process over a Unix socket at socket_path to all
+ * processes that set MOCKLIBSECRET_DAEMON to it, until SIGINT or SIGTERM is
+ * received. See mocklibsecretd.c.
+ *
+ * socket_path is printed on stdout once connections are accepted.
+ */
+gboolean mocklibsecret_serve(const char *socket_path, GError **error);
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A daemon that owns the password store and serves it to all processes that
+ * set MOCKLIBSECRET_DAEMON to its socket, e.g. all test processes of a test
+ * run. Every process still loads the mock, but instead of each of them
+ * parsing and locking passwords.ini, only the daemon does so and can keep its
+ * cache warm.
+ *
+ * The store lives in the daemon's HOME and all the other environment
+ * variables of secret.c that configure the store apply to the daemon, not to
+ * its clients. Failures are still injected on the client side.
+ *
+ * Usage: mocklibsecretd --socket PATH
+ */
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "mocklibsecret.h"
+
+static gchar *socket_path = NULL;
+
+static GOptionEntry entries[] = {
+    {"socket", 's', 0, G_OPTION_ARG_FILENAME, &socket_path,
+     "Path of the Unix socket to listen on", "PATH"},
+    {NULL, 0, 0, 0, NULL, NULL, NULL}};
+
+int main(int argc, char **argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- serve the mocklibsecret store");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  if (socket_path == NULL) {
+    g_printerr("--socket is required\n");
+    return EXIT_FAILURE;
+  }
+
+  // pending changes are written by the library's destructor on exit
+  if (!mocklibsecret_serve(socket_path, &error)) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_free(socket_path);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+/* how much is read at once at least */
+#define READ_CHUNK_SIZE (64 * 1024)
+
+gsize protocol_begin_message(GString *out, guint8 code, guint8 present) {
+  const gsize start = out->len;
+  const message_header_t header = {0, code, present, 0};
+  g_string_append_len(out, (const gchar *)&header, sizeof(header));
+  return start;
+}
+
+void protocol_end_message(GString *out, gsize start) {
+  message_header_t header;
+  memcpy(&header, out->str + start, sizeof(header));
+  header.length = (guint32)(out->len - start - sizeof(header));
+  memcpy(out->str + start, &header, sizeof(header));
+}
+
+void protocol_append_message(GString *out, guint8 code, guint8 present,
+                             const gchar *const *strings, gsize n_strings) {
+  const gsize start = protocol_begin_message(out, code, present);
+  for (gsize i = 0; i < n_strings; ++i) {
+    if ((present & (1 << i)) != 0) {
+      // the NUL terminator is part of the message
+      g_string_append_len(out, strings[i], (gssize)strlen(strings[i]) + 1);
+    }
+  }
+  protocol_end_message(out, start);
+}
+
+gboolean protocol_write_all(int fd, const gchar *data, gsize length,
+                            GError **error) {
+  while (length > 0) {
+    // a peer that went away must not kill us with SIGPIPE, neither the daemon
+    // (which would take the store down for everyone) nor its clients
+    const ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      const int errsv = errno;
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                  "Failed to write to the socket: %s", g_strerror(errsv));
+      return FALSE;
+    }
+    data += written;
+    length -= (gsize)written;
+  }
+  return TRUE;
+}
+
+void protocol_reader_init(protocol_reader_t *reader, int fd) {
+  reader->fd = fd;
+  reader->buffer = g_string_sized_new(READ_CHUNK_SIZE);
+  reader->start = 0;
+}
+
+void protocol_reader_clear(protocol_reader_t *reader) {
+  if (reader->buffer != NULL) {
+    g_string_free(reader->buffer, TRUE);
+    reader->buffer = NULL;
+  }
+  reader->fd = -1;
+  reader->start = 0;
+}
+
+static gsize buffered(const protocol_reader_t *reader) {
+  return reader->buffer->len - reader->start;
+}
+
+gboolean protocol_reader_has_message(const protocol_reader_t *reader) {
+  if (buffered(reader) < sizeof(message_header_t)) {
+    return FALSE;
+  }
+  message_header_t header;
+  memcpy(&header, reader->buffer->str + reader->start, sizeof(header));
+  return buffered(reader) - sizeof(header) >= header.length;
+}
+
+/*
+ * Reads until at least length bytes are buffered, *eof is set if the peer
+ * closed the connection with nothing buffered.
+ */
+static gboolean fill(protocol_reader_t *reader, gsize length, gboolean *eof,
+                     GError **error) {
+  *eof = FALSE;
+  GString *buf = reader->buffer;
+
+  if (reader->start > 0 && buf->len - reader->start < length) {
+    // drop the consumed messages instead of growing the buffer forever
+    g_string_erase(buf, 0, (gssize)reader->start);
+    reader->start = 0;
+  }
+
+  while (buffered(reader) < length) {
+    const gsize old_len = buf->len;
+    const gsize chunk = MAX(length - buffered(reader), READ_CHUNK_SIZE);
+    g_string_set_size(buf, old_len + chunk);
+    const ssize_t n = read(reader->fd, buf->str + old_len, chunk);
+    g_string_truncate(buf, old_len + (gsize)MAX(n, 0));
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      const int errsv = errno;
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                  "Failed to read from the socket: %s", g_strerror(errsv));
+      return FALSE;
+    }
+    if (n == 0) {
+      if (buffered(reader) == 0) {
+        *eof = TRUE;
+        return FALSE;
+      }
+      g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+                          "Connection closed in the middle of a message");
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+gboolean protocol_reader_next(protocol_reader_t *reader,
+                              message_header_t *header, const gchar **payload,
+                              GError **error) {
+  gboolean eof;
+  if (!fill(reader, sizeof(*header), &eof, error)) {
+    return FALSE;
+  }
+  memcpy(header, reader->buffer->str + reader->start, sizeof(*header));
+  if (header->length > PROTOCOL_MAX_PAYLOAD) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Message of %u bytes is too large", header->length);
+    return FALSE;
+  }
+
+  if (!fill(reader, sizeof(*header) + header->length, &eof, error)) {
+    return FALSE;
+  }
+  *payload = reader->buffer->str + reader->start + sizeof(*header);
+  reader->start += sizeof(*header) + header->length;
+  return TRUE;
+}
+
+gboolean protocol_parse_request(const message_header_t *header,
+                                const gchar *payload, const gchar **strings,
+                                gsize n_strings, GError **error) {
+  const gchar *pos = payload;
+  const gchar *end = payload + header->length;
+
+  for (gsize i = 0; i < n_strings; ++i) {
+    strings[i] = NULL;
+    if ((header->present & (1 << i)) == 0) {
+      continue;
+    }
+    const gchar *nul = memchr(pos, '\0', (gsize)(end - pos));
+    if (nul == NULL) {
+      g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                          "Request is missing a string");
+      return FALSE;
+    }
+    strings[i] = pos;
+    pos = nul + 1;
+  }
+
+  if (pos != end) {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "Request has trailing data");
+    return FALSE;
+  }
+  return TRUE;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * The protocol between the library and mocklibsecretd (see server.c and
+ * mocklibsecretd.c), used if MOCKLIBSECRET_DAEMON is set.
+ *
+ * Every request and response is a message_header_t followed by its payload,
+ * a sequence of NUL terminated strings. Which of the strings of a request
+ * (service, account, password) are present is given by a bitmask, absent
+ * attributes match any value. Responses are sent in the order of the requests,
+ * so a client may pipeline requests on one connection.
+ *
+ * Responses carry no strings apart from:
+ * - PROTOCOL_LOOKUP: the password if the status is PROTOCOL_OK
+ * - PROTOCOL_SEARCH: service, account and password of every item
+ * - PROTOCOL_ERROR: the error message
+ *
+ * Both sides run on the same machine, so integers are in native byte order.
+ */
+
+typedef enum {
+  PROTOCOL_STORE = 1,
+  PROTOCOL_LOOKUP,
+  PROTOCOL_CLEAR,
+  PROTOCOL_SEARCH
+} protocol_op_t;
+
+typedef enum {
+  /* the operation succeeded, the entry was found or was removed */
+  PROTOCOL_OK = 0,
+  /* the operation succeeded but nothing was found or removed */
+  PROTOCOL_NOT_FOUND,
+  PROTOCOL_ERROR
+} protocol_status_t;
+
+/* bits of message_header_t.present */
+#define PROTOCOL_HAS_SERVICE (1 << 0)
+#define PROTOCOL_HAS_ACCOUNT (1 << 1)
+#define PROTOCOL_HAS_PASSWORD (1 << 2)
+
+/* upper bound of the payload, so that a broken peer cannot make us OOM */
+#define PROTOCOL_MAX_PAYLOAD (256 * 1024 * 1024)
+
+typedef struct {
+  /* size of the payload following the header */
+  guint32 length;
+  /* protocol_op_t for requests, protocol_status_t for responses */
+  guint8 code;
+  guint8 present;
+  guint16 reserved;
+} message_header_t;
+
+/*
+ * Appends a message to out, strings[i] is only included if bit i of present
+ * is set.
+ */
+void protocol_append_message(GString *out, guint8 code, guint8 present,
+                             const gchar *const *strings, gsize n_strings);
+
+/*
+ * Like protocol_append_message() for payloads that are appended piecewise:
+ * returns the offset of the message in out, which has to be passed to
+ * protocol_end_message() once the payload is complete.
+ */
+gsize protocol_begin_message(GString *out, guint8 code, guint8 present);
+void protocol_end_message(GString *out, gsize start);
+
+/*
+ * Writes everything to the socket fd or fails, EPIPE is reported as an error
+ * instead of raising SIGPIPE.
+ */
+gboolean protocol_write_all(int fd, const gchar *data, gsize length,
+                            GError **error);
+
+/*
+ * Buffered reading of messages: every read() fetches as much as the peer has
+ * already sent, so pipelined messages cost one system call in total instead
+ * of two per message.
+ */
+typedef struct {
+  int fd;
+  GString *buffer;
+  /* offset of the first unconsumed byte in buffer */
+  gsize start;
+} protocol_reader_t;
+
+void protocol_reader_init(protocol_reader_t *reader, int fd);
+void protocol_reader_clear(protocol_reader_t *reader);
+
+/* Whether a complete message is buffered, i.e. reading it does not block. */
+gboolean protocol_reader_has_message(const protocol_reader_t *reader);
+
+/*
+ * Reads the next message, payload points into the reader's buffer and stays
+ * valid until the next call. Returns FALSE without setting error if the peer
+ * closed the connection between two messages.
+ */
+gboolean protocol_reader_next(protocol_reader_t *reader,
+                              message_header_t *header, const gchar **payload,
+                              GError **error);
+
+/*
+ * Splits the payload of a request into strings according to present, absent
+ * strings are set to NULL. Fails if the payload does not contain exactly
+ * these strings.
+ */
+gboolean protocol_parse_request(const message_header_t *header,
+                                const gchar *payload, const gchar **strings,
+                                gsize n_strings, GError **error);
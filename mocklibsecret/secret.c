@@ -21,269 +21,2488 @@
  */
 
 #define _GNU_SOURCE
-#include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <fcntl.h>
+#include <gio/gio.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <libsecret/secret.h>
+#include <pthread.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
-// FIXME: at the moment it is not possible to use keytar.findPassword(), because
-// that calls secret_password_lookup_sync with only the service as the variadic
-// parameter and not the account too.
+#include "client.h"
+#include "failure_injection.h"
+#include "mocklibsecret.h"
+#include "protocol.h"
+#include "server.h"
+#include "stats.h"
+#include "store.h"
+
+/*
+ * The behavior of the mock can be tweaked via the following environment
+ * variables:
+ *
+ * MOCKLIBSECRET_WRITEBACK: "immediate" (default) writes passwords.ini on every
+ *     store and clear, "deferred" keeps modifications in memory and writes
+ *     them out in one go after MOCKLIBSECRET_WRITEBACK_DELAY_MS and when the
+ *     library is unloaded. "journal" only appends a record of every
+ *     modification to passwords.journal, which is folded into passwords.ini
+ *     (or passwords.bin) once it grows beyond MOCKLIBSECRET_JOURNAL_MAX_KB.
+ * MOCKLIBSECRET_WRITEBACK_DELAY_MS: how long modifications are coalesced in
+ *     the deferred mode before being written to disk (default: 100).
+ * MOCKLIBSECRET_JOURNAL_MAX_KB: the size of passwords.journal that triggers
+ *     its compaction in the journal mode (default: 256).
+ * MOCKLIBSECRET_FSYNC: passwords.ini is always replaced atomically, this
+ *     controls whether it is also flushed to stable storage: "none" never
+ *     syncs, "file" (default) fdatasync()s the file and "full" additionally
+ *     fsync()s the containing directory.
+ * MOCKLIBSECRET_STATS: write call and I/O statistics to this path when the
+ *     library is unloaded, see stats.h.
+ * MOCKLIBSECRET_BACKEND: "ini" (default) keeps the passwords in
+ *     passwords.ini, "binary" in passwords.bin, an image that is memory mapped
+ *     and read in place instead of being parsed (see store_new_from_image()).
+ *     passwords.ini is imported automatically if it changed since passwords.bin
+ *     was created from it, and mocklibsecret_export_ini() writes the contents
+ *     back into the ini format.
+ * MOCKLIBSECRET_DAEMON: the path of the socket of a mocklibsecretd, all
+ *     operations are then forwarded to it instead of accessing the store
+ *     directly (see mocklibsecretd.c). The store is then the one in the
+ *     daemon's HOME, configured by the daemon's environment.
+ * MOCKLIBSECRET_SHARDING: "none" (default) keeps all services in one store,
+ *     "service" gives every service its own passwords.ini (respectively .bin,
+ *     .journal and .ini.lock) in HOME/passwords.d, named after the URI escaped
+ *     service. Modifications then only rewrite, lock and invalidate the files
+ *     of their service, only queries without a service visit all of them.
+ */
 
 #define UNUSED(var) (void)var
 
-void secret_password_free(char *password) { g_free(password); }
+/*
+ * Passwords that are handed out to the caller by the lookups come from a pool
+ * of buffers in a few fixed size classes and return into it via
+ * secret_password_free(). Buffers are zeroed when they are released, so that
+ * no password lingers in freed memory, and repeated lookups reuse a handful of
+ * buffers instead of allocating a new one every time. Passwords that do not fit
+ * into the largest class get a buffer of their own, which is zeroed all the
+ * same.
+ */
+#define SECRET_BUFFER_MAGIC 0x5ec2e7b1
+/* the magic of buffers in the pool, so that double frees are caught */
+#define SECRET_BUFFER_FREE_MAGIC 0x5ec2f4ee
+#define N_SECRET_BUFFER_CLASSES 6
+/* free buffers that are kept per size class, others go back to the heap */
+#define SECRET_POOL_MAX_FREE 64
+
+/* usable size of the buffers of each class, including the terminating NUL */
+static const gsize secret_buffer_sizes[N_SECRET_BUFFER_CLASSES] = {
+    32, 64, 128, 256, 1024, 4096};
+
+typedef struct secret_buffer {
+  /* the next free buffer of the same class while this one is in the pool */
+  struct secret_buffer *next;
+  /* accessed atomically by secret_password_free() */
+  gint magic;
+  /* N_SECRET_BUFFER_CLASSES if the buffer does not belong to the pool */
+  guint32 size_class;
+  gsize capacity;
+  gchar data[];
+} secret_buffer_t;
+
+static struct {
+  GMutex lock;
+  secret_buffer_t *free[N_SECRET_BUFFER_CLASSES];
+  guint n_free[N_SECRET_BUFFER_CLASSES];
+} secret_pool;
+
+/* Returns a copy of password that has to be freed with secret_password_free. */
+static gchar *secret_buffer_dup(const gchar *password) {
+  const gsize len = strlen(password) + 1;
+  guint32 size_class = 0;
+  while (size_class < N_SECRET_BUFFER_CLASSES &&
+         secret_buffer_sizes[size_class] < len) {
+    ++size_class;
+  }
+
+  secret_buffer_t *buffer = NULL;
+  if (size_class < N_SECRET_BUFFER_CLASSES) {
+    g_mutex_lock(&secret_pool.lock);
+    buffer = secret_pool.free[size_class];
+    if (buffer != NULL) {
+      secret_pool.free[size_class] = buffer->next;
+      --secret_pool.n_free[size_class];
+    }
+    g_mutex_unlock(&secret_pool.lock);
+  }
+  if (buffer == NULL) {
+    const gsize capacity = size_class < N_SECRET_BUFFER_CLASSES
+                               ? secret_buffer_sizes[size_class]
+                               : len;
+    buffer = g_malloc(sizeof(secret_buffer_t) + capacity);
+    buffer->size_class = size_class;
+    buffer->capacity = capacity;
+  }
+  buffer->magic = SECRET_BUFFER_MAGIC;
+  buffer->next = NULL;
+  return memcpy(buffer->data, password, len);
+}
+
+void secret_password_free(gchar *password) {
+  if (password == NULL) {
+    return;
+  }
+  secret_buffer_t *buffer =
+      (secret_buffer_t *)(void *)(password - offsetof(secret_buffer_t, data));
+  // marking the buffer as free first also catches concurrent double frees
+  if (!g_atomic_int_compare_and_exchange(&buffer->magic, SECRET_BUFFER_MAGIC,
+                                         SECRET_BUFFER_FREE_MAGIC)) {
+    g_critical("%s: %p was not returned by a lookup or was already freed",
+               G_STRFUNC, (void *)password);
+    return;
+  }
+
+  explicit_bzero(buffer->data, buffer->capacity);
+  if (buffer->size_class < N_SECRET_BUFFER_CLASSES) {
+    g_mutex_lock(&secret_pool.lock);
+    if (secret_pool.n_free[buffer->size_class] < SECRET_POOL_MAX_FREE) {
+      buffer->next = secret_pool.free[buffer->size_class];
+      secret_pool.free[buffer->size_class] = buffer;
+      ++secret_pool.n_free[buffer->size_class];
+      g_mutex_unlock(&secret_pool.lock);
+      return;
+    }
+    g_mutex_unlock(&secret_pool.lock);
+  }
+  g_free(buffer);
+}
+
+/* Returns the free buffers of the pool to the heap. */
+static void secret_pool_drain(void) {
+  g_mutex_lock(&secret_pool.lock);
+  for (guint i = 0; i < N_SECRET_BUFFER_CLASSES; ++i) {
+    while (secret_pool.free[i] != NULL) {
+      secret_buffer_t *buffer = secret_pool.free[i];
+      secret_pool.free[i] = buffer->next;
+      g_free(buffer);
+    }
+    secret_pool.n_free[i] = 0;
+  }
+  g_mutex_unlock(&secret_pool.lock);
+}
+
+static GQuark quark;
+
+/*
+ * Names of the files of a shard, see shard_t. Without sharding they are
+ * HOME/passwords.ini and so on, with MOCKLIBSECRET_SHARDING=service the base
+ * name is the URI escaped service instead and the files are in
+ * HOME/passwords.d.
+ */
+#define DEFAULT_BASE_NAME "passwords"
+#define SHARDS_DIR_NAME "passwords.d"
+#define INI_SUFFIX ".ini"
+#define BIN_SUFFIX ".bin"
+#define JOURNAL_SUFFIX ".journal"
+#define LOCK_SUFFIX INI_SUFFIX ".lock"
+
+static gboolean set_error_from_errno(GError **error, const char *what,
+                                     const char *path) {
+  const int errsv = errno;
+  *error = g_error_new(G_FILE_ERROR, g_file_error_from_errno(errsv),
+                       "Failed to %s '%s': %s", what, path, g_strerror(errsv));
+  return FALSE;
+}
+
+typedef enum { SHARDING_NONE, SHARDING_SERVICE } sharding_t;
+
+static sharding_t sharding = SHARDING_NONE;
+
+static void read_sharding_config(void) {
+  const char *name = secure_getenv("MOCKLIBSECRET_SHARDING");
+  if (name == NULL || g_strcmp0(name, "none") == 0) {
+    sharding = SHARDING_NONE;
+  } else if (g_strcmp0(name, "service") == 0) {
+    sharding = SHARDING_SERVICE;
+  } else {
+    g_warning("Invalid value for MOCKLIBSECRET_SHARDING: '%s', falling back "
+              "to 'none'",
+              name);
+    sharding = SHARDING_NONE;
+  }
+}
+
+/*
+ * A part of the store that is cached, locked and written independently of all
+ * others.
+ *
+ * Without sharding there is only one shard, which holds all services. With
+ * sharding every service has its own, so that modifying the passwords of one
+ * service neither rewrites nor invalidates the cached passwords of the others
+ * and writers of different services do not wait for each other.
+ */
+typedef struct {
+  /* the service of the shard, NULL if it holds all of them */
+  gchar *service;
+  /* the directory of the files, owned by the location */
+  int dir_fd;
+  /* names of the files relative to dir_fd */
+  gchar *ini_name;
+  gchar *bin_name;
+  gchar *journal_name;
+  gchar *lock_name;
+  /* the full paths, only used for error messages */
+  gchar *ini_path;
+  gchar *bin_path;
+  gchar *journal_path;
+
+  /*
+   * keytar calls us from libuv's worker threads, so everything below must only
+   * be accessed with this lock held.
+   *
+   * Lookups and searches only take it for reading as long as the cached store
+   * is up to date (see acquire_reader()), so that they run concurrently.
+   * Everything that modifies the store or the cache needs it for writing.
+   */
+  GRWLock lock;
+
+  /*
+   * Cache of passwords.ini.
+   *
+   * passwords.ini is only parsed again if the file on disk got replaced or
+   * modified, which we detect via the device, inode, size and mtime reported
+   * by stat(). Writes create a new file and rename it over the old one (see
+   * write_file_atomically()), so every write of us or of another process
+   * results in a new inode.
+   *
+   * With the binary backend, the stat information is the one of passwords.bin
+   * and origin identifies the version of passwords.ini that it was created
+   * from.
+   *
+   * The records of passwords.journal are applied on top of that (see
+   * replay_journal()), journal identifies the version of the journal that was
+   * read up to journal_applied.
+   */
+  struct {
+    store_t *store;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    store_origin_t origin;
+    /* all zeros if there is no journal */
+    store_origin_t journal;
+    /* end of the last record that was applied */
+    guint64 journal_applied;
+    /* whether the journal belongs to the cached passwords.ini or .bin */
+    gboolean journal_valid;
+  } cache;
+
+  /*
+   * Modifications that have not been written to disk yet (only used with
+   * MOCKLIBSECRET_WRITEBACK=deferred).
+   *
+   * They are kept in addition to the modified cached store, so that they can
+   * be applied on top of passwords.ini if another process modified it in the
+   * meantime.
+   */
+  GPtrArray *pending_changes;
+
+  /*
+   * Scratch buffer for reading and writing passwords.ini, only used with lock
+   * held for writing.
+   *
+   * It is kept around between calls, so that reloading or saving the file
+   * does not have to allocate a buffer of the file's size every time.
+   * Unusually large buffers are released after use again, so that a single
+   * huge file does not pin its size in memory forever.
+   */
+  GString *io_buffer;
+
+  /* the fd of passwords.ini.lock, see lock_store() */
+  int lock_fd;
+  struct {
+    GMutex lock;
+    /* number of threads sharing the LOCK_SH */
+    guint readers;
+  } flock_state;
+} shard_t;
+
+static void forget_journal(shard_t *shard) {
+  memset(&shard->cache.journal, 0, sizeof(shard->cache.journal));
+  shard->cache.journal_applied = 0;
+  shard->cache.journal_valid = FALSE;
+}
+
+static void invalidate_cache(shard_t *shard) {
+  g_clear_pointer(&shard->cache.store, store_free);
+  forget_journal(shard);
+}
+
+/*
+ * Creates the shard of service (NULL for the one of all services) with its
+ * files in dir_fd, which is the directory path.
+ */
+static shard_t *shard_new(int dir_fd, const gchar *dir,
+                          const gchar *service) {
+  shard_t *shard = g_new0(shard_t, 1);
+  // escaped names contain no slashes and map back to exactly one service
+  g_autofree gchar *base = service != NULL
+                               ? g_uri_escape_string(service, NULL, FALSE)
+                               : g_strdup(DEFAULT_BASE_NAME);
+  shard->service = g_strdup(service);
+  shard->dir_fd = dir_fd;
+  shard->ini_name = g_strconcat(base, INI_SUFFIX, NULL);
+  shard->bin_name = g_strconcat(base, BIN_SUFFIX, NULL);
+  shard->journal_name = g_strconcat(base, JOURNAL_SUFFIX, NULL);
+  shard->lock_name = g_strconcat(base, LOCK_SUFFIX, NULL);
+  shard->ini_path = g_build_filename(dir, shard->ini_name, NULL);
+  shard->bin_path = g_build_filename(dir, shard->bin_name, NULL);
+  shard->journal_path = g_build_filename(dir, shard->journal_name, NULL);
+  g_rw_lock_init(&shard->lock);
+  g_mutex_init(&shard->flock_state.lock);
+  shard->lock_fd = -1;
+  return shard;
+}
+
+static void shard_free(gpointer data) {
+  shard_t *shard = data;
+  invalidate_cache(shard);
+  g_clear_pointer(&shard->pending_changes, g_ptr_array_unref);
+  if (shard->io_buffer != NULL) {
+    memset(shard->io_buffer->str, 0, shard->io_buffer->len);
+    g_string_free(shard->io_buffer, TRUE);
+  }
+  if (shard->lock_fd != -1) {
+    close(shard->lock_fd);
+  }
+  g_rw_lock_clear(&shard->lock);
+  g_mutex_clear(&shard->flock_state.lock);
+  g_free(shard->service);
+  g_free(shard->ini_name);
+  g_free(shard->bin_name);
+  g_free(shard->journal_name);
+  g_free(shard->lock_name);
+  g_free(shard->ini_path);
+  g_free(shard->bin_path);
+  g_free(shard->journal_path);
+  g_free(shard);
+}
+
+/*
+ * Location of the store, resolved once from HOME.
+ *
+ * A descriptor is only replaced as a whole if HOME changes (see
+ * ensure_store_location_locked()), new shards are added to it on demand. All
+ * file operations are performed relative to a directory fd, so that no entry
+ * point has to allocate just to find a file.
+ */
+typedef struct {
+  /* the value of HOME this descriptor was created for */
+  gchar *home;
+  /* HOME opened as a directory */
+  int dir_fd;
+  /* HOME/passwords.d and its fd, only with sharding */
+  gchar *shards_path;
+  int shards_fd;
+  /* the only shard without sharding */
+  shard_t *single;
+  /* service => shard_t with sharding, entries are never removed */
+  GHashTable *shards;
+  GMutex shards_lock;
+} store_location_t;
+
+static void store_location_free(store_location_t *location) {
+  g_clear_pointer(&location->single, shard_free);
+  g_clear_pointer(&location->shards, g_hash_table_unref);
+  if (location->shards_fd != -1) {
+    close(location->shards_fd);
+  }
+  if (location->dir_fd != -1) {
+    close(location->dir_fd);
+  }
+  g_mutex_clear(&location->shards_lock);
+  g_free(location->home);
+  g_free(location->shards_path);
+  g_free(location);
+}
+
+static store_location_t *store_location_new(const char *home,
+                                            GError **error) {
+  const int dir_fd = g_open(home, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+  if (dir_fd == -1) {
+    set_error_from_errno(error, "open", home);
+    return NULL;
+  }
+
+  store_location_t *location = g_new0(store_location_t, 1);
+  location->home = g_strdup(home);
+  location->dir_fd = dir_fd;
+  location->shards_fd = -1;
+  g_mutex_init(&location->shards_lock);
+
+  if (sharding == SHARDING_SERVICE) {
+    location->shards_path = g_build_filename(home, SHARDS_DIR_NAME, NULL);
+    if (mkdirat(dir_fd, SHARDS_DIR_NAME, S_IRWXU) != 0 && errno != EEXIST) {
+      set_error_from_errno(error, "create", location->shards_path);
+      store_location_free(location);
+      return NULL;
+    }
+    location->shards_fd =
+        openat(dir_fd, SHARDS_DIR_NAME, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (location->shards_fd == -1) {
+      set_error_from_errno(error, "open", location->shards_path);
+      store_location_free(location);
+      return NULL;
+    }
+    // the files of a shard are only created when something is stored in it
+    location->shards =
+        g_hash_table_new_full(g_str_hash, g_str_equal, NULL, shard_free);
+    return location;
+  }
+
+  location->single = shard_new(dir_fd, home, NULL);
+  // make sure that passwords.ini exists, lookups fail otherwise
+  const int fd =
+      openat(dir_fd, location->single->ini_name,
+             O_RDONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+  if (fd != -1) {
+    close(fd);
+  }
+
+  return location;
+}
+
+/*
+ * NULL if HOME is not set.
+ *
+ * Protected by location_lock: the location and its shards stay valid as long as
+ * it is held. Replacing the location needs it for writing, which also grants
+ * exclusive access to all shards, since their locks are only ever taken while
+ * holding location_lock for reading.
+ */
+static store_location_t *location = NULL;
+
+static GRWLock location_lock;
+
+/*
+ * Returns the shard that holds service, creating it on first use. service
+ * must only be NULL without sharding. Must be called with location_lock held.
+ */
+static shard_t *get_shard(const gchar *service) {
+  if (location->shards == NULL) {
+    return location->single;
+  }
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&location->shards_lock);
+  shard_t *shard = g_hash_table_lookup(location->shards, service);
+  if (shard == NULL) {
+    shard = shard_new(location->shards_fd, location->shards_path, service);
+    g_hash_table_insert(location->shards, shard->service, shard);
+  }
+  return shard;
+}
+
+/*
+ * All shards that were created so far (not the ones that only exist on disk).
+ * Must be called with location_lock held.
+ */
+static GPtrArray *get_shards(void) {
+  GPtrArray *shards = g_ptr_array_new();
+  if (location->shards == NULL) {
+    g_ptr_array_add(shards, location->single);
+    return shards;
+  }
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&location->shards_lock);
+  GHashTableIter iter;
+  gpointer shard;
+  g_hash_table_iter_init(&iter, location->shards);
+  while (g_hash_table_iter_next(&iter, NULL, &shard)) {
+    g_ptr_array_add(shards, shard);
+  }
+  return shards;
+}
+
+static gint compare_services(gconstpointer a, gconstpointer b) {
+  return g_strcmp0(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+/*
+ * The sorted names of all services that have a shard, either on disk or, with
+ * deferred writes, so far only in memory. Must be called with location_lock
+ * held and only with sharding.
+ */
+static GPtrArray *list_services(GError **error) {
+  GDir *dir = g_dir_open(location->shards_path, 0, error);
+  if (dir == NULL) {
+    return NULL;
+  }
+
+  // new shards only have a .bin or a .journal with the respective backend
+  // or write-back mode
+  static const char *const suffixes[] = {INI_SUFFIX, BIN_SUFFIX,
+                                         JOURNAL_SUFFIX};
+  g_autoptr(GHashTable) names =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (const gchar *name = g_dir_read_name(dir); name != NULL;
+       name = g_dir_read_name(dir)) {
+    for (gsize i = 0; i < G_N_ELEMENTS(suffixes); ++i) {
+      if (!g_str_has_suffix(name, suffixes[i])) {
+        continue;
+      }
+      g_autofree gchar *base =
+          g_strndup(name, strlen(name) - strlen(suffixes[i]));
+      gchar *service = g_uri_unescape_string(base, NULL);
+      if (service != NULL) {
+        g_hash_table_add(names, service);
+      }
+      break;
+    }
+  }
+  g_dir_close(dir);
+
+  g_autoptr(GPtrArray) shards = get_shards();
+  for (guint i = 0; i < shards->len; ++i) {
+    const shard_t *shard = g_ptr_array_index(shards, i);
+    g_hash_table_add(names, g_strdup(shard->service));
+  }
+
+  GPtrArray *services = g_ptr_array_new_full(
+      g_hash_table_size(names), g_free);
+  GHashTableIter iter;
+  gpointer service;
+  g_hash_table_iter_init(&iter, names);
+  while (g_hash_table_iter_next(&iter, &service, NULL)) {
+    g_ptr_array_add(services, g_strdup(service));
+  }
+  g_ptr_array_sort(services, compare_services);
+  return services;
+}
+
+typedef enum { BACKEND_INI, BACKEND_BINARY } backend_t;
+
+static backend_t backend = BACKEND_INI;
+
+static void read_backend_config(void) {
+  const char *name = secure_getenv("MOCKLIBSECRET_BACKEND");
+  if (name == NULL || g_strcmp0(name, "ini") == 0) {
+    backend = BACKEND_INI;
+  } else if (g_strcmp0(name, "binary") == 0) {
+    backend = BACKEND_BINARY;
+  } else {
+    g_warning("Invalid value for MOCKLIBSECRET_BACKEND: '%s', falling back to "
+              "'ini'",
+              name);
+    backend = BACKEND_INI;
+  }
+}
+
+static gboolean stat_matches_cache(const shard_t *shard,
+                                   const struct stat *st) {
+  return shard->cache.store != NULL && st->st_dev == shard->cache.dev &&
+         st->st_ino == shard->cache.ino && st->st_size == shard->cache.size &&
+         st->st_mtim.tv_sec == shard->cache.mtime.tv_sec &&
+         st->st_mtim.tv_nsec == shard->cache.mtime.tv_nsec;
+}
+
+static void remember_stat(shard_t *shard, const struct stat *st) {
+  shard->cache.dev = st->st_dev;
+  shard->cache.ino = st->st_ino;
+  shard->cache.size = st->st_size;
+  shard->cache.mtime = st->st_mtim;
+}
+
+/* Sets origin to the identity of st or to all zeros if st is NULL. */
+static void origin_from_stat(const struct stat *st, store_origin_t *origin) {
+  memset(origin, 0, sizeof(*origin));
+  if (st != NULL) {
+    origin->dev = st->st_dev;
+    origin->ino = st->st_ino;
+    origin->size = (guint64)st->st_size;
+    origin->mtime_sec = st->st_mtim.tv_sec;
+    origin->mtime_nsec = st->st_mtim.tv_nsec;
+  }
+}
+
+static gboolean origin_equal(const store_origin_t *a, const store_origin_t *b) {
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+         a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+/* The identity of the file that the cached store was loaded from. */
+static void cached_snapshot_origin(const shard_t *shard,
+                                   store_origin_t *origin) {
+  const struct stat st = {.st_dev = shard->cache.dev,
+                          .st_ino = shard->cache.ino,
+                          .st_size = shard->cache.size,
+                          .st_mtim = shard->cache.mtime};
+  origin_from_stat(&st, origin);
+}
+
+/*
+ * A copy of service, account and password in a single allocation, freed with
+ * credential_free(). Each of them may be NULL.
+ */
+typedef struct {
+  const gchar *service;
+  const gchar *account;
+  /* for pending changes: NULL if the entry got removed */
+  const gchar *password;
+  /* the strings above, allocated together with the struct */
+  gchar strings[];
+} credential_t;
+
+static credential_t *credential_new(const gchar *service, const gchar *account,
+                                    const gchar *password) {
+  const gchar *src[] = {service, account, password};
+  gsize lengths[G_N_ELEMENTS(src)];
+  gsize total = 0;
+  for (gsize i = 0; i < G_N_ELEMENTS(src); ++i) {
+    lengths[i] = src[i] != NULL ? strlen(src[i]) + 1 : 0;
+    total += lengths[i];
+  }
+
+  credential_t *credential = g_malloc(sizeof(credential_t) + total);
+  const gchar **dest[] = {&credential->service, &credential->account,
+                          &credential->password};
+  gchar *str = credential->strings;
+  for (gsize i = 0; i < G_N_ELEMENTS(src); ++i) {
+    *dest[i] = src[i] != NULL ? memcpy(str, src[i], lengths[i]) : NULL;
+    str += lengths[i];
+  }
+  return credential;
+}
+
+/* Frees a credential_t, without leaving its password behind in the heap. */
+static void credential_free(gpointer data) {
+  credential_t *credential = data;
+  if (credential->password != NULL) {
+    explicit_bzero((gchar *)credential->password, strlen(credential->password));
+  }
+  g_free(credential);
+}
+
+static void replay_pending_changes(const shard_t *shard, store_t *store) {
+  if (shard->pending_changes == NULL) {
+    return;
+  }
+  for (guint i = 0; i < shard->pending_changes->len; ++i) {
+    const credential_t *change = g_ptr_array_index(shard->pending_changes, i);
+    if (change->password != NULL) {
+      store_set(store, change->service, change->account, change->password);
+    } else {
+      // the entry might already be gone on disk, that's fine
+      store_remove(store, change->service, change->account);
+    }
+  }
+}
+
+#define IO_BUFFER_KEEP_SIZE (4 * 1024 * 1024)
+
+static GString *acquire_io_buffer(shard_t *shard) {
+  if (shard->io_buffer == NULL) {
+    shard->io_buffer = g_string_sized_new(4096);
+  }
+  return shard->io_buffer;
+}
+
+static void release_io_buffer(shard_t *shard) {
+  GString *io_buffer = shard->io_buffer;
+  if (io_buffer != NULL && io_buffer->allocated_len > IO_BUFFER_KEEP_SIZE) {
+    g_string_free(g_steal_pointer(&shard->io_buffer), TRUE);
+  } else if (io_buffer != NULL) {
+    // don't keep passwords around longer than necessary
+    memset(io_buffer->str, 0, io_buffer->len);
+    g_string_truncate(io_buffer, 0);
+  }
+}
+
+/*
+ * Reads everything from fd, which is path, into buf (replacing its contents).
+ * size_hint is the expected size of the contents.
+ */
+static gboolean read_fd(int fd, const gchar *path, gsize size_hint,
+                        GString *buf, GError **error) {
+  g_string_truncate(buf, 0);
+  gsize length = 0;
+  gsize wanted = size_hint + 1;
+
+  for (;;) {
+    g_string_set_size(buf, MAX(wanted, length + 1));
+    const ssize_t res = read(fd, buf->str + length, buf->len - length);
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res == -1) {
+      g_string_truncate(buf, length);
+      return set_error_from_errno(error, "read", path);
+    }
+    if (res == 0) {
+      break;
+    }
+    length += (gsize)res;
+    if (length == buf->len) {
+      wanted = 2 * buf->len;
+    }
+  }
+
+  g_string_truncate(buf, length);
+  return TRUE;
+}
+
+/*
+ * Reads and parses passwords.ini, st is set to the stat information of the
+ * file that was read. The file of a service's shard need not exist, it is
+ * then empty and st all zeros.
+ */
+static store_t *read_ini_file(shard_t *shard, struct stat *st,
+                              GError **error) {
+  gint64 start = stats_start();
+
+  const int fd = openat(shard->dir_fd, shard->ini_name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1 && errno == ENOENT && shard->service != NULL) {
+    memset(st, 0, sizeof(*st));
+    return store_new_from_data("", 0, error);
+  }
+  if (fd == -1) {
+    set_error_from_errno(error, "open", shard->ini_path);
+    if (!g_error_matches(*error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning("Error loading key file: %s", (*error)->message);
+    return NULL;
+  }
+
+  // stat the file that we actually read, it could have been replaced since the
+  // caller's fstatat()
+  GString *contents = acquire_io_buffer(shard);
+  gboolean success = FALSE;
+  if (fstat(fd, st) != 0) {
+    set_error_from_errno(error, "stat", shard->ini_path);
+  } else {
+    success = read_fd(fd, shard->ini_path, (gsize)st->st_size, contents, error);
+  }
+  close(fd);
+  if (!success) {
+    release_io_buffer(shard);
+    g_warning("Error loading key file: %s", (*error)->message);
+    return NULL;
+  }
+  stats_record_io(STATS_IO_READ, start, contents->len);
+
+  start = stats_start();
+  store_t *store = store_new_from_data(contents->str, contents->len, error);
+  release_io_buffer(shard);
+  if (store == NULL) {
+    g_warning("Error loading key file: %s", (*error)->message);
+    return NULL;
+  }
+  stats_record_io(STATS_IO_PARSE, start, 0);
+  return store;
+}
+
+/*
+ * Maps passwords.bin into memory, st is set to the stat information of the
+ * mapped file and origin to the passwords.ini it was created from.
+ */
+static store_t *read_binary_file(const shard_t *shard, struct stat *st,
+                                 store_origin_t *origin, GError **error) {
+  gint64 start = stats_start();
+
+  const int fd = openat(shard->dir_fd, shard->bin_name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    set_error_from_errno(error, "open", shard->bin_path);
+    return NULL;
+  }
+
+  GMappedFile *file = NULL;
+  if (fstat(fd, st) != 0) {
+    set_error_from_errno(error, "stat", shard->bin_path);
+  } else {
+    file = g_mapped_file_new_from_fd(fd, FALSE, error);
+  }
+  // the mapping stays valid after closing the fd
+  close(fd);
+  if (file == NULL) {
+    return NULL;
+  }
+  g_autoptr(GBytes) image = g_mapped_file_get_bytes(file);
+  g_mapped_file_unref(file);
+  stats_record_io(STATS_IO_READ, start, g_bytes_get_size(image));
+
+  start = stats_start();
+  store_t *store = store_new_from_image(image, origin, error);
+  if (store != NULL) {
+    stats_record_io(STATS_IO_PARSE, start, 0);
+  }
+  return store;
+}
+
+/*
+ * passwords.journal starts with the store_origin_t of the passwords.ini (or
+ * passwords.bin with the binary backend) that it applies to and continues
+ * with one record per modification, in the message format of protocol.h:
+ * PROTOCOL_STORE with service, account and password or PROTOCOL_CLEAR with
+ * service and account.
+ *
+ * The journal is only ever appended to, while holding the exclusive lock. To
+ * start a new one, e.g. after a compaction rewrote passwords.ini, it is
+ * replaced as a whole. Thus a journal with the same inode as the cached one
+ * only grew and just the new records need to be applied. A journal that does
+ * not belong to the current passwords.ini, e.g. because it was modified
+ * behind our back, is ignored.
+ */
+
+static void apply_record(store_t *store, const message_header_t *header,
+                         const gchar *const *strings) {
+  if (header->code == PROTOCOL_STORE) {
+    store_set(store, strings[0], strings[1], strings[2]);
+  } else {
+    store_remove(store, strings[0], strings[1]);
+  }
+}
+
+static gboolean is_valid_record(const message_header_t *header,
+                                const gchar *const *strings) {
+  const guint8 entry = PROTOCOL_HAS_SERVICE | PROTOCOL_HAS_ACCOUNT;
+  const guint8 expected = header->code == PROTOCOL_STORE
+                              ? entry | PROTOCOL_HAS_PASSWORD
+                              : entry;
+  return (header->code == PROTOCOL_STORE || header->code == PROTOCOL_CLEAR) &&
+         header->present == expected &&
+         store_is_valid_name(strings[0], strings[1]);
+}
+
+/*
+ * Brings store up to date with passwords.journal: applies the records that
+ * were appended since the last call or all of them if it is a different
+ * journal. Must be called with the shard's lock held for writing.
+ */
+static gboolean replay_journal(shard_t *shard, store_t *store,
+                               GError **error) {
+  const gint64 start = stats_start();
+
+  const int fd =
+      openat(shard->dir_fd, shard->journal_name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1 && errno == ENOENT) {
+    forget_journal(shard);
+    return TRUE;
+  }
+  if (fd == -1) {
+    return set_error_from_errno(error, "open", shard->journal_path);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return set_error_from_errno(error, "stat", shard->journal_path);
+  }
+  store_origin_t origin;
+  origin_from_stat(&st, &origin);
+
+  guint64 offset = shard->cache.journal_applied;
+  if (!shard->cache.journal_valid || shard->cache.journal.dev != origin.dev ||
+      shard->cache.journal.ino != origin.ino || origin.size < offset) {
+    store_origin_t base, snapshot;
+    cached_snapshot_origin(shard, &snapshot);
+    shard->cache.journal_valid =
+        pread(fd, &base, sizeof(base), 0) == (ssize_t)sizeof(base) &&
+        origin_equal(&base, &snapshot);
+    offset = sizeof(base);
+  }
+  const guint64 first = offset;
+  shard->cache.journal = origin;
+  if (!shard->cache.journal_valid ||
+      lseek(fd, (off_t)offset, SEEK_SET) == -1) {
+    shard->cache.journal_applied = 0;
+    close(fd);
+    return TRUE;
+  }
+
+  protocol_reader_t reader;
+  protocol_reader_init(&reader, fd);
+  message_header_t header;
+  const gchar *payload;
+  g_autoptr(GError) record_error = NULL;
+  while (protocol_reader_next(&reader, &header, &payload, &record_error)) {
+    const gchar *strings[3];
+    if (!protocol_parse_request(&header, payload, strings,
+                                G_N_ELEMENTS(strings), &record_error) ||
+        !is_valid_record(&header, strings)) {
+      g_warning("Ignoring %s from offset %" G_GUINT64_FORMAT " on: %s",
+                shard->journal_path, offset,
+                record_error != NULL ? record_error->message
+                                     : "invalid record");
+      break;
+    }
+    apply_record(store, &header, strings);
+    offset += sizeof(header) + header.length;
+  }
+  // a torn record at the end is left over by a writer that crashed, the
+  // next one cuts it off
+  protocol_reader_clear(&reader);
+  close(fd);
+  stats_record_io(STATS_IO_READ, start, offset - first);
+
+  shard->cache.journal_applied = offset;
+  return TRUE;
+}
+
+static gboolean save_ini_file(shard_t *shard, store_t *store, GError **error);
+
+/* Loads the store for the binary backend, see open_ini_file(). */
+static store_t *open_binary_file(shard_t *shard, GError **error) {
+  struct stat ini_st, bin_st;
+  const gboolean have_ini =
+      fstatat(shard->dir_fd, shard->ini_name, &ini_st, 0) == 0;
+  store_origin_t origin;
+  origin_from_stat(have_ini ? &ini_st : NULL, &origin);
+
+  g_autoptr(GError) bin_error = NULL;
+  store_origin_t image_origin;
+  store_t *store = read_binary_file(shard, &bin_st, &image_origin, &bin_error);
+  if (store != NULL && have_ini && !origin_equal(&origin, &image_origin)) {
+    // passwords.ini was modified since the image was created from it, e.g.
+    // by a process using the ini backend, its contents take precedence
+    g_clear_pointer(&store, store_free);
+  } else if (store == NULL &&
+             !g_error_matches(bin_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+    g_warning("Error loading %s, importing %s instead: %s", shard->bin_path,
+              shard->ini_path, bin_error->message);
+  }
+
+  if (store != NULL) {
+    shard->cache.origin = origin;
+    shard->cache.store = store;
+    remember_stat(shard, &bin_st);
+    return shard->cache.store;
+  }
+
+  store = read_ini_file(shard, &ini_st, error);
+  if (store == NULL) {
+    return NULL;
+  }
+  if (ini_st.st_ino == 0) {
+    // a shard without any files, don't create one just for reading it
+    memset(&shard->cache.origin, 0, sizeof(shard->cache.origin));
+    remember_stat(shard, &ini_st);
+    shard->cache.store = store;
+    return shard->cache.store;
+  }
+
+  // replace passwords.bin right away, so that the following loads can map
+  // it. We only hold a shared lock, but concurrent readers would all write an
+  // image with the same contents and writers are excluded.
+  origin_from_stat(&ini_st, &shard->cache.origin);
+  g_autoptr(GError) save_error = NULL;
+  if (!save_ini_file(shard, store, &save_error)) {
+    // reload on the next call
+    const struct stat unknown = {0};
+    remember_stat(shard, &unknown);
+  }
+  shard->cache.store = store;
+  return shard->cache.store;
+}
+
+/*
+ * Whether the cached store was loaded from the current passwords.ini (or
+ * passwords.bin), not taking the journal into account.
+ */
+static gboolean snapshot_is_current(const shard_t *shard) {
+  struct stat st;
+  if (backend == BACKEND_BINARY) {
+    const gboolean have_ini =
+        fstatat(shard->dir_fd, shard->ini_name, &st, 0) == 0;
+    store_origin_t origin;
+    origin_from_stat(have_ini ? &st : NULL, &origin);
+    if (!origin_equal(&origin, &shard->cache.origin)) {
+      return FALSE;
+    }
+  }
+
+  const char *name =
+      backend == BACKEND_BINARY ? shard->bin_name : shard->ini_name;
+  if (fstatat(shard->dir_fd, name, &st, 0) != 0) {
+    // the shard of a service was cached while it had no file
+    return errno == ENOENT && shard->service != NULL &&
+           shard->cache.store != NULL && shard->cache.ino == 0;
+  }
+  return stat_matches_cache(shard, &st);
+}
+
+/* Whether all of passwords.journal has been applied to the cached store. */
+static gboolean journal_is_current(const shard_t *shard) {
+  struct stat st;
+  if (fstatat(shard->dir_fd, shard->journal_name, &st, 0) != 0) {
+    return errno == ENOENT && shard->cache.journal.ino == 0;
+  }
+  store_origin_t origin;
+  origin_from_stat(&st, &origin);
+  return origin_equal(&origin, &shard->cache.journal);
+}
+
+/*
+ * Returns the cached store if it matches the files on disk and NULL otherwise.
+ * Only needs the shard's lock held for reading.
+ */
+static store_t *get_fresh_cached_store(const shard_t *shard) {
+  return shard->cache.store != NULL && snapshot_is_current(shard) &&
+                 journal_is_current(shard)
+             ? shard->cache.store
+             : NULL;
+}
+
+/*
+ * Returns the cached store of the shard, (re)loading it from disk if it
+ * changed.
+ *
+ * The returned store is owned by the cache and must not be freed. It must
+ * only be used while holding the shard's lock for writing. On failure NULL is
+ * returned and error is set.
+ */
+static store_t *open_ini_file(shard_t *shard, GError **error) {
+  *error = NULL;
+
+  if (get_fresh_cached_store(shard) != NULL) {
+    stats_record_cache(TRUE);
+    return shard->cache.store;
+  }
+
+  stats_record_cache(FALSE);
+  if (shard->cache.store == NULL || !snapshot_is_current(shard)) {
+    invalidate_cache(shard);
+
+    if (backend == BACKEND_BINARY) {
+      if (open_binary_file(shard, error) == NULL) {
+        return NULL;
+      }
+    } else {
+      struct stat st;
+      store_t *store = read_ini_file(shard, &st, error);
+      if (store == NULL) {
+        return NULL;
+      }
+      shard->cache.store = store;
+      remember_stat(shard, &st);
+    }
+  }
+
+  // only the journal changed if the cached store is still there
+  if (!replay_journal(shard, shard->cache.store, error)) {
+    invalidate_cache(shard);
+    return NULL;
+  }
+  replay_pending_changes(shard, shard->cache.store);
+  return shard->cache.store;
+}
+
+typedef enum {
+  /* never call fdatasync(), the file is still replaced atomically */
+  DURABILITY_NONE,
+  /* fdatasync() the new file before renaming it */
+  DURABILITY_FILE,
+  /* additionally fsync() the directory after the rename */
+  DURABILITY_FULL
+} durability_t;
+
+static durability_t durability = DURABILITY_FILE;
+
+static void read_durability_config(void) {
+  const char *policy = secure_getenv("MOCKLIBSECRET_FSYNC");
+  if (policy == NULL || g_strcmp0(policy, "file") == 0) {
+    durability = DURABILITY_FILE;
+  } else if (g_strcmp0(policy, "none") == 0) {
+    durability = DURABILITY_NONE;
+  } else if (g_strcmp0(policy, "full") == 0) {
+    durability = DURABILITY_FULL;
+  } else {
+    g_warning("Invalid value for MOCKLIBSECRET_FSYNC: '%s', falling back to "
+              "'file'",
+              policy);
+    durability = DURABILITY_FILE;
+  }
+}
+
+/*
+ * Replaces the file name in the shard's directory (path is its full path)
+ * with data.
+ *
+ * The data is written into a temporary file in the same directory which is
+ * then renamed over the file, so that readers (and we after a crash) either
+ * see the old or the new contents but never a partially written file. The
+ * stat information of the new file is stored in st.
+ */
+static gboolean write_file_atomically(const shard_t *shard, const gchar *name,
+                                      const gchar *path, const gchar *data,
+                                      gsize length, struct stat *st,
+                                      GError **error) {
+  const int dir_fd = shard->dir_fd;
+  g_autofree gchar *tmp_name = NULL;
+  int fd = -1;
+  for (int attempt = 0; fd == -1 && attempt < 100; ++attempt) {
+    g_free(tmp_name);
+    tmp_name = g_strdup_printf("%s.%08" G_GINT32_MODIFIER "x", name,
+                               g_random_int());
+    fd = openat(dir_fd, tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1 && errno != EEXIST) {
+      break;
+    }
+  }
+  if (fd == -1) {
+    return set_error_from_errno(error, "create temporary file for", path);
+  }
+
+  gsize written = 0;
+  while (written < length) {
+    const ssize_t res = write(fd, data + written, length - written);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      set_error_from_errno(error, "write", tmp_name);
+      goto err;
+    }
+    written += (gsize)res;
+  }
+
+  // don't depend on the umask
+  if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP) != 0) {
+    set_error_from_errno(error, "set permissions of", tmp_name);
+    goto err;
+  }
+
+  if (durability != DURABILITY_NONE && fdatasync(fd) != 0) {
+    set_error_from_errno(error, "sync", tmp_name);
+    goto err;
+  }
+
+  // rename() does not modify the mtime, so this is the stat of the final file
+  if (fstat(fd, st) != 0) {
+    set_error_from_errno(error, "stat", tmp_name);
+    goto err;
+  }
+
+  if (close(fd) != 0) {
+    set_error_from_errno(error, "close", tmp_name);
+    unlinkat(dir_fd, tmp_name, 0);
+    return FALSE;
+  }
+
+  if (renameat(dir_fd, tmp_name, dir_fd, name) != 0) {
+    set_error_from_errno(error, "rename temporary file to", path);
+    unlinkat(dir_fd, tmp_name, 0);
+    return FALSE;
+  }
+
+  if (durability == DURABILITY_FULL && fsync(dir_fd) != 0) {
+    return set_error_from_errno(error, "sync the directory of", path);
+  }
+
+  return TRUE;
+
+err:
+  close(fd);
+  unlinkat(dir_fd, tmp_name, 0);
+  return FALSE;
+}
+
+/*
+ * Writes the cached store back to disk (in the format of the backend) and
+ * updates the cached stat information, so that we do not reparse our own
+ * write.
+ */
+static gboolean save_ini_file(shard_t *shard, store_t *store,
+                              GError **error) {
+  GString *data = acquire_io_buffer(shard);
+  gint64 start = stats_start();
+  if (backend == BACKEND_BINARY) {
+    store_to_image(store, &shard->cache.origin, data);
+  } else {
+    store_to_data(store, data);
+  }
+  stats_record_io(STATS_IO_SERIALIZE, start, 0);
+
+  struct stat st;
+  start = stats_start();
+  const gboolean success =
+      backend == BACKEND_BINARY
+          ? write_file_atomically(shard, shard->bin_name, shard->bin_path,
+                                  data->str, data->len, &st, error)
+          : write_file_atomically(shard, shard->ini_name, shard->ini_path,
+                                  data->str, data->len, &st, error);
+  if (success) {
+    stats_record_io(STATS_IO_WRITE, start, data->len);
+  }
+  release_io_buffer(shard);
+  if (!success) {
+    g_warning("Error saving key file: %s", (*error)->message);
+    // the in-memory copy now differs from the file => drop it
+    invalidate_cache(shard);
+    return FALSE;
+  }
+
+  remember_stat(shard, &st);
+  // the journal is folded into the new file, it would be ignored anyway
+  // since it does not belong to it
+  if (shard->cache.journal.ino != 0) {
+    unlinkat(shard->dir_fd, shard->journal_name, 0);
+    forget_journal(shard);
+  }
+  return TRUE;
+}
+
+/*
+ * Cross process locking of passwords.ini.
+ *
+ * Since passwords.ini gets replaced on every write, we cannot lock it directly
+ * and use passwords.ini.lock instead. Readers take a shared lock, while
+ * modifications take an exclusive lock for the whole read-modify-write cycle,
+ * so that concurrent writers in different processes don't lose updates.
+ *
+ * flock() locks belong to the open file description and not to a thread, so
+ * they must only be taken while holding the shard's lock. Threads that hold
+ * it for reading share one LOCK_SH, which is released by the last of them.
+ *
+ * A store_lock_t is the locked shard or NULL.
+ */
+typedef shard_t *store_lock_t;
+
+static void unlock_store(store_lock_t shard) {
+  g_autoptr(GMutexLocker) locker =
+      g_mutex_locker_new(&shard->flock_state.lock);
+  if (shard->flock_state.readers > 0 && --shard->flock_state.readers > 0) {
+    return;
+  }
+  while (flock(shard->lock_fd, LOCK_UN) != 0 && errno == EINTR)
+    ;
+}
+
+G_DEFINE_AUTO_CLEANUP_FREE_FUNC(store_lock_t, unlock_store, NULL)
+
+/*
+ * Acquires the cross process lock of the shard with the flock() operation
+ * LOCK_SH or LOCK_EX. Returns NULL on failure. Must be called with the
+ * shard's lock held, for writing in the case of LOCK_EX.
+ */
+static store_lock_t lock_store(shard_t *shard, int operation,
+                               GError **error) {
+  g_autoptr(GMutexLocker) locker =
+      g_mutex_locker_new(&shard->flock_state.lock);
+  if (operation == LOCK_SH && shard->flock_state.readers > 0) {
+    shard->flock_state.readers++;
+    return shard;
+  }
+
+  if (shard->lock_fd == -1) {
+    shard->lock_fd =
+        openat(shard->dir_fd, shard->lock_name, O_RDWR | O_CREAT | O_CLOEXEC,
+               S_IRUSR | S_IWUSR | S_IRGRP);
+    if (shard->lock_fd == -1) {
+      set_error_from_errno(error, "open", shard->lock_name);
+      return NULL;
+    }
+  }
+
+  while (flock(shard->lock_fd, operation) != 0) {
+    if (errno != EINTR) {
+      *error = g_error_new(quark, 0, "Failed to lock %s: %s", shard->ini_name,
+                           g_strerror(errno));
+      return NULL;
+    }
+  }
+  if (operation == LOCK_SH) {
+    shard->flock_state.readers = 1;
+  }
+  return shard;
+}
+
+typedef enum {
+  WRITEBACK_IMMEDIATE,
+  WRITEBACK_DEFERRED,
+  WRITEBACK_JOURNAL
+} writeback_mode_t;
+
+/*
+ * State of the flusher thread. It needs a GMutex for waiting on cond, so it
+ * has its own lock, which is taken after the locks of the shards.
+ */
+static struct {
+  writeback_mode_t mode;
+  gint64 delay_usec;
+  guint64 journal_max_size;
+  GMutex lock;
+  /* the following are protected by lock */
+  GThread *flusher;
+  GCond cond;
+  gint64 deadline;
+  /* the number of shards whose pending_changes are not empty */
+  guint pending;
+  gboolean shutdown;
+} writeback = {WRITEBACK_IMMEDIATE, 100 * 1000, 256 * 1024, {0}, NULL, {0}, 0,
+               0, FALSE};
+
+static void read_writeback_config(void) {
+  const char *mode = secure_getenv("MOCKLIBSECRET_WRITEBACK");
+  if (mode == NULL || g_strcmp0(mode, "immediate") == 0) {
+    writeback.mode = WRITEBACK_IMMEDIATE;
+  } else if (g_strcmp0(mode, "deferred") == 0) {
+    writeback.mode = WRITEBACK_DEFERRED;
+  } else if (g_strcmp0(mode, "journal") == 0) {
+    writeback.mode = WRITEBACK_JOURNAL;
+  } else {
+    g_warning("Invalid value for MOCKLIBSECRET_WRITEBACK: '%s', falling back "
+              "to 'immediate'",
+              mode);
+    writeback.mode = WRITEBACK_IMMEDIATE;
+  }
+
+  const char *delay = secure_getenv("MOCKLIBSECRET_WRITEBACK_DELAY_MS");
+  if (delay != NULL) {
+    gchar *end = NULL;
+    const guint64 delay_ms = g_ascii_strtoull(delay, &end, 10);
+    if (end == delay || *end != '\0') {
+      g_warning("Invalid value for MOCKLIBSECRET_WRITEBACK_DELAY_MS: '%s'",
+                delay);
+    } else {
+      writeback.delay_usec = (gint64)delay_ms * 1000;
+    }
+  }
+
+  const char *max_kb = secure_getenv("MOCKLIBSECRET_JOURNAL_MAX_KB");
+  if (max_kb != NULL) {
+    gchar *end = NULL;
+    const guint64 kb = g_ascii_strtoull(max_kb, &end, 10);
+    if (end == max_kb || *end != '\0') {
+      g_warning("Invalid value for MOCKLIBSECRET_JOURNAL_MAX_KB: '%s'",
+                max_kb);
+    } else {
+      writeback.journal_max_size = kb * 1024;
+    }
+  }
+}
+
+/* Lets the flusher thread retry after the delay. */
+static void postpone_flush(void) {
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&writeback.lock);
+  writeback.deadline = g_get_monotonic_time() + writeback.delay_usec;
+}
+
+static void clear_pending_changes_locked(shard_t *shard) {
+  if (shard->pending_changes == NULL || shard->pending_changes->len == 0) {
+    return;
+  }
+  g_ptr_array_set_size(shard->pending_changes, 0);
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&writeback.lock);
+  writeback.pending--;
+}
+
+/*
+ * Writes all pending changes of the shard to disk. Must be called with the
+ * shard's lock (or location_lock) held for writing.
+ */
+static void flush_pending_changes_locked(shard_t *shard) {
+  if (shard->pending_changes == NULL || shard->pending_changes->len == 0) {
+    return;
+  }
+
+  g_autoptr(GError) err = NULL;
+  g_auto(store_lock_t) file_lock = lock_store(shard, LOCK_EX, &err);
+  if (file_lock == NULL) {
+    g_warning("Error flushing pending changes: %s", err->message);
+    postpone_flush();
+    return;
+  }
+
+  store_t *store = open_ini_file(shard, &err);
+  if (store == NULL) {
+    // retry on the next deadline
+    postpone_flush();
+    return;
+  }
+  g_clear_error(&err);
+
+  if (!save_ini_file(shard, store, &err)) {
+    postpone_flush();
+    return;
+  }
+
+  clear_pending_changes_locked(shard);
+}
+
+/*
+ * Writes the pending changes of all shards, one after the other. Must be
+ * called with location_lock held for writing.
+ */
+static void flush_all_pending_changes_locked(void) {
+  if (location == NULL) {
+    return;
+  }
+  g_autoptr(GPtrArray) shards = get_shards();
+  for (guint i = 0; i < shards->len; ++i) {
+    flush_pending_changes_locked(g_ptr_array_index(shards, i));
+  }
+}
+
+/*
+ * Like flush_all_pending_changes_locked(), but only locks one shard at a time,
+ * so that the others stay accessible meanwhile.
+ */
+static void flush_all_pending_changes(void) {
+  g_autoptr(GRWLockReaderLocker) locker =
+      g_rw_lock_reader_locker_new(&location_lock);
+  if (location == NULL) {
+    return;
+  }
+  g_autoptr(GPtrArray) shards = get_shards();
+  for (guint i = 0; i < shards->len; ++i) {
+    shard_t *shard = g_ptr_array_index(shards, i);
+    g_rw_lock_writer_lock(&shard->lock);
+    flush_pending_changes_locked(shard);
+    g_rw_lock_writer_unlock(&shard->lock);
+  }
+}
+
+static gpointer flusher_thread(gpointer data) {
+  UNUSED(data);
+
+  g_mutex_lock(&writeback.lock);
+  while (!writeback.shutdown) {
+    if (writeback.pending == 0) {
+      g_cond_wait(&writeback.cond, &writeback.lock);
+      continue;
+    }
+
+    if (g_get_monotonic_time() < writeback.deadline) {
+      g_cond_wait_until(&writeback.cond, &writeback.lock, writeback.deadline);
+      continue;
+    }
+
+    // respect the lock order
+    g_mutex_unlock(&writeback.lock);
+    flush_all_pending_changes();
+    g_mutex_lock(&writeback.lock);
+  }
+  g_mutex_unlock(&writeback.lock);
+
+  return NULL;
+}
+
+/*
+ * Appends data to the journal, whose cached version must be current, after
+ * cutting off a torn record at its end. st is set to its new stat
+ * information.
+ */
+static gboolean append_to_journal(const shard_t *shard, const gchar *data,
+                                  gsize length, struct stat *st,
+                                  GError **error) {
+  const int fd =
+      openat(shard->dir_fd, shard->journal_name, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return set_error_from_errno(error, "open", shard->journal_path);
+  }
+
+  const off_t offset = (off_t)shard->cache.journal_applied;
+  gsize written = 0;
+  if (shard->cache.journal.size != shard->cache.journal_applied &&
+      ftruncate(fd, offset) != 0) {
+    set_error_from_errno(error, "truncate", shard->journal_path);
+    goto err;
+  }
+  while (written < length) {
+    const ssize_t res = pwrite(fd, data + written, length - written,
+                               offset + (off_t)written);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      set_error_from_errno(error, "write", shard->journal_path);
+      goto err;
+    }
+    written += (gsize)res;
+  }
+  if (durability != DURABILITY_NONE && fdatasync(fd) != 0) {
+    set_error_from_errno(error, "sync", shard->journal_path);
+    goto err;
+  }
+  if (fstat(fd, st) != 0) {
+    set_error_from_errno(error, "stat", shard->journal_path);
+    goto err;
+  }
+  return close(fd) == 0 ||
+         set_error_from_errno(error, "close", shard->journal_path);
+
+err:
+  close(fd);
+  return FALSE;
+}
+
+/*
+ * Records the modification in passwords.journal, which is started if
+ * necessary and compacted once it gets too large. Must be called with the
+ * shard's lock held for writing and the exclusive lock.
+ */
+static gboolean journal_change(shard_t *shard, store_t *store,
+                               const gchar *service, const gchar *account,
+                               const gchar *password, GError **error) {
+  GString *data = acquire_io_buffer(shard);
+  const gboolean start_journal = !shard->cache.journal_valid;
+  if (start_journal) {
+    store_origin_t base;
+    cached_snapshot_origin(shard, &base);
+    g_string_append_len(data, (const gchar *)&base, sizeof(base));
+  }
+  const gchar *const strings[] = {service, account, password};
+  protocol_append_message(
+      data, password != NULL ? PROTOCOL_STORE : PROTOCOL_CLEAR,
+      PROTOCOL_HAS_SERVICE | PROTOCOL_HAS_ACCOUNT |
+          (password != NULL ? PROTOCOL_HAS_PASSWORD : 0),
+      strings, G_N_ELEMENTS(strings));
+
+  struct stat st;
+  const gint64 start = stats_start();
+  const gboolean success =
+      start_journal ? write_file_atomically(shard, shard->journal_name,
+                                            shard->journal_path, data->str,
+                                            data->len, &st, error)
+                    : append_to_journal(shard, data->str, data->len, &st,
+                                        error);
+  if (success) {
+    stats_record_io(STATS_IO_WRITE, start, data->len);
+  }
+  release_io_buffer(shard);
+  if (!success) {
+    g_warning("Error appending to the journal: %s", (*error)->message);
+    invalidate_cache(shard);
+    return FALSE;
+  }
+
+  origin_from_stat(&st, &shard->cache.journal);
+  shard->cache.journal_applied = (guint64)st.st_size;
+  shard->cache.journal_valid = TRUE;
+
+  if (shard->cache.journal_applied > writeback.journal_max_size) {
+    // the modification is safe in the journal already, compacting can be
+    // retried by the next one
+    g_autoptr(GError) compact_error = NULL;
+    save_ini_file(shard, store, &compact_error);
+  }
+  return TRUE;
+}
+
+/*
+ * Persists the modification of service/account in the cached store of the
+ * shard, either right away, after the coalescing delay or in the journal.
+ * Must be called with the shard's lock held for writing.
+ */
+static gboolean commit_change(shard_t *shard, store_t *store,
+                              const gchar *service, const gchar *account,
+                              const gchar *password, GError **error) {
+  if (writeback.mode == WRITEBACK_IMMEDIATE) {
+    return save_ini_file(shard, store, error);
+  }
+  if (writeback.mode == WRITEBACK_JOURNAL) {
+    return journal_change(shard, store, service, account, password, error);
+  }
+
+  if (shard->pending_changes == NULL) {
+    shard->pending_changes = g_ptr_array_new_with_free_func(credential_free);
+  }
+  const gboolean first_change = shard->pending_changes->len == 0;
+  g_ptr_array_add(shard->pending_changes,
+                  credential_new(service, account, password));
+
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&writeback.lock);
+  // the deadline is not moved on further modifications, so that the data on
+  // disk is never more than delay_usec behind
+  if (first_change && writeback.pending++ == 0) {
+    writeback.deadline = g_get_monotonic_time() + writeback.delay_usec;
+  }
+
+  if (writeback.flusher == NULL) {
+    writeback.flusher =
+        g_thread_try_new("mocklibsecret-flusher", flusher_thread, NULL, error);
+    if (writeback.flusher == NULL) {
+      g_warning("Could not start the flusher thread: %s, writing directly",
+                (*error)->message);
+      g_clear_error(error);
+      // no flusher means that no other shard has pending changes
+      writeback.mode = WRITEBACK_IMMEDIATE;
+      writeback.pending = 0;
+      g_clear_pointer(&locker, g_mutex_locker_free);
+      g_ptr_array_set_size(shard->pending_changes, 0);
+      return save_ini_file(shard, store, error);
+    }
+  }
+  g_cond_signal(&writeback.cond);
+
+  return TRUE;
+}
+
+/*
+ * (Re)creates the store location from the current value of HOME, writing all
+ * pending changes to the previous location first. Must be called with
+ * location_lock held for writing.
+ */
+static gboolean reinit_store_location_locked(GError **error) {
+  if (location != NULL) {
+    g_autoptr(GPtrArray) shards = get_shards();
+    for (guint i = 0; i < shards->len; ++i) {
+      shard_t *shard = g_ptr_array_index(shards, i);
+      flush_pending_changes_locked(shard);
+      if (shard->pending_changes != NULL && shard->pending_changes->len > 0) {
+        g_warning("Discarding %u changes that could not be written to %s",
+                  shard->pending_changes->len, shard->ini_path);
+        clear_pending_changes_locked(shard);
+      }
+    }
+  }
+  g_clear_pointer(&location, store_location_free);
+
+  const char *home = secure_getenv("HOME");
+  if (home == NULL) {
+    *error = g_error_new(quark, 0,
+                         "environment variable HOME not set (are we running in "
+                         "a secure context?)");
+    return FALSE;
+  }
+
+  location = store_location_new(home, error);
+  return location != NULL;
+}
+
+/*
+ * Whether location is valid and points to the current HOME. Tests change HOME
+ * between runs, so this is checked on every call, which costs only a getenv()
+ * and a string comparison. Must be called with location_lock held.
+ */
+static gboolean store_location_is_current(void) {
+  return location != NULL &&
+         g_strcmp0(secure_getenv("HOME"), location->home) == 0;
+}
+
+/*
+ * Makes sure that location is valid and points to the current HOME. Must be
+ * called with location_lock held for writing.
+ */
+static gboolean ensure_store_location_locked(GError **error) {
+  if (store_location_is_current()) {
+    return TRUE;
+  }
+  return reinit_store_location_locked(error);
+}
+
+/*
+ * Takes location_lock for reading, after making sure that location points to
+ * the current HOME. Returns FALSE and sets error if there is no location, in
+ * which case the lock is not held.
+ */
+static gboolean lock_location(GError **error) {
+  g_rw_lock_reader_lock(&location_lock);
+  while (!store_location_is_current()) {
+    g_rw_lock_reader_unlock(&location_lock);
+    g_rw_lock_writer_lock(&location_lock);
+    const gboolean success = ensure_store_location_locked(error);
+    g_rw_lock_writer_unlock(&location_lock);
+    if (!success) {
+      return FALSE;
+    }
+    g_rw_lock_reader_lock(&location_lock);
+  }
+  return TRUE;
+}
+
+/*
+ * The services whose shards have to be visited for query, in this order:
+ * only the one of the query or, if it matches every service, all of them.
+ * Without sharding that is just NULL, which stands for the only shard.
+ */
+static GPtrArray *services_for_query(const store_query_t *query,
+                                     GError **error) {
+  if (sharding == SHARDING_NONE || query->service != NULL) {
+    GPtrArray *services = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(services, g_strdup(query->service));
+    return services;
+  }
+
+  if (!lock_location(error)) {
+    return NULL;
+  }
+  GPtrArray *services = list_services(error);
+  g_rw_lock_reader_unlock(&location_lock);
+  return services;
+}
+
+/*
+ * Read access to an up to date cached store of one shard, for lookups and
+ * searches.
+ *
+ * The fast path only takes the shard's lock for reading and a shared flock(),
+ * so that readers do not block each other. If the store has to be (re)loaded
+ * first, the lock is taken for writing instead and kept until
+ * release_reader(), so that a busy writer in another process cannot starve
+ * the reader. location_lock is held for reading in both cases.
+ */
+typedef struct {
+  shard_t *shard;
+  store_t *store;
+  gboolean exclusive;
+  store_lock_t file_lock;
+} reader_t;
+
+#define READER_INIT {NULL, NULL, FALSE, NULL}
+
+static void release_reader(reader_t *reader) {
+  if (reader->shard == NULL) {
+    return;
+  }
+  if (reader->file_lock != NULL) {
+    unlock_store(g_steal_pointer(&reader->file_lock));
+  }
+  if (reader->exclusive) {
+    g_rw_lock_writer_unlock(&reader->shard->lock);
+  } else {
+    g_rw_lock_reader_unlock(&reader->shard->lock);
+  }
+  g_rw_lock_reader_unlock(&location_lock);
+  reader->shard = NULL;
+  reader->store = NULL;
+  reader->exclusive = FALSE;
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(reader_t, release_reader)
+
+/*
+ * Sets reader->store to the cached store of the shard of service, loading it
+ * if necessary. Returns FALSE and sets error on failure, in which case no lock
+ * is held.
+ */
+static gboolean acquire_reader(reader_t *reader, const gchar *service,
+                               GError **error) {
+  if (!lock_location(error)) {
+    return FALSE;
+  }
+  shard_t *shard = get_shard(service);
+
+  g_rw_lock_reader_lock(&shard->lock);
+  reader->file_lock = lock_store(shard, LOCK_SH, error);
+  if (reader->file_lock == NULL) {
+    g_rw_lock_reader_unlock(&shard->lock);
+    g_rw_lock_reader_unlock(&location_lock);
+    return FALSE;
+  }
+  reader->store = get_fresh_cached_store(shard);
+  if (reader->store != NULL) {
+    reader->shard = shard;
+    stats_record_cache(TRUE);
+    return TRUE;
+  }
+  unlock_store(g_steal_pointer(&reader->file_lock));
+  g_rw_lock_reader_unlock(&shard->lock);
+
+  g_rw_lock_writer_lock(&shard->lock);
+  reader->shard = shard;
+  reader->exclusive = TRUE;
+  reader->file_lock = lock_store(shard, LOCK_SH, error);
+  if (reader->file_lock != NULL) {
+    reader->store = open_ini_file(shard, error);
+  }
+  if (reader->store == NULL) {
+    release_reader(reader);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Write access to the cached store of one shard, for modifications: the
+ * shard's lock is held for writing and the exclusive flock() for the whole
+ * read-modify-write cycle, location_lock for reading.
+ */
+typedef struct {
+  shard_t *shard;
+  store_t *store;
+  store_lock_t file_lock;
+} writer_t;
+
+#define WRITER_INIT {NULL, NULL, NULL}
+
+static void release_writer(writer_t *writer) {
+  if (writer->shard == NULL) {
+    return;
+  }
+  if (writer->file_lock != NULL) {
+    unlock_store(g_steal_pointer(&writer->file_lock));
+  }
+  g_rw_lock_writer_unlock(&writer->shard->lock);
+  g_rw_lock_reader_unlock(&location_lock);
+  writer->shard = NULL;
+  writer->store = NULL;
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(writer_t, release_writer)
+
+/*
+ * Sets writer->store to the cached store of the shard of service, loading it
+ * if necessary. Returns FALSE and sets error on failure, in which case no lock
+ * is held.
+ */
+static gboolean acquire_writer(writer_t *writer, const gchar *service,
+                               GError **error) {
+  if (!lock_location(error)) {
+    return FALSE;
+  }
+  writer->shard = get_shard(service);
+  g_rw_lock_writer_lock(&writer->shard->lock);
+  writer->file_lock = lock_store(writer->shard, LOCK_EX, error);
+  if (writer->file_lock != NULL) {
+    writer->store = open_ini_file(writer->shard, error);
+  }
+  if (writer->store == NULL) {
+    release_writer(writer);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void mocklibsecret_reinit(void) {
+  g_autoptr(GRWLockWriterLocker) locker =
+      g_rw_lock_writer_locker_new(&location_lock);
+  g_autoptr(GError) err = NULL;
+  if (!reinit_store_location_locked(&err)) {
+    g_warning("Could not initialize the password store: %s", err->message);
+  }
+}
+
+gboolean mocklibsecret_export_ini(const char *path, GError **error) {
+  const store_query_t all = {NULL, NULL};
+  g_autoptr(GPtrArray) services = services_for_query(&all, error);
+  if (services == NULL) {
+    return FALSE;
+  }
+
+  // every shard only holds its own service, so their contents just need to be
+  // concatenated
+  GString *data = g_string_new(NULL);
+  GString *part = g_string_new(NULL);
+  gboolean success = TRUE;
+  for (guint i = 0; success && i < services->len; ++i) {
+    g_auto(reader_t) reader = READER_INIT;
+    success = acquire_reader(&reader, g_ptr_array_index(services, i), error);
+    if (success) {
+      store_to_data(reader.store, part);
+      if (data->len > 0 && part->len > 0) {
+        g_string_append_c(data, '\n');
+      }
+      g_string_append_len(data, part->str, (gssize)part->len);
+    }
+  }
+  if (success) {
+    success = g_file_set_contents_full(
+        path, data->str, (gssize)data->len, G_FILE_SET_CONTENTS_CONSISTENT,
+        S_IRUSR | S_IWUSR | S_IRGRP, error);
+  }
+
+  // don't keep passwords around longer than necessary
+  memset(data->str, 0, data->len);
+  memset(part->str, 0, part->len);
+  g_string_free(data, TRUE);
+  g_string_free(part, TRUE);
+  return success;
+}
+
+/*
+ * The extension host forks, so ensure that the child does not inherit a held
+ * lock, the parent's flock()s or a flusher thread that does not exist in it.
+ * Holding location_lock for writing excludes everyone else from all shards.
+ * Pending changes are written by the parent.
+ */
+static void atfork_prepare(void) {
+  g_rw_lock_writer_lock(&location_lock);
+  g_mutex_lock(&writeback.lock);
+  g_mutex_lock(&secret_pool.lock);
+  failure_injection_atfork_prepare();
+  stats_atfork_prepare();
+  client_atfork_prepare();
+}
+
+static void atfork_parent(void) {
+  client_atfork_parent();
+  stats_atfork_parent();
+  failure_injection_atfork_parent();
+  g_mutex_unlock(&secret_pool.lock);
+  g_mutex_unlock(&writeback.lock);
+  g_rw_lock_writer_unlock(&location_lock);
+}
+
+static void atfork_child(void) {
+  writeback.flusher = NULL;
+  writeback.pending = 0;
+  g_autoptr(GPtrArray) shards =
+      location != NULL ? get_shards() : g_ptr_array_new();
+  for (guint i = 0; i < shards->len; ++i) {
+    shard_t *shard = g_ptr_array_index(shards, i);
+    // the fd shares the lock with the parent, we need our own
+    if (shard->lock_fd != -1) {
+      close(shard->lock_fd);
+      shard->lock_fd = -1;
+    }
+    if (shard->pending_changes != NULL) {
+      g_ptr_array_set_size(shard->pending_changes, 0);
+      // the cached store contains the parent's unwritten changes
+      invalidate_cache(shard);
+    }
+  }
+  client_atfork_child();
+  stats_atfork_child();
+  failure_injection_atfork_child();
+  g_mutex_unlock(&secret_pool.lock);
+  g_mutex_unlock(&writeback.lock);
+  g_rw_lock_writer_unlock(&location_lock);
+}
+
+__attribute__((destructor)) static void fini(void) {
+  g_mutex_lock(&writeback.lock);
+  GThread *flusher = g_steal_pointer(&writeback.flusher);
+  writeback.shutdown = TRUE;
+  g_cond_signal(&writeback.cond);
+  g_mutex_unlock(&writeback.lock);
+
+  if (flusher != NULL) {
+    g_thread_join(flusher);
+  }
+
+  g_rw_lock_writer_lock(&location_lock);
+  flush_all_pending_changes_locked();
+  g_rw_lock_writer_unlock(&location_lock);
+
+  secret_pool_drain();
+  stats_dump();
+}
+
+__attribute__((constructor)) void init() {
+  static const char *quark_str = "MOCKLIBSECRET_ERROR";
+  quark = g_quark_from_static_string(quark_str);
+
+  // determines the layout of the location
+  read_sharding_config();
+
+  // HOME might legitimately be unset here, we only report errors once the
+  // store is actually used
+  g_rw_lock_writer_lock(&location_lock);
+  g_autoptr(GError) err = NULL;
+  reinit_store_location_locked(&err);
+  g_rw_lock_writer_unlock(&location_lock);
+
+  failure_injection_init();
+  stats_init();
+  read_writeback_config();
+  read_durability_config();
+  read_backend_config();
+  pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+#define RETURN_IF_SHOULD_FAIL()                                                \
+  do {                                                                         \
+    g_autofree gchar *_err_msg = failure_injection_get_message();              \
+    if (_err_msg != NULL) {                                                    \
+      *error = g_error_new(quark, 0, "%s", _err_msg);                          \
+      return FALSE;                                                            \
+    }                                                                          \
+  } while (0)
+
+/*
+ * Our schema only knows the attributes service and account. Queries may
+ * contain any subset of them, missing attributes match everything.
+ */
+static gboolean set_query_attribute(store_query_t *query, const gchar *name,
+                                    const gchar *value, GError **error) {
+  if (value == NULL) {
+    *error = g_error_new(quark, 0, "attribute '%s' has no value", name);
+    return FALSE;
+  }
+  if (g_strcmp0(name, "service") == 0) {
+    query->service = value;
+  } else if (g_strcmp0(name, "account") == 0) {
+    query->account = value;
+  } else {
+    *error = g_error_new(quark, 0, "unknown attribute '%s'", name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Parses the NULL terminated list of attribute names and values. The strings
+ * are borrowed from the caller's arguments, so that lookups only need to
+ * allocate the returned password.
+ */
+static gboolean query_from_va_args(store_query_t *query, GError **error,
+                                   va_list argp) {
+  *error = NULL;
+  query->service = query->account = NULL;
+
+  for (const gchar *name = va_arg(argp, const gchar *); name != NULL;
+       name = va_arg(argp, const gchar *)) {
+    if (!set_query_attribute(query, name, va_arg(argp, const gchar *),
+                             error)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * Like query_from_va_args(), but both service and account must be given, as
+ * required for storing and clearing passwords.
+ */
+static gboolean label_from_va_args(const gchar **service,
+                                   const gchar **account, GError **error,
+                                   va_list argp) {
+  store_query_t query;
+  if (!query_from_va_args(&query, error, argp)) {
+    return FALSE;
+  }
+  if (query.service == NULL || query.account == NULL) {
+    *error = g_error_new(quark, 0, "both service and account are required");
+    return FALSE;
+  }
+  *service = query.service;
+  *account = query.account;
+  return TRUE;
+}
 
-static GQuark quark;
+/* Like query_from_va_args(), but for the attributes of a search. */
+static gboolean query_from_attributes(store_query_t *query,
+                                      GHashTable *attributes, GError **error) {
+  *error = NULL;
+  query->service = query->account = NULL;
+
+  // don't rely on the hash table's hash function, keytar's compares pointers
+  GHashTableIter iter;
+  gpointer name, value;
+  g_hash_table_iter_init(&iter, attributes);
+  while (g_hash_table_iter_next(&iter, &name, &value)) {
+    if (!set_query_attribute(query, name, value, error)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
 
-static gboolean get_ini_location(char **ini_path, GError **error) {
+/*
+ * The implementations of the password functions, shared by the synchronous
+ * and the asynchronous variants.
+ */
+static gboolean password_store(const gchar *service, const gchar *account,
+                               const gchar *password, GError **error) {
   *error = NULL;
-  const char *home = secure_getenv("HOME");
-  if (home == NULL) {
+
+  RETURN_IF_SHOULD_FAIL();
+
+  if (!store_is_valid_name(service, account)) {
     *error = g_error_new(quark, 0,
-                         "environment variable HOME not set (are we running in "
-                         "a secure context?)");
+                         "service '%s' or account '%s' cannot be stored in "
+                         "passwords.ini",
+                         service, account);
     return FALSE;
   }
 
-  const gboolean err = asprintf(ini_path, "%s/passwords.ini", home) == -1;
-  if (err) {
-    *error = g_error_new(
-        quark, 0, "could not create string with the path to passwords.ini");
+  if (client_enabled()) {
+    return client_store(service, account, password, error);
   }
-  return !err;
-}
 
-__attribute__((constructor)) void init() {
-  static const char *quark_str = "MOCKLIBSECRET_ERROR";
-  quark = g_quark_from_static_string(quark_str);
+  g_auto(writer_t) writer = WRITER_INIT;
+  if (!acquire_writer(&writer, service, error)) {
+    return FALSE;
+  }
 
-  g_autofree gchar *ini_path;
-  GError *err = NULL;
-  get_ini_location(&ini_path, &err);
+  store_set(writer.store, service, account, password);
 
-  const int fd = g_open(ini_path, O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
-  g_close(fd, &err);
+  return commit_change(writer.shard, writer.store, service, account, password,
+                       error);
 }
 
-static gboolean open_ini_file(GKeyFile *key_file, GError **error) {
+static gchar *password_lookup(const store_query_t *query, GError **error) {
   *error = NULL;
 
-  g_autofree gchar *ini_path;
-  get_ini_location(&ini_path, error);
-  if (!g_key_file_load_from_file(
-          key_file, ini_path,
-          G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS, error)) {
-    if (!g_error_matches(*error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
-      g_warning("Error loading key file: %s", (*error)->message);
-    return FALSE;
+  RETURN_IF_SHOULD_FAIL();
+
+  if (client_enabled()) {
+    gchar *response = client_lookup(query, error);
+    if (response == NULL) {
+      return NULL;
+    }
+    gchar *password = secret_buffer_dup(response);
+    explicit_bzero(response, strlen(response));
+    g_free(response);
+    return password;
   }
 
-  return TRUE;
+  g_autoptr(GPtrArray) services = services_for_query(query, error);
+  if (services == NULL) {
+    return NULL;
+  }
+
+  // like libsecret: the first match if only some attributes are given and no
+  // error if there is no such password
+  for (guint i = 0; i < services->len; ++i) {
+    g_auto(reader_t) reader = READER_INIT;
+    if (!acquire_reader(&reader, g_ptr_array_index(services, i), error)) {
+      return NULL;
+    }
+    store_iter_t iter;
+    store_iter_init(&iter, reader.store, query);
+    const gchar *service, *account, *password;
+    if (store_iter_next(&iter, &service, &account, &password)) {
+      return secret_buffer_dup(password);
+    }
+  }
+  return NULL;
 }
 
-#define RETURN_IF_SHOULD_FAIL()                                                \
-  char *_err_msg = secure_getenv("MOCKLIBSECRET_ERROR_MESSAGE");               \
-  if (_err_msg != NULL) {                                                      \
-    *error = g_error_new(quark, 0, "%s", _err_msg);                            \
-    return FALSE;                                                              \
-  }                                                                            \
-  g_autofree gchar *_error_file, *_error_message;                              \
-  gsize _length = 0;                                                           \
-  const gboolean _asprintf_err = asprintf(                                     \
-      &_error_file, "%s/mocklibsecret_error_message", g_get_tmp_dir());        \
-  if (_asprintf_err) {                                                         \
-    *error = g_error_new(quark, 0,                                             \
-                         "could not create string with the path to "           \
-                         "TMPDIR/mocklibsecret_error_message");                \
-  }                                                                            \
-  /* don't care why reading failed */                                          \
-  if (g_file_get_contents(_error_file, &_error_message, &_length, NULL)) {     \
-    *error =                                                                   \
-        g_error_new(quark, 0, "%s",                                            \
-                    _length == 0 ? "libsecret call failed" : _error_message);  \
-    return FALSE;                                                              \
-  }
-
-static gboolean label_from_va_args(gchar **service, gchar **account,
-                                   GError **error, va_list argp) {
+static gboolean password_clear(const gchar *service, const gchar *account,
+                               GError **error) {
   *error = NULL;
-  const char *expect_service = va_arg(argp, const char *);
-  if (g_strcmp0("service", expect_service) != 0) {
-    *error =
-        g_error_new(quark, 0, "invalid first parameter: '%s'", expect_service);
-    return FALSE;
+
+  RETURN_IF_SHOULD_FAIL();
+
+  if (client_enabled()) {
+    return client_clear(service, account, error);
   }
-  *service = g_strdup(va_arg(argp, char *));
 
-  const char *expect_account = va_arg(argp, const char *);
-  if (g_strcmp0("account", expect_account) != 0) {
-    *error =
-        g_error_new(quark, 0, "invalid third parameter: '%s'", expect_account);
+  g_auto(writer_t) writer = WRITER_INIT;
+  if (!acquire_writer(&writer, service, error)) {
     return FALSE;
   }
-  *account = g_strdup(va_arg(argp, char *));
 
-  if (va_arg(argp, void *) != NULL) {
-    *error = g_error_new(quark, 0, "invalid last parameter, should be NULL");
+  // like libsecret: nothing to remove is not an error
+  if (!store_remove(writer.store, service, account)) {
     return FALSE;
   }
 
-  return TRUE;
+  return commit_change(writer.shard, writer.store, service, account, NULL,
+                       error);
 }
 
-gboolean secret_password_store_sync(const SecretSchema *schema,
-                                    const gchar *collection, const gchar *label,
-                                    const gchar *password,
-                                    GCancellable *cancellable, GError **error,
-                                    ...) {
-  UNUSED(schema);
-  UNUSED(collection);
-  UNUSED(label);
-  UNUSED(cancellable);
-
-  *error = NULL;
+/*
+ * The result of secret_service_search_sync() and secret_service_search().
+ *
+ * The strings of all items are copied into one buffer owned by the result
+ * (with MOCKLIBSECRET_DAEMON that is the daemon's response as is). All items
+ * of a result are stored in one array and share its reference count, and an
+ * item doubles as its own SecretValue, so that building a result of n items
+ * needs O(1) allocations apart from the list nodes.
+ *
+ * The list holds a reference to the result, which is never dropped: keytar
+ * only frees the list, but not the items (we'd have no way to notice that
+ * anyway, since they are not real GObjects). That is why the strings are
+ * copied instead of referencing the store: a result only retains its own
+ * matches, not the store version (or the mapped passwords.bin) that it was
+ * found in. SecretValues are counted properly, see secret_item_get_secret().
+ */
+typedef struct search_result search_result_t;
+
+typedef struct {
+  search_result_t *result;
+  /* point into result->buffer */
+  const gchar *service;
+  const gchar *account;
+  const gchar *password;
+  /* created on the first call of secret_item_get_attributes() */
+  GHashTable *attributes;
+} mock_item_t;
+
+struct search_result {
+  gint ref_count;
+  /* the strings of the items, one nul terminated triple per item */
+  GBytes *buffer;
+  gsize n_items;
+  mock_item_t items[];
+};
+
+/* Takes ownership of buffer, which must consist of n_items triples. */
+static search_result_t *search_result_new(GBytes *buffer, gsize n_items) {
+  search_result_t *result =
+      g_malloc0(sizeof(search_result_t) + n_items * sizeof(mock_item_t));
+  result->ref_count = 1;
+  result->buffer = buffer;
+  result->n_items = n_items;
+
+  const gchar *pos = g_bytes_get_data(buffer, NULL);
+  for (gsize i = 0; i < n_items; ++i) {
+    mock_item_t *item = &result->items[i];
+    item->result = result;
+    item->service = pos;
+    pos += strlen(pos) + 1;
+    item->account = pos;
+    pos += strlen(pos) + 1;
+    item->password = pos;
+    pos += strlen(pos) + 1;
+  }
+  return result;
+}
 
-  RETURN_IF_SHOULD_FAIL()
+static search_result_t *search_result_ref(search_result_t *result) {
+  g_atomic_int_inc(&result->ref_count);
+  return result;
+}
 
-  g_autoptr(GKeyFile) key_file = g_key_file_new();
-  g_autofree gchar *ini_path;
-  if (!get_ini_location(&ini_path, error)) {
-    return FALSE;
+static void search_result_unref(search_result_t *result) {
+  if (!g_atomic_int_dec_and_test(&result->ref_count)) {
+    return;
   }
+  for (gsize i = 0; i < result->n_items; ++i) {
+    g_clear_pointer(&result->items[i].attributes, g_hash_table_unref);
+  }
+  g_clear_pointer(&result->buffer, g_bytes_unref);
+  g_free(result);
+}
 
-  gboolean retval = TRUE;
-
-  if (!g_key_file_load_from_file(
-          key_file, ini_path,
-          G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS, error)) {
-    if (!g_error_matches(*error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
-      g_warning("Error loading key file: %s", (*error)->message);
-    return FALSE;
+/* prepends in reverse, so that the list has the order of passwords.ini */
+static GList *search_result_to_list(search_result_t *result) {
+  GList *l = NULL;
+  for (gsize i = result->n_items; i > 0; --i) {
+    l = g_list_prepend(l, &result->items[i - 1]);
   }
+  return l;
+}
 
-  g_autofree gchar *service;
-  g_autofree gchar *account;
-  va_list argp;
-  va_start(argp, error);
-  if (!label_from_va_args(&service, &account, error, argp)) {
-    va_end(argp);
-    return FALSE;
+static GList *search_daemon(const store_query_t *query, GError **error) {
+  GBytes *buffer = client_search(query, error);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  gsize size;
+  const gchar *data = g_bytes_get_data(buffer, &size);
+  gsize n_strings = 0;
+  for (gsize i = 0; i < size; ++i) {
+    n_strings += data[i] == '\0';
+  }
+  if (n_strings == 0) {
+    g_bytes_unref(buffer);
+    return NULL;
   }
-  va_end(argp);
 
-  g_key_file_set_string(key_file, service, account, password);
+  // client_search() ensured that there are complete triples
+  return search_result_to_list(search_result_new(buffer, n_strings / 3));
+}
 
-  if (!g_key_file_save_to_file(key_file, ini_path, error)) {
-    g_warning("Error saving key file: %s", (*error)->message);
-    return FALSE;
+/* The matches of query in store or NULL if there are none. */
+static search_result_t *search_store(const store_t *store,
+                                     const store_query_t *query) {
+  const gsize length = store_count(store, query);
+  if (length == 0) {
+    return NULL;
   }
 
-  return retval;
+  GString *strings = g_string_new(NULL);
+  store_iter_t iter;
+  store_iter_init(&iter, store, query);
+  const gchar *service, *account, *password;
+  while (store_iter_next(&iter, &service, &account, &password)) {
+    g_string_append_len(strings, service, strlen(service) + 1);
+    g_string_append_len(strings, account, strlen(account) + 1);
+    g_string_append_len(strings, password, strlen(password) + 1);
+  }
+  return search_result_new(g_string_free_to_bytes(strings), length);
 }
 
-gchar *secret_password_lookup_sync(const SecretSchema *schema,
-                                   GCancellable *cancellable, GError **error,
-                                   ...) {
-  UNUSED(schema);
-  UNUSED(cancellable);
-
+static GList *service_search(const store_query_t *query,
+                             SecretSearchFlags flags, GError **error) {
   *error = NULL;
 
   RETURN_IF_SHOULD_FAIL();
 
-  g_autofree char *ini_path;
-  if (!get_ini_location(&ini_path, error)) {
+  if (flags !=
+      (SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS)) {
+    *error = g_error_new(quark, 0, "got wrong flags from keytar: %d", flags);
     return NULL;
   }
 
-  g_autoptr(GKeyFile) key_file = g_key_file_new();
+  if (client_enabled()) {
+    return search_daemon(query, error);
+  }
 
-  va_list argp;
-  va_start(argp, error);
+  g_autoptr(GPtrArray) services = services_for_query(query, error);
+  if (services == NULL) {
+    return NULL;
+  }
 
-  g_autofree gchar *service;
-  g_autofree gchar *account;
+  // one result per shard, the lists of their items are concatenated
+  g_autoptr(GPtrArray) results = g_ptr_array_new();
+  for (guint i = 0; i < services->len; ++i) {
+    g_auto(reader_t) reader = READER_INIT;
+    if (!acquire_reader(&reader, g_ptr_array_index(services, i), error)) {
+      for (guint r = 0; r < results->len; ++r) {
+        search_result_unref(g_ptr_array_index(results, r));
+      }
+      return NULL;
+    }
+    search_result_t *result = search_store(reader.store, query);
+    if (result != NULL) {
+      g_ptr_array_add(results, result);
+    }
+  }
 
-  if (!label_from_va_args(&service, &account, error, argp)) {
-    va_end(argp);
-    return NULL;
+  // no passwords stored => not an error!
+  GList *items = NULL;
+  for (guint r = results->len; r > 0; --r) {
+    items = g_list_concat(
+        search_result_to_list(g_ptr_array_index(results, r - 1)), items);
   }
-  va_end(argp);
+  return items;
+}
 
-  if (!open_ini_file(key_file, error)) {
-    return NULL;
+static void append_status(GString *response, gboolean found,
+                          const GError *error) {
+  if (error != NULL) {
+    const gchar *const strings[] = {error->message};
+    protocol_append_message(response, PROTOCOL_ERROR, 1, strings, 1);
+  } else {
+    protocol_append_message(response,
+                            found ? PROTOCOL_OK : PROTOCOL_NOT_FOUND, 0, NULL,
+                            0);
   }
+}
 
-  gchar *retval = g_key_file_get_string(key_file, service, account, error);
-  if (retval == NULL && !g_error_matches(*error, G_KEY_FILE_ERROR,
-                                         G_KEY_FILE_ERROR_KEY_NOT_FOUND)) {
-    g_warning("Error finding key in key file: %s", (*error)->message);
-    return NULL;
+/* Like service_search(), but copies the matches straight into response. */
+static void search_for_client(const store_query_t *query, GString *response) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) services = services_for_query(query, &error);
+  if (services == NULL) {
+    append_status(response, FALSE, error);
+    return;
   }
 
-  return retval;
+  const gsize start = protocol_begin_message(response, PROTOCOL_OK, 0);
+  for (guint i = 0; i < services->len; ++i) {
+    g_auto(reader_t) reader = READER_INIT;
+    if (!acquire_reader(&reader, g_ptr_array_index(services, i), &error)) {
+      g_string_truncate(response, start);
+      append_status(response, FALSE, error);
+      return;
+    }
+    store_iter_t iter;
+    store_iter_init(&iter, reader.store, query);
+    const gchar *service, *account, *password;
+    while (store_iter_next(&iter, &service, &account, &password)) {
+      g_string_append_len(response, service, (gssize)strlen(service) + 1);
+      g_string_append_len(response, account, (gssize)strlen(account) + 1);
+      g_string_append_len(response, password, (gssize)strlen(password) + 1);
+    }
+  }
+  protocol_end_message(response, start);
 }
 
-gboolean secret_password_clear_sync(const SecretSchema *schema,
+void server_handle_request(protocol_op_t op, const gchar *const *strings,
+                           GString *response) {
+  const store_query_t query = {strings[0], strings[1]};
+  const gchar *password = strings[2];
+  g_autoptr(GError) error = NULL;
+
+  if ((op == PROTOCOL_STORE || op == PROTOCOL_CLEAR) &&
+      (query.service == NULL || query.account == NULL)) {
+    error = g_error_new(quark, 0, "service and account are required");
+    append_status(response, FALSE, error);
+    return;
+  }
+
+  switch (op) {
+  case PROTOCOL_STORE:
+    if (password == NULL) {
+      error = g_error_new(quark, 0, "no password given");
+    } else {
+      password_store(query.service, query.account, password, &error);
+    }
+    append_status(response, TRUE, error);
+    break;
+  case PROTOCOL_LOOKUP: {
+    gchar *found = password_lookup(&query, &error);
+    if (found != NULL) {
+      const gchar *const result[] = {found};
+      protocol_append_message(response, PROTOCOL_OK, 1, result, 1);
+    } else {
+      append_status(response, FALSE, error);
+    }
+    secret_password_free(found);
+    break;
+  }
+  case PROTOCOL_CLEAR: {
+    const gboolean removed =
+        password_clear(query.service, query.account, &error);
+    append_status(response, removed, error);
+    break;
+  }
+  case PROTOCOL_SEARCH:
+    search_for_client(&query, response);
+    break;
+  }
+}
+
+gboolean secret_password_store_sync(const SecretSchema *schema,
+                                    const gchar *collection, const gchar *label,
+                                    const gchar *password,
                                     GCancellable *cancellable, GError **error,
                                     ...) {
   UNUSED(schema);
+  UNUSED(collection);
+  UNUSED(label);
   UNUSED(cancellable);
 
-  *error = NULL;
-
-  RETURN_IF_SHOULD_FAIL();
-
-  g_autofree gchar *service;
-  g_autofree gchar *account;
+  const gint64 start = stats_start();
+  const gchar *service = NULL;
+  const gchar *account = NULL;
   va_list argp;
   va_start(argp, error);
-
-  if (!label_from_va_args(&service, &account, error, argp)) {
-    va_end(argp);
-    return FALSE;
-  }
+  const gboolean valid = label_from_va_args(&service, &account, error, argp);
   va_end(argp);
 
-  g_autoptr(GKeyFile) key_file = g_key_file_new();
+  const gboolean res =
+      valid && password_store(service, account, password, error);
+  stats_record_call(STATS_PASSWORD_STORE_SYNC, start, *error != NULL);
+  return res;
+}
 
-  if (!open_ini_file(key_file, error)) {
-    return FALSE;
-  }
+gchar *secret_password_lookup_sync(const SecretSchema *schema,
+                                   GCancellable *cancellable, GError **error,
+                                   ...) {
+  UNUSED(schema);
+  UNUSED(cancellable);
 
-  if (!g_key_file_remove_key(key_file, service, account, error)) {
-    if (g_error_matches(*error, G_KEY_FILE_ERROR,
-                        G_KEY_FILE_ERROR_KEY_NOT_FOUND)) {
-      g_warning("Error finding key in key file: %s", (*error)->message);
-    }
-    return FALSE;
-  }
+  const gint64 start = stats_start();
+  store_query_t query;
+  va_list argp;
+  va_start(argp, error);
+  const gboolean valid = query_from_va_args(&query, error, argp);
+  va_end(argp);
 
-  g_autofree gchar *ini_path;
-  if (!get_ini_location(&ini_path, error)) {
-    return FALSE;
-  }
+  gchar *password = valid ? password_lookup(&query, error) : NULL;
+  stats_record_call(STATS_PASSWORD_LOOKUP_SYNC, start, *error != NULL);
+  return password;
+}
 
-  if (!g_key_file_save_to_file(key_file, ini_path, error)) {
-    g_warning("Error saving key file: %s", (*error)->message);
-    return FALSE;
-  }
+gboolean secret_password_clear_sync(const SecretSchema *schema,
+                                    GCancellable *cancellable, GError **error,
+                                    ...) {
+  UNUSED(schema);
+  UNUSED(cancellable);
 
-  return TRUE;
-}
+  const gint64 start = stats_start();
+  const gchar *service = NULL;
+  const gchar *account = NULL;
+  va_list argp;
+  va_start(argp, error);
+  const gboolean valid = label_from_va_args(&service, &account, error, argp);
+  va_end(argp);
 
-gboolean key_match_find(gpointer key, gpointer value, gpointer user_data) {
-  UNUSED(value);
-  return g_strcmp0(key, user_data) == 0;
+  const gboolean res = valid && password_clear(service, account, error);
+  stats_record_call(STATS_PASSWORD_CLEAR_SYNC, start, *error != NULL);
+  return res;
 }
 
 GList *secret_service_search_sync(SecretService *service,
@@ -291,80 +2510,320 @@ GList *secret_service_search_sync(SecretService *service,
                                   GHashTable *attributes,
                                   SecretSearchFlags flags,
                                   GCancellable *cancellable, GError **error) {
-  *error = NULL;
-
   UNUSED(service);
   UNUSED(schema);
   UNUSED(cancellable);
-  UNUSED(attributes);
 
-  *error = NULL;
+  const gint64 start = stats_start();
+  store_query_t query;
+  GList *items = query_from_attributes(&query, attributes, error)
+                     ? service_search(&query, flags, error)
+                     : NULL;
+  stats_record_call(STATS_SERVICE_SEARCH_SYNC, start, *error != NULL);
+  return items;
+}
 
-  RETURN_IF_SHOULD_FAIL();
+/*
+ * The asynchronous variants run the synchronous implementation in GTask's
+ * worker thread pool, so that multiple calls can overlap and callers never
+ * block their main loop on passwords.ini.
+ *
+ * The arguments are copied into the task data, since the caller's strings
+ * are only guaranteed to be valid until the call returns.
+ */
+static void run_in_thread(gpointer task_data, GDestroyNotify task_data_destroy,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data,
+                          GTaskThreadFunc func) {
+  g_autoptr(GTask) task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_task_data(task, task_data, task_data_destroy);
+  g_task_run_in_thread(task, func);
+}
 
-  if (flags !=
-      (SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS)) {
-    *error = g_error_new(quark, 0, "got wrong flags from keytar: %d", flags);
-    return NULL;
+static void return_boolean_or_error(GTask *task, gboolean result,
+                                    GError *error) {
+  if (error != NULL) {
+    g_task_return_error(task, error);
+  } else {
+    g_task_return_boolean(task, result);
+  }
+}
+
+static void password_store_thread(GTask *task, gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable) {
+  UNUSED(source_object);
+  UNUSED(cancellable);
+
+  if (g_task_return_error_if_cancelled(task)) {
+    return;
   }
 
-  const gchar *service_name =
-      g_hash_table_find(attributes, key_match_find, (gpointer) "service");
+  const gint64 start = stats_start();
+  const credential_t *credential = task_data;
+  GError *error = NULL;
+  const gboolean res = password_store(credential->service, credential->account,
+                                      credential->password, &error);
+  stats_record_call(STATS_PASSWORD_STORE, start, error != NULL);
+  return_boolean_or_error(task, res, error);
+}
 
-  if (service_name == NULL) {
+void secret_password_store(const SecretSchema *schema, const gchar *collection,
+                           const gchar *label, const gchar *password,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data,
+                           ...) {
+  UNUSED(schema);
+  UNUSED(collection);
+  UNUSED(label);
 
-    *error = g_error_new(quark, 0,
-                         "could not get the service name from the hash table");
-    return NULL;
+  const gchar *service = NULL;
+  const gchar *account = NULL;
+  GError *error = NULL;
+  va_list argp;
+  va_start(argp, user_data);
+  const gboolean valid = label_from_va_args(&service, &account, &error, argp);
+  va_end(argp);
+  if (!valid) {
+    stats_record_call(STATS_PASSWORD_STORE, stats_start(), TRUE);
+    g_task_report_error(NULL, callback, user_data, NULL, error);
+    return;
   }
 
-  g_autoptr(GKeyFile) key_file = g_key_file_new();
-  if (!open_ini_file(key_file, error)) {
-    return NULL;
+  run_in_thread(credential_new(service, account, password), credential_free,
+                cancellable, callback, user_data, password_store_thread);
+}
+
+gboolean secret_password_store_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+static void password_lookup_thread(GTask *task, gpointer source_object,
+                                   gpointer task_data,
+                                   GCancellable *cancellable) {
+  UNUSED(source_object);
+  UNUSED(cancellable);
+
+  if (g_task_return_error_if_cancelled(task)) {
+    return;
   }
 
-  gsize length = 0;
-  gchar **keys = g_key_file_get_keys(key_file, service_name, &length, error);
-  // key not found => no passwords stored => not an error!
-  if ((keys == NULL) && ((*error)->code == G_KEY_FILE_ERROR_GROUP_NOT_FOUND)) {
-    *error = NULL;
-    return NULL;
+  const gint64 start = stats_start();
+  const credential_t *credential = task_data;
+  const store_query_t query = {credential->service, credential->account};
+  GError *error = NULL;
+  gchar *password = password_lookup(&query, &error);
+  stats_record_call(STATS_PASSWORD_LOOKUP, start, error != NULL);
+  if (error != NULL) {
+    g_task_return_error(task, error);
+  } else {
+    g_task_return_pointer(task, password, (GDestroyNotify)secret_password_free);
   }
+}
 
-  GList *l = NULL;
+void secret_password_lookup(const SecretSchema *schema,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data,
+                            ...) {
+  UNUSED(schema);
+
+  store_query_t query;
+  GError *error = NULL;
+  va_list argp;
+  va_start(argp, user_data);
+  const gboolean valid = query_from_va_args(&query, &error, argp);
+  va_end(argp);
+  if (!valid) {
+    stats_record_call(STATS_PASSWORD_LOOKUP, stats_start(), TRUE);
+    g_task_report_error(NULL, callback, user_data, NULL, error);
+    return;
+  }
+
+  run_in_thread(credential_new(query.service, query.account, NULL),
+                credential_free, cancellable, callback, user_data,
+                password_lookup_thread);
+}
+
+gchar *secret_password_lookup_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
 
-  for (gsize i = 0; i < length; ++i) {
-    GHashTable *secret_item =
-        g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
-    gchar *password =
-        g_key_file_get_string(key_file, service_name, keys[i], error);
-    // the only possible errors are: group not found or key not found, which
-    // both must not happen
-    assert(password != NULL);
+static void password_clear_thread(GTask *task, gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable) {
+  UNUSED(source_object);
+  UNUSED(cancellable);
+
+  if (g_task_return_error_if_cancelled(task)) {
+    return;
+  }
+
+  const gint64 start = stats_start();
+  const credential_t *credential = task_data;
+  GError *error = NULL;
+  const gboolean res =
+      password_clear(credential->service, credential->account, &error);
+  stats_record_call(STATS_PASSWORD_CLEAR, start, error != NULL);
+  return_boolean_or_error(task, res, error);
+}
 
-    g_hash_table_replace(secret_item, "account", g_strdup(keys[i]));
-    g_hash_table_replace(secret_item, "password", password);
+void secret_password_clear(const SecretSchema *schema,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data,
+                           ...) {
+  UNUSED(schema);
 
-    l = g_list_append(l, secret_item);
+  const gchar *service = NULL;
+  const gchar *account = NULL;
+  GError *error = NULL;
+  va_list argp;
+  va_start(argp, user_data);
+  const gboolean valid = label_from_va_args(&service, &account, &error, argp);
+  va_end(argp);
+  if (!valid) {
+    stats_record_call(STATS_PASSWORD_CLEAR, stats_start(), TRUE);
+    g_task_report_error(NULL, callback, user_data, NULL, error);
+    return;
   }
 
-  g_strfreev(keys);
-  return l;
+  run_in_thread(credential_new(service, account, NULL), credential_free,
+                cancellable, callback, user_data, password_clear_thread);
+}
+
+gboolean secret_password_clear_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+typedef struct {
+  SecretSearchFlags flags;
+  /* only service and account are used */
+  credential_t *query;
+} search_args_t;
+
+static void search_args_free(gpointer data) {
+  search_args_t *args = data;
+  credential_free(args->query);
+  g_free(args);
+}
+
+static void free_search_list(gpointer list) { g_list_free(list); }
+
+static void service_search_thread(GTask *task, gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable) {
+  UNUSED(source_object);
+  UNUSED(cancellable);
+
+  if (g_task_return_error_if_cancelled(task)) {
+    return;
+  }
+
+  const gint64 start = stats_start();
+  const search_args_t *args = task_data;
+  const store_query_t query = {args->query->service, args->query->account};
+  GError *error = NULL;
+  GList *items = service_search(&query, args->flags, &error);
+  stats_record_call(STATS_SERVICE_SEARCH, start, error != NULL);
+  if (error != NULL) {
+    g_task_return_error(task, error);
+  } else {
+    // the items belong to the search result and are never freed, see above
+    g_task_return_pointer(task, items, free_search_list);
+  }
+}
+
+void secret_service_search(SecretService *service, const SecretSchema *schema,
+                           GHashTable *attributes, SecretSearchFlags flags,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data) {
+  UNUSED(service);
+  UNUSED(schema);
+
+  store_query_t query;
+  GError *error = NULL;
+  if (!query_from_attributes(&query, attributes, &error)) {
+    stats_record_call(STATS_SERVICE_SEARCH, stats_start(), TRUE);
+    g_task_report_error(NULL, callback, user_data, NULL, error);
+    return;
+  }
+
+  search_args_t *args = g_new(search_args_t, 1);
+  args->flags = flags;
+  args->query = credential_new(query.service, query.account, NULL);
+
+  run_in_thread(args, search_args_free, cancellable, callback, user_data,
+                service_search_thread);
+}
+
+GList *secret_service_search_finish(SecretService *service,
+                                    GAsyncResult *result, GError **error) {
+  UNUSED(service);
+
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
 }
 
 GHashTable *secret_item_get_attributes(SecretItem *self) {
-  return (GHashTable *)self;
+  mock_item_t *item = (mock_item_t *)self;
+
+  GHashTable *attributes = g_atomic_pointer_get(&item->attributes);
+  if (attributes == NULL) {
+    // the strings are owned by the search result
+    GHashTable *new_attributes = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(new_attributes, "service", (gpointer)item->service);
+    g_hash_table_insert(new_attributes, "account", (gpointer)item->account);
+    if (g_atomic_pointer_compare_and_exchange(&item->attributes, NULL,
+                                              new_attributes)) {
+      attributes = new_attributes;
+    } else {
+      g_hash_table_unref(new_attributes);
+      attributes = g_atomic_pointer_get(&item->attributes);
+    }
+  }
+
+  // like libsecret, return a new reference
+  return g_hash_table_ref(attributes);
 }
 
+/*
+ * The item is its own SecretValue, like in libsecret the caller owns a
+ * reference to the returned value, which keeps the whole result alive.
+ */
 SecretValue *secret_item_get_secret(SecretItem *self) {
-  return (SecretValue *)self;
+  mock_item_t *item = (mock_item_t *)self;
+  search_result_ref(item->result);
+  return (SecretValue *)item;
+}
+
+SecretValue *secret_value_ref(SecretValue *value) {
+  search_result_ref(((mock_item_t *)value)->result);
+  return value;
+}
+
+void secret_value_unref(gpointer value) {
+  if (value != NULL) {
+    search_result_unref(((mock_item_t *)value)->result);
+  }
+}
+
+const gchar *secret_value_get(SecretValue *value, gsize *length) {
+  const mock_item_t *item = (const mock_item_t *)value;
+  if (length != NULL) {
+    *length = strlen(item->password);
+  }
+  return item->password;
 }
 
 const gchar *secret_value_get_text(SecretValue *value) {
-  GHashTable *secret_item = (GHashTable *)value;
-  return g_hash_table_lookup(secret_item, "password");
+  const mock_item_t *item = (const mock_item_t *)value;
+  return item->password;
 }
 
 const gchar *secret_value_get_content_type(SecretValue *value) {
-  return (const gchar *)value;
+  UNUSED(value);
+  // everything that can be stored via secret_password_store() is text
+  return "text/plain";
 }
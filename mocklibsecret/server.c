@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "mocklibsecret.h"
+#include "server.h"
+
+static void append_error(GString *response, const gchar *message) {
+  const gchar *const strings[] = {message};
+  protocol_append_message(response, PROTOCOL_ERROR, 1, strings, 1);
+}
+
+/*
+ * Answers all requests that have arrived before writing the responses, so
+ * that pipelined requests are answered with one write.
+ */
+static gpointer connection_thread(gpointer data) {
+  const int fd = GPOINTER_TO_INT(data);
+  protocol_reader_t reader;
+  protocol_reader_init(&reader, fd);
+  g_autoptr(GString) response = g_string_new(NULL);
+  g_autoptr(GError) error = NULL;
+
+  while (TRUE) {
+    message_header_t header;
+    const gchar *payload;
+    if (!protocol_reader_next(&reader, &header, &payload, &error)) {
+      break;
+    }
+
+    const gchar *strings[3];
+    g_autoptr(GError) request_error = NULL;
+    if (header.code < PROTOCOL_STORE || header.code > PROTOCOL_SEARCH) {
+      append_error(response, "Invalid request");
+    } else if (!protocol_parse_request(&header, payload, strings,
+                                       G_N_ELEMENTS(strings),
+                                       &request_error)) {
+      append_error(response, request_error->message);
+    } else {
+      server_handle_request((protocol_op_t)header.code, strings, response);
+    }
+
+    if (!protocol_reader_has_message(&reader)) {
+      if (!protocol_write_all(fd, response->str, response->len, &error)) {
+        break;
+      }
+      g_string_truncate(response, 0);
+    }
+  }
+
+  if (error != NULL) {
+    g_printerr("mocklibsecretd: %s\n", error->message);
+  }
+  protocol_reader_clear(&reader);
+  close(fd);
+  return NULL;
+}
+
+static gpointer accept_thread(gpointer data) {
+  const int listen_fd = GPOINTER_TO_INT(data);
+  while (TRUE) {
+    const int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      g_printerr("mocklibsecretd: accept failed: %s\n", g_strerror(errno));
+      return NULL;
+    }
+    g_thread_unref(g_thread_new("mocklibsecretd-connection",
+                                connection_thread, GINT_TO_POINTER(fd)));
+  }
+}
+
+static gboolean quit(gpointer loop) {
+  g_main_loop_quit(loop);
+  return G_SOURCE_CONTINUE;
+}
+
+static int listen_on(const char *socket_path, GError **error) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FILENAME_TOO_LONG,
+                "Failed to listen on %s: %s", socket_path,
+                g_strerror(ENAMETOOLONG));
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  // a leftover of a daemon that was killed
+  g_unlink(socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    const int errsv = errno;
+    if (fd != -1) {
+      close(fd);
+    }
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv),
+                "Failed to listen on %s: %s", socket_path, g_strerror(errsv));
+    return -1;
+  }
+  return fd;
+}
+
+gboolean mocklibsecret_serve(const char *socket_path, GError **error) {
+  client_disable();
+
+  const int listen_fd = listen_on(socket_path, error);
+  if (listen_fd == -1) {
+    return FALSE;
+  }
+  printf("%s\n", socket_path);
+  fflush(stdout);
+
+  g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+  const guint sigint = g_unix_signal_add(SIGINT, quit, loop);
+  const guint sigterm = g_unix_signal_add(SIGTERM, quit, loop);
+
+  // the accept thread and the connection threads are left running, they
+  // die with the process
+  g_thread_unref(
+      g_thread_new("mocklibsecretd-accept", accept_thread,
+                   GINT_TO_POINTER(listen_fd)));
+
+  g_main_loop_run(loop);
+
+  g_source_remove(sigint);
+  g_source_remove(sigterm);
+  g_unlink(socket_path);
+  return TRUE;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+typedef struct {
+  guint64 count;
+  guint64 errors;
+  guint64 bytes;
+  gint64 total_ns;
+  gint64 max_ns;
+} counter_t;
+
+static const char *const symbol_names[STATS_N_SYMBOLS] = {
+    [STATS_PASSWORD_STORE_SYNC] = "secret_password_store_sync",
+    [STATS_PASSWORD_LOOKUP_SYNC] = "secret_password_lookup_sync",
+    [STATS_PASSWORD_CLEAR_SYNC] = "secret_password_clear_sync",
+    [STATS_SERVICE_SEARCH_SYNC] = "secret_service_search_sync",
+    [STATS_PASSWORD_STORE] = "secret_password_store",
+    [STATS_PASSWORD_LOOKUP] = "secret_password_lookup",
+    [STATS_PASSWORD_CLEAR] = "secret_password_clear",
+    [STATS_SERVICE_SEARCH] = "secret_service_search"};
+
+static const char *const io_names[STATS_N_IO] = {
+    [STATS_IO_READ] = "read",
+    [STATS_IO_PARSE] = "parse",
+    [STATS_IO_SERIALIZE] = "serialize",
+    [STATS_IO_WRITE] = "write"};
+
+static struct {
+  /* NULL if the statistics are disabled, not modified after stats_init() */
+  gchar *path;
+
+  /* protects everything below */
+  GMutex lock;
+  counter_t symbols[STATS_N_SYMBOLS];
+  counter_t io[STATS_N_IO];
+  guint64 cache_hits;
+  guint64 cache_misses;
+} stats;
+
+static gint64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+void stats_init(void) {
+  const char *path = secure_getenv("MOCKLIBSECRET_STATS");
+  if (path != NULL && *path != '\0') {
+    stats.path = g_strdup(path);
+  }
+}
+
+gint64 stats_start(void) {
+  // 0 means disabled
+  return stats.path != NULL ? MAX(now_ns(), 1) : 0;
+}
+
+static void add_sample(counter_t *counter, gint64 start) {
+  const gint64 duration = now_ns() - start;
+  counter->count++;
+  counter->total_ns += duration;
+  counter->max_ns = MAX(counter->max_ns, duration);
+}
+
+void stats_record_call(stats_symbol_t symbol, gint64 start, gboolean failed) {
+  if (start == 0) {
+    return;
+  }
+  g_mutex_lock(&stats.lock);
+  add_sample(&stats.symbols[symbol], start);
+  if (failed) {
+    stats.symbols[symbol].errors++;
+  }
+  g_mutex_unlock(&stats.lock);
+}
+
+void stats_record_io(stats_io_t phase, gint64 start, gsize bytes) {
+  if (start == 0) {
+    return;
+  }
+  g_mutex_lock(&stats.lock);
+  add_sample(&stats.io[phase], start);
+  stats.io[phase].bytes += bytes;
+  g_mutex_unlock(&stats.lock);
+}
+
+void stats_record_cache(gboolean hit) {
+  if (stats.path == NULL) {
+    return;
+  }
+  g_mutex_lock(&stats.lock);
+  if (hit) {
+    stats.cache_hits++;
+  } else {
+    stats.cache_misses++;
+  }
+  g_mutex_unlock(&stats.lock);
+}
+
+static void append_counter(GString *out, const char *name,
+                           const counter_t *counter, gboolean with_errors,
+                           gboolean with_bytes) {
+  g_string_append_printf(out, "    \"%s\": {\"count\": %" G_GUINT64_FORMAT,
+                         name, counter->count);
+  if (with_errors) {
+    g_string_append_printf(out, ", \"errors\": %" G_GUINT64_FORMAT,
+                           counter->errors);
+  }
+  if (with_bytes) {
+    g_string_append_printf(out, ", \"bytes\": %" G_GUINT64_FORMAT,
+                           counter->bytes);
+  }
+  g_string_append_printf(out, ", \"total_us\": %.3f, \"max_us\": %.3f}",
+                         counter->total_ns / 1e3, counter->max_ns / 1e3);
+}
+
+void stats_dump(void) {
+  if (stats.path == NULL) {
+    return;
+  }
+
+  GString *out = g_string_new("{\n");
+  g_mutex_lock(&stats.lock);
+  g_string_append_printf(out, "  \"pid\": %d,\n  \"symbols\": {\n",
+                         (int)getpid());
+  for (int i = 0; i < STATS_N_SYMBOLS; ++i) {
+    append_counter(out, symbol_names[i], &stats.symbols[i], TRUE, FALSE);
+    g_string_append(out, i + 1 < STATS_N_SYMBOLS ? ",\n" : "\n");
+  }
+  g_string_append(out, "  },\n  \"io\": {\n");
+  for (int i = 0; i < STATS_N_IO; ++i) {
+    append_counter(out, io_names[i], &stats.io[i], FALSE, TRUE);
+    g_string_append(out, i + 1 < STATS_N_IO ? ",\n" : "\n");
+  }
+  g_string_append_printf(out,
+                         "  },\n  \"cache\": {\"hits\": %" G_GUINT64_FORMAT
+                         ", \"misses\": %" G_GUINT64_FORMAT "}\n}\n",
+                         stats.cache_hits, stats.cache_misses);
+  g_mutex_unlock(&stats.lock);
+
+  g_autofree gchar *pid = g_strdup_printf("%d", (int)getpid());
+  g_auto(GStrv) parts = g_strsplit(stats.path, "%p", -1);
+  g_autofree gchar *path = g_strjoinv(pid, parts);
+
+  g_autoptr(GError) error = NULL;
+  if (!g_file_set_contents(path, out->str, (gssize)out->len, &error)) {
+    g_warning("Could not write the statistics: %s", error->message);
+  }
+  g_string_free(out, TRUE);
+}
+
+void stats_atfork_prepare(void) { g_mutex_lock(&stats.lock); }
+
+void stats_atfork_parent(void) { g_mutex_unlock(&stats.lock); }
+
+void stats_atfork_child(void) {
+  memset(stats.symbols, 0, sizeof(stats.symbols));
+  memset(stats.io, 0, sizeof(stats.io));
+  stats.cache_hits = stats.cache_misses = 0;
+  g_mutex_unlock(&stats.lock);
+}
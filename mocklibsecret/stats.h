@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Optional instrumentation of the exported functions and of the file I/O.
+ *
+ * If the environment variable MOCKLIBSECRET_STATS is set to a path, call
+ * counts, error counts and latencies of every entry point, as well as the
+ * number of bytes and the time spent reading, parsing, serializing and writing
+ * passwords.ini are collected and written to that path as JSON when the
+ * library is unloaded. "%p" in the path is replaced by the process id, so that
+ * forked processes do not overwrite each other's statistics.
+ *
+ * Without MOCKLIBSECRET_STATS, all functions return right away.
+ */
+
+typedef enum {
+  STATS_PASSWORD_STORE_SYNC,
+  STATS_PASSWORD_LOOKUP_SYNC,
+  STATS_PASSWORD_CLEAR_SYNC,
+  STATS_SERVICE_SEARCH_SYNC,
+  STATS_PASSWORD_STORE,
+  STATS_PASSWORD_LOOKUP,
+  STATS_PASSWORD_CLEAR,
+  STATS_SERVICE_SEARCH,
+  STATS_N_SYMBOLS
+} stats_symbol_t;
+
+typedef enum {
+  STATS_IO_READ,
+  STATS_IO_PARSE,
+  STATS_IO_SERIALIZE,
+  STATS_IO_WRITE,
+  STATS_N_IO
+} stats_io_t;
+
+/* Reads MOCKLIBSECRET_STATS. */
+void stats_init(void);
+
+/* Writes the statistics to the configured path. */
+void stats_dump(void);
+
+/*
+ * Returns the start time of a measurement, which has to be passed to the
+ * stats_record_*() functions, or 0 if the statistics are disabled.
+ */
+gint64 stats_start(void);
+
+/* Records a call of an entry point that started at start. */
+void stats_record_call(stats_symbol_t symbol, gint64 start, gboolean failed);
+
+/* Records an I/O phase that started at start and processed bytes. */
+void stats_record_io(stats_io_t phase, gint64 start, gsize bytes);
+
+/* Records whether passwords.ini could be served from the cache. */
+void stats_record_cache(gboolean hit);
+
+/* pthread_atfork() handlers, the child starts with empty statistics */
+void stats_atfork_prepare(void);
+void stats_atfork_parent(void);
+void stats_atfork_child(void);
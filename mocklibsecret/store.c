@@ -0,0 +1,1025 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "store.h"
+
+#define NO_ENTRY G_MAXUINT32
+
+/* values of the index slots that do not refer to an entry */
+#define EMPTY_SLOT G_MAXUINT32
+#define TOMBSTONE (G_MAXUINT32 - 1)
+
+#define MIN_SLOTS 16
+
+typedef struct {
+  /* index into store->services */
+  guint32 service;
+  /*
+   * account and password share one allocation, which is owned by the entry.
+   * account is NULL if the entry got removed.
+   */
+  gchar *account;
+  const gchar *password;
+  guint32 hash;
+  /* neighbours within the same service, NO_ENTRY if there are none */
+  guint32 prev;
+  guint32 next;
+} entry_t;
+
+typedef struct {
+  gchar *name;
+  /* first and last entry in insertion order */
+  guint32 first;
+  guint32 last;
+  gsize count;
+} service_t;
+
+/*
+ * The binary image created by store_to_image(), all integers are in native
+ * byte order (it is a cache and not meant to be portable):
+ *
+ * image_header_t
+ * image_service_t services[n_services]  (in insertion order)
+ * guint32 sorted_services[n_services]   (indexes, sorted by name)
+ * image_entry_t entries[n_entries]      (grouped by service, in order)
+ * guint32 slots[n_slots]                (like store->slots, no tombstones)
+ * gchar blob[blob_size]                 (NUL terminated strings)
+ *
+ * All strings are referenced by their offset in the blob, the account and
+ * password of an entry are stored next to each other.
+ */
+#define IMAGE_MAGIC "MLSBIN\0\1"
+
+typedef struct {
+  gchar magic[8];
+  guint32 n_services;
+  guint32 n_entries;
+  guint32 n_slots;
+  guint32 blob_size;
+  store_origin_t origin;
+} image_header_t;
+
+typedef struct {
+  guint32 name;
+  guint32 first;
+  guint32 count;
+} image_service_t;
+
+typedef struct {
+  guint32 service;
+  guint32 account;
+  guint32 password;
+  guint32 hash;
+} image_entry_t;
+
+typedef struct {
+  GBytes *bytes;
+  const image_header_t *header;
+  const image_service_t *services;
+  const guint32 *sorted_services;
+  const image_entry_t *entries;
+  const guint32 *slots;
+  const gchar *blob;
+} image_t;
+
+struct store {
+  /* entry_t, removed entries stay in here until the next rebuild */
+  GArray *entries;
+  guint32 n_removed;
+
+  /*
+   * The index: an open addressing hash table with linear probing that maps
+   * (service, account) to the position in entries. n_slots is a power of two.
+   */
+  guint32 *slots;
+  guint32 n_slots;
+  /* slots that are not EMPTY_SLOT (i.e. entries plus tombstones) */
+  guint32 n_used_slots;
+
+  /* service_t, services are never removed, like GKeyFile keeps empty groups */
+  GArray *services;
+  /* service name -> position in services + 1 */
+  GHashTable *service_index;
+
+  /*
+   * If image.bytes is not NULL, the contents are read from a binary image and
+   * the fields above are empty until the store gets modified for the first
+   * time (see thaw()).
+   */
+  image_t image;
+};
+
+static guint32 entry_hash(guint32 service, const gchar *account) {
+  return g_str_hash(account) ^ (service * 0x9E3779B1u);
+}
+
+static guint32 lookup_service(const store_t *store, const gchar *name) {
+  const guint idx =
+      GPOINTER_TO_UINT(g_hash_table_lookup(store->service_index, name));
+  return idx == 0 ? NO_ENTRY : idx - 1;
+}
+
+static guint32 get_or_add_service(store_t *store, const gchar *name) {
+  guint32 idx = lookup_service(store, name);
+  if (idx != NO_ENTRY) {
+    return idx;
+  }
+
+  service_t service = {g_strdup(name), NO_ENTRY, NO_ENTRY, 0};
+  g_array_append_val(store->services, service);
+  idx = store->services->len - 1;
+  g_hash_table_insert(store->service_index, service.name,
+                      GUINT_TO_POINTER(idx + 1));
+  return idx;
+}
+
+#define ENTRY(store, idx) (&g_array_index((store)->entries, entry_t, (idx)))
+#define SERVICE(store, idx) (&g_array_index((store)->services, service_t, (idx)))
+
+/*
+ * Returns the position of the entry in entries or NO_ENTRY if it does not
+ * exist. slot is set to the slot of the entry or to the slot where it should
+ * be inserted.
+ */
+static guint32 find_entry(const store_t *store, guint32 service,
+                          const gchar *account, guint32 hash, guint32 *slot) {
+  const guint32 mask = store->n_slots - 1;
+  guint32 first_tombstone = NO_ENTRY;
+
+  // terminates, since we never let the index fill up completely
+  for (guint32 i = hash & mask;; i = (i + 1) & mask) {
+    const guint32 value = store->slots[i];
+    if (value == EMPTY_SLOT) {
+      *slot = first_tombstone != NO_ENTRY ? first_tombstone : i;
+      return NO_ENTRY;
+    }
+    if (value == TOMBSTONE) {
+      if (first_tombstone == NO_ENTRY) {
+        first_tombstone = i;
+      }
+      continue;
+    }
+
+    const entry_t *entry = ENTRY(store, value);
+    if (entry->hash == hash && entry->service == service &&
+        strcmp(entry->account, account) == 0) {
+      *slot = i;
+      return value;
+    }
+  }
+}
+
+/*
+ * Accessors that work for both representations, entries of an image are
+ * referenced by their position in image.entries.
+ */
+static gboolean is_image(const store_t *store) {
+  return store->image.bytes != NULL;
+}
+
+static guint32 n_services(const store_t *store) {
+  return is_image(store) ? store->image.header->n_services
+                         : store->services->len;
+}
+
+static const gchar *service_name(const store_t *store, guint32 srv) {
+  return is_image(store)
+             ? store->image.blob + store->image.services[srv].name
+             : SERVICE(store, srv)->name;
+}
+
+static gsize service_count(const store_t *store, guint32 srv) {
+  return is_image(store) ? store->image.services[srv].count
+                         : SERVICE(store, srv)->count;
+}
+
+static guint32 service_first(const store_t *store, guint32 srv) {
+  if (!is_image(store)) {
+    return SERVICE(store, srv)->first;
+  }
+  const image_service_t *service = &store->image.services[srv];
+  return service->count > 0 ? service->first : NO_ENTRY;
+}
+
+static guint32 entry_next(const store_t *store, guint32 idx) {
+  if (!is_image(store)) {
+    return ENTRY(store, idx)->next;
+  }
+  const image_entry_t *entries = store->image.entries;
+  return idx + 1 < store->image.header->n_entries &&
+                 entries[idx + 1].service == entries[idx].service
+             ? idx + 1
+             : NO_ENTRY;
+}
+
+static void get_entry(const store_t *store, guint32 idx, guint32 *service,
+                      const gchar **account, const gchar **password) {
+  if (is_image(store)) {
+    const image_entry_t *entry = &store->image.entries[idx];
+    *service = entry->service;
+    *account = store->image.blob + entry->account;
+    *password = store->image.blob + entry->password;
+  } else {
+    const entry_t *entry = ENTRY(store, idx);
+    *service = entry->service;
+    *account = entry->account;
+    *password = entry->password;
+  }
+}
+
+static guint32 find_service(const store_t *store, const gchar *name) {
+  if (!is_image(store)) {
+    return lookup_service(store, name);
+  }
+
+  // binary search in the sorted index
+  const guint32 *sorted = store->image.sorted_services;
+  guint32 low = 0, high = store->image.header->n_services;
+  while (low < high) {
+    const guint32 mid = low + (high - low) / 2;
+    const int cmp = strcmp(service_name(store, sorted[mid]), name);
+    if (cmp == 0) {
+      return sorted[mid];
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NO_ENTRY;
+}
+
+/* Like find_entry(), but for both representations. */
+static guint32 lookup_entry(const store_t *store, guint32 service,
+                            const gchar *account) {
+  const guint32 hash = entry_hash(service, account);
+  if (!is_image(store)) {
+    guint32 slot;
+    return find_entry(store, service, account, hash, &slot);
+  }
+
+  const image_t *image = &store->image;
+  const guint32 mask = image->header->n_slots - 1;
+  // terminates, check_image() ensured that there are empty slots
+  for (guint32 i = hash & mask;; i = (i + 1) & mask) {
+    const guint32 value = image->slots[i];
+    if (value == EMPTY_SLOT) {
+      return NO_ENTRY;
+    }
+    const image_entry_t *entry = &image->entries[value];
+    if (entry->hash == hash && entry->service == service &&
+        strcmp(image->blob + entry->account, account) == 0) {
+      return value;
+    }
+  }
+}
+
+/*
+ * Drops all removed entries and recreates the index so that it can hold at
+ * least n_entries entries.
+ */
+static void rebuild(store_t *store, guint32 n_entries) {
+  guint32 n_slots = MIN_SLOTS;
+  // keep the load factor below 3/4
+  while ((guint64)n_slots * 3 < (guint64)n_entries * 4 + 4) {
+    n_slots *= 2;
+  }
+
+  // copy the live entries service by service, so that the order within each
+  // service is preserved
+  GArray *old = store->entries;
+  store->entries = g_array_sized_new(FALSE, FALSE, sizeof(entry_t),
+                                     old->len - store->n_removed);
+  for (guint32 s = 0; s < store->services->len; ++s) {
+    service_t *service = SERVICE(store, s);
+    guint32 idx = service->first;
+    service->first = service->last = NO_ENTRY;
+
+    while (idx != NO_ENTRY) {
+      entry_t entry = g_array_index(old, entry_t, idx);
+      idx = entry.next;
+
+      entry.prev = service->last;
+      entry.next = NO_ENTRY;
+      g_array_append_val(store->entries, entry);
+      const guint32 new_idx = store->entries->len - 1;
+      if (service->last != NO_ENTRY) {
+        ENTRY(store, service->last)->next = new_idx;
+      } else {
+        service->first = new_idx;
+      }
+      service->last = new_idx;
+    }
+  }
+  g_array_unref(old);
+
+  g_free(store->slots);
+  store->slots = g_new(guint32, n_slots);
+  memset(store->slots, 0xff, n_slots * sizeof(guint32));
+  store->n_slots = n_slots;
+  store->n_used_slots = store->entries->len;
+  store->n_removed = 0;
+
+  const guint32 mask = n_slots - 1;
+  for (guint32 idx = 0; idx < store->entries->len; ++idx) {
+    guint32 i = ENTRY(store, idx)->hash & mask;
+    while (store->slots[i] != EMPTY_SLOT) {
+      i = (i + 1) & mask;
+    }
+    store->slots[i] = idx;
+  }
+}
+
+store_t *store_new(void) {
+  store_t *store = g_new0(store_t, 1);
+  store->entries = g_array_new(FALSE, FALSE, sizeof(entry_t));
+  store->services = g_array_new(FALSE, FALSE, sizeof(service_t));
+  store->service_index = g_hash_table_new(g_str_hash, g_str_equal);
+  rebuild(store, 0);
+  return store;
+}
+
+void store_free(store_t *store) {
+  if (store == NULL) {
+    return;
+  }
+  for (guint32 i = 0; i < store->entries->len; ++i) {
+    g_free(ENTRY(store, i)->account);
+  }
+  for (guint32 i = 0; i < store->services->len; ++i) {
+    g_free(SERVICE(store, i)->name);
+  }
+  g_array_unref(store->entries);
+  g_array_unref(store->services);
+  g_hash_table_unref(store->service_index);
+  g_free(store->slots);
+  g_clear_pointer(&store->image.bytes, g_bytes_unref);
+  g_free(store);
+}
+
+static void set_entry_strings(entry_t *entry, const gchar *account,
+                              const gchar *password) {
+  const gsize account_len = strlen(account) + 1;
+  const gsize password_len = strlen(password) + 1;
+  gchar *buf = g_malloc(account_len + password_len);
+  memcpy(buf, account, account_len);
+  memcpy(buf + account_len, password, password_len);
+
+  g_free(entry->account);
+  entry->account = buf;
+  entry->password = buf + account_len;
+}
+
+static void set_in_service(store_t *store, guint32 service,
+                           const gchar *account, const gchar *password) {
+  const guint32 hash = entry_hash(service, account);
+  guint32 slot;
+  guint32 idx = find_entry(store, service, account, hash, &slot);
+
+  if (idx != NO_ENTRY) {
+    // replace the password but keep the position, like GKeyFile does
+    set_entry_strings(ENTRY(store, idx), account, password);
+    return;
+  }
+
+  if ((guint64)(store->n_used_slots + 1) * 4 > (guint64)store->n_slots * 3) {
+    rebuild(store, store->entries->len - store->n_removed + 1);
+    find_entry(store, service, account, hash, &slot);
+  }
+
+  service_t *srv = SERVICE(store, service);
+  entry_t entry = {service, NULL, NULL, hash, srv->last, NO_ENTRY};
+  set_entry_strings(&entry, account, password);
+  g_array_append_val(store->entries, entry);
+  idx = store->entries->len - 1;
+
+  if (srv->last != NO_ENTRY) {
+    ENTRY(store, srv->last)->next = idx;
+  } else {
+    srv->first = idx;
+  }
+  srv->last = idx;
+  srv->count++;
+
+  if (store->slots[slot] == EMPTY_SLOT) {
+    store->n_used_slots++;
+  }
+  store->slots[slot] = idx;
+}
+
+/*
+ * Converts a store that is backed by an image into the mutable
+ * representation.
+ */
+static void thaw(store_t *store) {
+  if (!is_image(store)) {
+    return;
+  }
+
+  image_t image = store->image;
+  memset(&store->image, 0, sizeof(store->image));
+
+  rebuild(store, image.header->n_entries);
+  for (guint32 s = 0; s < image.header->n_services; ++s) {
+    const image_service_t *service = &image.services[s];
+    const guint32 srv = get_or_add_service(store, image.blob + service->name);
+    for (guint32 idx = service->first; idx < service->first + service->count;
+         ++idx) {
+      const image_entry_t *entry = &image.entries[idx];
+      set_in_service(store, srv, image.blob + entry->account,
+                     image.blob + entry->password);
+    }
+  }
+
+  g_bytes_unref(image.bytes);
+}
+
+void store_set(store_t *store, const gchar *service, const gchar *account,
+               const gchar *password) {
+  thaw(store);
+  set_in_service(store, get_or_add_service(store, service), account, password);
+}
+
+const gchar *store_lookup(const store_t *store, const gchar *service,
+                          const gchar *account) {
+  const guint32 srv = find_service(store, service);
+  if (srv == NO_ENTRY) {
+    return NULL;
+  }
+
+  const guint32 idx = lookup_entry(store, srv, account);
+  if (idx == NO_ENTRY) {
+    return NULL;
+  }
+  guint32 entry_service;
+  const gchar *entry_account, *password;
+  get_entry(store, idx, &entry_service, &entry_account, &password);
+  return password;
+}
+
+gboolean store_remove(store_t *store, const gchar *service,
+                      const gchar *account) {
+  if (store_lookup(store, service, account) == NULL) {
+    return FALSE;
+  }
+  thaw(store);
+
+  const guint32 srv_idx = lookup_service(store, service);
+  if (srv_idx == NO_ENTRY) {
+    return FALSE;
+  }
+
+  guint32 slot;
+  const guint32 idx =
+      find_entry(store, srv_idx, account, entry_hash(srv_idx, account), &slot);
+  if (idx == NO_ENTRY) {
+    return FALSE;
+  }
+
+  entry_t *entry = ENTRY(store, idx);
+  service_t *srv = SERVICE(store, srv_idx);
+  if (entry->prev != NO_ENTRY) {
+    ENTRY(store, entry->prev)->next = entry->next;
+  } else {
+    srv->first = entry->next;
+  }
+  if (entry->next != NO_ENTRY) {
+    ENTRY(store, entry->next)->prev = entry->prev;
+  } else {
+    srv->last = entry->prev;
+  }
+  srv->count--;
+
+  g_clear_pointer(&entry->account, g_free);
+  entry->password = NULL;
+  store->slots[slot] = TOMBSTONE;
+  store->n_removed++;
+
+  // don't let removed entries pile up
+  if (store->n_removed > MIN_SLOTS &&
+      store->n_removed > store->entries->len / 2) {
+    rebuild(store, store->entries->len - store->n_removed);
+  }
+
+  return TRUE;
+}
+
+gsize store_count(const store_t *store, const store_query_t *query) {
+  if (query->service != NULL) {
+    const guint32 srv = find_service(store, query->service);
+    if (srv == NO_ENTRY) {
+      return 0;
+    }
+    if (query->account == NULL) {
+      return service_count(store, srv);
+    }
+    return lookup_entry(store, srv, query->account) != NO_ENTRY ? 1 : 0;
+  }
+
+  const guint32 services = n_services(store);
+  gsize count = 0;
+  for (guint32 srv = 0; srv < services; ++srv) {
+    if (query->account == NULL) {
+      count += service_count(store, srv);
+    } else if (lookup_entry(store, srv, query->account) != NO_ENTRY) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+void store_iter_init(store_iter_t *iter, const store_t *store,
+                     const store_query_t *query) {
+  iter->store = store;
+  iter->account = query->account;
+  iter->next = NO_ENTRY;
+
+  if (query->service == NULL) {
+    iter->service = 0;
+    iter->end_service = n_services(store);
+    return;
+  }
+
+  const guint32 srv = find_service(store, query->service);
+  iter->service = srv == NO_ENTRY ? 0 : srv;
+  iter->end_service = srv == NO_ENTRY ? 0 : srv + 1;
+}
+
+gboolean store_iter_next(store_iter_t *iter, const gchar **service,
+                         const gchar **account, const gchar **password) {
+  const store_t *store = iter->store;
+
+  while (iter->next == NO_ENTRY) {
+    if (iter->service >= iter->end_service) {
+      return FALSE;
+    }
+    const guint32 srv = iter->service++;
+    iter->next = iter->account != NULL
+                     ? lookup_entry(store, srv, iter->account)
+                     : service_first(store, srv);
+  }
+
+  guint32 srv;
+  get_entry(store, iter->next, &srv, account, password);
+  *service = service_name(store, srv);
+  // there is at most one entry per service with the same account
+  iter->next = iter->account != NULL ? NO_ENTRY : entry_next(store, iter->next);
+  return TRUE;
+}
+
+gboolean store_is_valid_name(const gchar *service, const gchar *account) {
+  // same restrictions as g_key_file_is_group_name() and
+  // g_key_file_is_key_name() (without support for locales)
+  if (service == NULL || *service == '\0' || account == NULL ||
+      *account == '\0') {
+    return FALSE;
+  }
+  for (const gchar *p = service; *p != '\0'; ++p) {
+    if (*p == '[' || *p == ']' || g_ascii_iscntrl(*p)) {
+      return FALSE;
+    }
+  }
+  for (const gchar *p = account; *p != '\0'; ++p) {
+    if (*p == '=' || *p == '[' || *p == ']' || *p == '\n' || *p == '\r') {
+      return FALSE;
+    }
+  }
+  return !g_ascii_isspace(account[0]) &&
+         !g_ascii_isspace(account[strlen(account) - 1]);
+}
+
+/* the inverse of escape_value(), see g_key_file_parse_value_as_string() */
+static gchar *unescape_value(const gchar *value, gsize length,
+                             GError **error) {
+  gchar *result = g_malloc(length + 1);
+  gchar *q = result;
+
+  for (const gchar *p = value; p < value + length; ++p) {
+    if (*p != '\\') {
+      *q++ = *p;
+      continue;
+    }
+
+    ++p;
+    if (p == value + length) {
+      g_set_error_literal(error, G_KEY_FILE_ERROR,
+                          G_KEY_FILE_ERROR_INVALID_VALUE,
+                          "Key file contains escape character at end of line");
+      g_free(result);
+      return NULL;
+    }
+
+    switch (*p) {
+    case 's':
+      *q++ = ' ';
+      break;
+    case 'n':
+      *q++ = '\n';
+      break;
+    case 't':
+      *q++ = '\t';
+      break;
+    case 'r':
+      *q++ = '\r';
+      break;
+    case '\\':
+      *q++ = '\\';
+      break;
+    case ';':
+      // only an escape sequence in lists, keep it as is
+      *q++ = '\\';
+      *q++ = ';';
+      break;
+    default:
+      g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                  "Key file contains invalid escape sequence '\\%c'", *p);
+      g_free(result);
+      return NULL;
+    }
+  }
+
+  *q = '\0';
+  return result;
+}
+
+/* escapes value like g_key_file_set_string() */
+static void escape_value(GString *out, const gchar *value) {
+  gboolean leading_space = TRUE;
+  for (const gchar *p = value; *p != '\0'; ++p) {
+    switch (*p) {
+    case ' ':
+      g_string_append(out, leading_space ? "\\s" : " ");
+      break;
+    case '\t':
+      g_string_append(out, leading_space ? "\\t" : "\t");
+      break;
+    case '\n':
+      g_string_append(out, "\\n");
+      leading_space = FALSE;
+      break;
+    case '\r':
+      g_string_append(out, "\\r");
+      leading_space = FALSE;
+      break;
+    case '\\':
+      g_string_append(out, "\\\\");
+      leading_space = FALSE;
+      break;
+    default:
+      g_string_append_c(out, *p);
+      leading_space = FALSE;
+    }
+  }
+}
+
+store_t *store_new_from_data(const gchar *data, gsize length, GError **error) {
+  store_t *store = store_new();
+  guint32 current_service = NO_ENTRY;
+  const gchar *const end = data + length;
+
+  for (const gchar *line = data; line < end;) {
+    const gchar *newline = memchr(line, '\n', end - line);
+    const gchar *line_end = newline != NULL ? newline : end;
+    const gchar *next_line = newline != NULL ? newline + 1 : end;
+
+    if (line_end > line && line_end[-1] == '\r') {
+      --line_end;
+    }
+    while (line < line_end && g_ascii_isspace(*line)) {
+      ++line;
+    }
+
+    if (line == line_end || *line == '#') {
+      // empty line or comment
+    } else if (*line == '[') {
+      const gchar *close = memchr(line, ']', line_end - line);
+      if (close == NULL) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                    "Invalid group name: %.*s", (int)(line_end - line), line);
+        goto err;
+      }
+      g_autofree gchar *name = g_strndup(line + 1, close - line - 1);
+      current_service = get_or_add_service(store, name);
+    } else {
+      if (current_service == NO_ENTRY) {
+        g_set_error_literal(error, G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                            "Key file does not start with a group");
+        goto err;
+      }
+
+      const gchar *equals = memchr(line, '=', line_end - line);
+      if (equals == NULL) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                    "Key file contains line '%.*s' which is not a key-value "
+                    "pair, group, or comment",
+                    (int)(line_end - line), line);
+        goto err;
+      }
+
+      const gchar *key_end = equals;
+      while (key_end > line && g_ascii_isspace(key_end[-1])) {
+        --key_end;
+      }
+      const gchar *value = equals + 1;
+      while (value < line_end && (*value == ' ' || *value == '\t')) {
+        ++value;
+      }
+
+      g_autofree gchar *account = g_strndup(line, key_end - line);
+      g_autofree gchar *password =
+          unescape_value(value, line_end - value, error);
+      if (password == NULL) {
+        goto err;
+      }
+      set_in_service(store, current_service, account, password);
+    }
+
+    line = next_line;
+  }
+
+  return store;
+
+err:
+  store_free(store);
+  return NULL;
+}
+
+void store_to_data(const store_t *store, GString *out) {
+  g_string_truncate(out, 0);
+
+  const guint32 services = n_services(store);
+  for (guint32 s = 0; s < services; ++s) {
+    // separate groups by an empty line, like GKeyFile does
+    if (out->len >= 2 && out->str[out->len - 2] != '\n') {
+      g_string_append_c(out, '\n');
+    }
+    g_string_append_printf(out, "[%s]\n", service_name(store, s));
+
+    for (guint32 idx = service_first(store, s); idx != NO_ENTRY;
+         idx = entry_next(store, idx)) {
+      guint32 srv;
+      const gchar *account, *password;
+      get_entry(store, idx, &srv, &account, &password);
+      g_string_append(out, account);
+      g_string_append_c(out, '=');
+      escape_value(out, password);
+      g_string_append_c(out, '\n');
+    }
+  }
+}
+
+static gboolean corrupt_image(GError **error, const gchar *reason) {
+  g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+              "Invalid password store image: %s", reason);
+  return FALSE;
+}
+
+/*
+ * Checks everything that the accessors rely on, so that a corrupt image can
+ * never result in reads out of bounds.
+ */
+static gboolean check_image(const image_t *image, gsize size, GError **error) {
+  const image_header_t *header = image->header;
+  if (size < sizeof(image_header_t) ||
+      memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0) {
+    return corrupt_image(error, "bad magic");
+  }
+  const guint64 expected_size =
+      sizeof(image_header_t) +
+      (guint64)header->n_services *
+          (sizeof(image_service_t) + sizeof(guint32)) +
+      (guint64)header->n_entries * sizeof(image_entry_t) +
+      (guint64)header->n_slots * sizeof(guint32) + header->blob_size;
+  if (expected_size != size) {
+    return corrupt_image(error, "size mismatch");
+  }
+  if (header->n_slots == 0 || (header->n_slots & (header->n_slots - 1)) != 0 ||
+      header->n_slots <= header->n_entries) {
+    return corrupt_image(error, "invalid number of slots");
+  }
+  // an empty blob is fine, the offsets are checked below
+  if (header->blob_size > 0 && image->blob[header->blob_size - 1] != '\0') {
+    return corrupt_image(error, "unterminated strings");
+  }
+
+  guint32 next_entry = 0;
+  for (guint32 s = 0; s < header->n_services; ++s) {
+    const image_service_t *service = &image->services[s];
+    if (service->name >= header->blob_size || service->first != next_entry ||
+        service->count > header->n_entries - next_entry) {
+      return corrupt_image(error, "invalid service");
+    }
+    for (guint32 idx = service->first; idx < service->first + service->count;
+         ++idx) {
+      const image_entry_t *entry = &image->entries[idx];
+      if (entry->service != s || entry->account >= header->blob_size ||
+          entry->password >= header->blob_size) {
+        return corrupt_image(error, "invalid entry");
+      }
+    }
+    next_entry += service->count;
+  }
+  if (next_entry != header->n_entries) {
+    return corrupt_image(error, "entries without a service");
+  }
+
+  // the binary search needs unique names in ascending order
+  const gchar *previous = NULL;
+  for (guint32 i = 0; i < header->n_services; ++i) {
+    const guint32 srv = image->sorted_services[i];
+    if (srv >= header->n_services) {
+      return corrupt_image(error, "invalid service index");
+    }
+    const gchar *name = image->blob + image->services[srv].name;
+    if (previous != NULL && strcmp(previous, name) >= 0) {
+      return corrupt_image(error, "unsorted service index");
+    }
+    previous = name;
+  }
+
+  // every entry is indexed exactly once, which leaves n_slots - n_entries > 0
+  // empty slots, so that probing in lookup_entry() always terminates
+  g_autofree guint8 *indexed = g_malloc0(header->n_entries / 8 + 1);
+  guint32 n_indexed = 0;
+  for (guint32 i = 0; i < header->n_slots; ++i) {
+    const guint32 value = image->slots[i];
+    if (value == EMPTY_SLOT) {
+      continue;
+    }
+    if (value >= header->n_entries ||
+        (indexed[value / 8] & (1u << (value % 8))) != 0) {
+      return corrupt_image(error, "invalid slot");
+    }
+    indexed[value / 8] |= (guint8)(1u << (value % 8));
+    ++n_indexed;
+  }
+  if (n_indexed != header->n_entries) {
+    return corrupt_image(error, "entries missing from the index");
+  }
+  return TRUE;
+}
+
+store_t *store_new_from_image(GBytes *bytes, store_origin_t *origin,
+                              GError **error) {
+  gsize size;
+  const gchar *data = g_bytes_get_data(bytes, &size);
+
+  image_t image = {.bytes = bytes, .header = (const image_header_t *)data};
+  if (size >= sizeof(image_header_t)) {
+    const image_header_t *header = image.header;
+    const gchar *p = data + sizeof(image_header_t);
+    // only compute the pointers if they stay within the data
+    const guint64 fixed_size =
+        sizeof(image_header_t) +
+        (guint64)header->n_services *
+            (sizeof(image_service_t) + sizeof(guint32)) +
+        (guint64)header->n_entries * sizeof(image_entry_t) +
+        (guint64)header->n_slots * sizeof(guint32);
+    if (fixed_size <= size) {
+      image.services = (const image_service_t *)p;
+      p += header->n_services * sizeof(image_service_t);
+      image.sorted_services = (const guint32 *)p;
+      p += header->n_services * sizeof(guint32);
+      image.entries = (const image_entry_t *)p;
+      p += header->n_entries * sizeof(image_entry_t);
+      image.slots = (const guint32 *)p;
+      p += header->n_slots * sizeof(guint32);
+      image.blob = p;
+    }
+  }
+  if (image.blob == NULL) {
+    corrupt_image(error, "truncated");
+    return NULL;
+  }
+  if (!check_image(&image, size, error)) {
+    return NULL;
+  }
+
+  store_t *store = store_new();
+  store->image = image;
+  g_bytes_ref(bytes);
+  if (origin != NULL) {
+    *origin = image.header->origin;
+  }
+  return store;
+}
+
+static gint compare_service_names(gconstpointer a, gconstpointer b,
+                                  gpointer user_data) {
+  const store_t *store = user_data;
+  return strcmp(service_name(store, *(const guint32 *)a),
+                service_name(store, *(const guint32 *)b));
+}
+
+void store_to_image(const store_t *store, const store_origin_t *origin,
+                    GString *out) {
+  const guint32 services = n_services(store);
+  guint32 n_entries = 0;
+  for (guint32 s = 0; s < services; ++s) {
+    n_entries += (guint32)service_count(store, s);
+  }
+  guint32 n_slots = MIN_SLOTS;
+  while ((guint64)n_slots * 3 < (guint64)n_entries * 4 + 4) {
+    n_slots *= 2;
+  }
+
+  // the fixed size part, the strings are appended afterwards
+  const gsize services_offset = sizeof(image_header_t);
+  const gsize sorted_offset =
+      services_offset + services * sizeof(image_service_t);
+  const gsize entries_offset = sorted_offset + services * sizeof(guint32);
+  const gsize slots_offset = entries_offset + n_entries * sizeof(image_entry_t);
+  const gsize blob_offset = slots_offset + n_slots * sizeof(guint32);
+  g_string_set_size(out, blob_offset);
+  memset(out->str, 0, blob_offset);
+
+  image_header_t *header = (image_header_t *)out->str;
+  image_service_t *image_services =
+      (image_service_t *)(out->str + services_offset);
+  guint32 *sorted = (guint32 *)(out->str + sorted_offset);
+  image_entry_t *entries = (image_entry_t *)(out->str + entries_offset);
+  guint32 *slots = (guint32 *)(out->str + slots_offset);
+
+  memcpy(header->magic, IMAGE_MAGIC, sizeof(header->magic));
+  header->n_services = services;
+  header->n_entries = n_entries;
+  header->n_slots = n_slots;
+  header->origin = *origin;
+
+  // assign the blob offsets first, the strings are copied in a second pass,
+  // since appending them can move the fixed size part in memory
+  guint32 blob_size = 0;
+  guint32 idx = 0;
+  for (guint32 s = 0; s < services; ++s) {
+    image_services[s].name = blob_size;
+    image_services[s].first = idx;
+    image_services[s].count = (guint32)service_count(store, s);
+    blob_size += strlen(service_name(store, s)) + 1;
+    sorted[s] = s;
+
+    for (guint32 e = service_first(store, s); e != NO_ENTRY;
+         e = entry_next(store, e), ++idx) {
+      guint32 srv;
+      const gchar *account, *password;
+      get_entry(store, e, &srv, &account, &password);
+      entries[idx].service = s;
+      entries[idx].account = blob_size;
+      blob_size += strlen(account) + 1;
+      entries[idx].password = blob_size;
+      blob_size += strlen(password) + 1;
+      entries[idx].hash = entry_hash(s, account);
+    }
+  }
+  header->blob_size = blob_size;
+
+  g_qsort_with_data(sorted, (gint)services, sizeof(guint32),
+                    compare_service_names, (gpointer)store);
+
+  memset(slots, 0xff, n_slots * sizeof(guint32));
+  const guint32 mask = n_slots - 1;
+  for (guint32 i = 0; i < n_entries; ++i) {
+    guint32 slot = entries[i].hash & mask;
+    while (slots[slot] != EMPTY_SLOT) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = i;
+  }
+
+  for (guint32 s = 0; s < services; ++s) {
+    g_string_append_len(out, service_name(store, s),
+                        strlen(service_name(store, s)) + 1);
+    for (guint32 e = service_first(store, s); e != NO_ENTRY;
+         e = entry_next(store, e)) {
+      guint32 srv;
+      const gchar *account, *password;
+      get_entry(store, e, &srv, &account, &password);
+      g_string_append_len(out, account, strlen(account) + 1);
+      g_string_append_len(out, password, strlen(password) + 1);
+    }
+  }
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * In-memory password store with O(1) lookups by service and account.
+ *
+ * Entries are kept in the order in which they were added (per service), so
+ * that serializing a loaded store reproduces the file and search results are
+ * in the same order as in passwords.ini.
+ *
+ * The store is not thread safe, callers have to synchronize access.
+ */
+typedef struct store store_t;
+
+store_t *store_new(void);
+void store_free(store_t *store);
+
+/*
+ * Parses the contents of passwords.ini (a GKeyFile with one group per service
+ * and the accounts as keys). Comments are dropped.
+ */
+store_t *store_new_from_data(const gchar *data, gsize length, GError **error);
+
+/*
+ * Serializes the store in the same format that GKeyFile would produce. The
+ * previous contents of out are replaced, so that callers can reuse a buffer.
+ */
+void store_to_data(const store_t *store, GString *out);
+
+/*
+ * Identifies the file that a binary image was created from, so that a stale
+ * image can be detected. All fields are zero if there is no such file.
+ */
+typedef struct {
+  guint64 dev;
+  guint64 ino;
+  guint64 size;
+  gint64 mtime_sec;
+  gint64 mtime_nsec;
+} store_origin_t;
+
+/*
+ * Creates a store that serves all reads directly from a binary image created
+ * by store_to_image(), e.g. a memory mapped file, without parsing or copying
+ * anything. The image is only copied into the regular representation when
+ * the store is modified. A reference to image is kept.
+ *
+ * The image is validated up front, so that corrupt files are rejected with an
+ * error. If origin is not NULL, it is set to the value passed to
+ * store_to_image().
+ */
+store_t *store_new_from_image(GBytes *image, store_origin_t *origin,
+                              GError **error);
+
+/* Serializes the store into a binary image, replacing the contents of out. */
+void store_to_image(const store_t *store, const store_origin_t *origin,
+                    GString *out);
+
+/*
+ * Returns whether service and account can be stored, GKeyFile imposes some
+ * restrictions on group and key names.
+ */
+gboolean store_is_valid_name(const gchar *service, const gchar *account);
+
+/* Returns the password or NULL, the result is owned by the store. */
+const gchar *store_lookup(const store_t *store, const gchar *service,
+                          const gchar *account);
+
+/* Adds or replaces the password of service and account. */
+void store_set(store_t *store, const gchar *service, const gchar *account,
+               const gchar *password);
+
+/* Removes the entry, returns FALSE if it did not exist. */
+gboolean store_remove(store_t *store, const gchar *service,
+                      const gchar *account);
+
+/*
+ * Selects the entries whose attributes match, NULL attributes match any
+ * value. Exact and service-only queries are answered from the index, account
+ * only queries do one index lookup per service.
+ */
+typedef struct {
+  const gchar *service;
+  const gchar *account;
+} store_query_t;
+
+/* Number of entries matching the query. */
+gsize store_count(const store_t *store, const store_query_t *query);
+
+/*
+ * Iterator over all entries matching a query, in the order of passwords.ini.
+ * The store must not be modified while iterating.
+ */
+typedef struct {
+  const store_t *store;
+  /* NULL if all accounts match */
+  const gchar *account;
+  /* the service that is currently visited and the end of the range */
+  guint32 service;
+  guint32 end_service;
+  guint32 next;
+} store_iter_t;
+
+void store_iter_init(store_iter_t *iter, const store_t *store,
+                     const store_query_t *query);
+gboolean store_iter_next(store_iter_t *iter, const gchar **service,
+                         const gchar **account, const gchar **password);
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Stress test of concurrent calls into the mock from many threads of one
+ * process, like keytar does from libuv's thread pool.
+ *
+ * Every thread stores, looks up and clears its own accounts and checks that it
+ * always reads back what it wrote, while all threads keep looking up a shared
+ * account and searching the whole service. Any mismatch aborts the process.
+ *
+ * With --daemon the given mocklibsecretd is started in the same HOME and all
+ * calls go through it. Meanwhile another thread keeps sending pipelined
+ * requests on connections that it closes without reading the responses,
+ * which the daemon has to survive.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsecret/secret.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mocklibsecret.h"
+#include "protocol.h"
+
+#define SERVICE "stress"
+#define SHARED_ACCOUNT "shared"
+#define SHARED_PASSWORD "shared password"
+
+/* accounts per thread */
+#define N_ACCOUNTS 8
+
+/* connections that are closed with requests in flight in daemon mode */
+#define N_ABANDONED_CONNECTIONS 200
+
+static const SecretSchema schema = {
+    "org.freedesktop.Secret.Generic",
+    SECRET_SCHEMA_NONE,
+    {{"service", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {"account", SECRET_SCHEMA_ATTRIBUTE_STRING},
+     {NULL, 0}},
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL};
+
+static gint n_threads = 16;
+static gint iterations = 2000;
+static gchar *daemon_path = NULL;
+
+static GOptionEntry entries[] = {
+    {"threads", 'j', 0, G_OPTION_ARG_INT, &n_threads,
+     "Number of threads (default: 16)", "N"},
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+     "Operations per thread (default: 2000)", "N"},
+    {"daemon", 'd', 0, G_OPTION_ARG_FILENAME, &daemon_path,
+     "Run the test through this mocklibsecretd", "PATH"},
+    {NULL, 0, 0, 0, NULL, NULL, NULL}};
+
+static void check_error(const char *what, GError *error) {
+  if (error != NULL) {
+    g_error("%s failed: %s", what, error->message);
+  }
+}
+
+static gchar *lookup(const gchar *account) {
+  g_autoptr(GError) error = NULL;
+  gchar *password = secret_password_lookup_sync(
+      &schema, NULL, &error, "service", SERVICE, "account", account, NULL);
+  check_error("lookup", error);
+  return password;
+}
+
+static void store(const gchar *account, const gchar *password) {
+  g_autoptr(GError) error = NULL;
+  secret_password_store_sync(&schema, NULL, "label", password, NULL, &error,
+                             "service", SERVICE, "account", account, NULL);
+  check_error("store", error);
+}
+
+static void clear(const gchar *account, gboolean expect_removal) {
+  g_autoptr(GError) error = NULL;
+  const gboolean removed = secret_password_clear_sync(
+      &schema, NULL, &error, "service", SERVICE, "account", account, NULL);
+  check_error("clear", error);
+  if (removed != expect_removal) {
+    g_error("clearing %s returned %d", account, removed);
+  }
+}
+
+/*
+ * Searches all accounts of the service: the shared one must be there and the
+ * passwords of all others must belong to the thread that owns the account.
+ */
+static void search(GHashTable *attributes) {
+  g_autoptr(GError) error = NULL;
+  GList *items = secret_service_search_sync(
+      NULL, &schema, attributes,
+      SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS,
+      NULL, &error);
+  check_error("search", error);
+
+  gboolean found_shared = FALSE;
+  for (GList *l = items; l != NULL; l = l->next) {
+    GHashTable *item_attributes = secret_item_get_attributes(l->data);
+    const gchar *account = g_hash_table_lookup(item_attributes, "account");
+    SecretValue *value = secret_item_get_secret(l->data);
+    const gchar *password = secret_value_get_text(value);
+
+    if (g_strcmp0(account, SHARED_ACCOUNT) == 0) {
+      found_shared = g_strcmp0(password, SHARED_PASSWORD) == 0;
+    } else {
+      // account "t<thread>-a<n>" has a password "t<thread>-<iteration>"
+      const gchar *dash = account != NULL ? strchr(account, '-') : NULL;
+      if (dash == NULL ||
+          strncmp(account, password, (gsize)(dash - account + 1)) != 0) {
+        g_error("account %s has the password %s", account, password);
+      }
+    }
+
+    secret_value_unref(value);
+    g_hash_table_unref(item_attributes);
+  }
+  g_list_free(items);
+
+  if (!found_shared) {
+    g_error("search did not return the shared account");
+  }
+}
+
+/*
+ * Starts mocklibsecretd with a socket in home and waits until it accepts
+ * connections.
+ */
+static GPid start_daemon(const gchar *home) {
+  g_autofree gchar *socket_path = g_build_filename(home, "daemon.sock", NULL);
+  gchar *argv[] = {daemon_path, "--socket", socket_path, NULL};
+  g_auto(GStrv) envp =
+      g_environ_unsetenv(g_get_environ(), "MOCKLIBSECRET_DAEMON");
+
+  g_autoptr(GError) error = NULL;
+  GPid pid;
+  gint out;
+  if (!g_spawn_async_with_pipes(NULL, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD,
+                                NULL, NULL, &pid, NULL, &out, NULL, &error)) {
+    g_error("could not start %s: %s", daemon_path, error->message);
+  }
+
+  // the daemon prints the socket path once it is listening
+  gchar line[PATH_MAX + 2];
+  FILE *f = fdopen(out, "r");
+  if (fgets(line, sizeof(line), f) == NULL) {
+    g_error("%s exited before listening", daemon_path);
+  }
+  fclose(f);
+
+  g_setenv("MOCKLIBSECRET_DAEMON", socket_path, TRUE);
+  return pid;
+}
+
+static void stop_daemon(GPid pid) {
+  int status;
+  kill(pid, SIGTERM);
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != EXIT_SUCCESS) {
+    g_error("%s did not exit cleanly", daemon_path);
+  }
+  g_spawn_close_pid(pid);
+}
+
+/*
+ * Sends pipelined requests to the daemon at socket_path and hangs up without
+ * reading the responses, like a client that gets killed in the middle of its
+ * calls.
+ */
+static gpointer abandon_connections(gpointer socket_path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  g_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+
+  g_autoptr(GString) requests = g_string_new(NULL);
+  const gchar *const lookup_strings[] = {SERVICE, SHARED_ACCOUNT};
+  const gchar *const search_strings[] = {SERVICE};
+  for (gint i = 0; i < 64; ++i) {
+    protocol_append_message(requests, PROTOCOL_LOOKUP,
+                            PROTOCOL_HAS_SERVICE | PROTOCOL_HAS_ACCOUNT,
+                            lookup_strings, G_N_ELEMENTS(lookup_strings));
+    protocol_append_message(requests, PROTOCOL_SEARCH, PROTOCOL_HAS_SERVICE,
+                            search_strings, G_N_ELEMENTS(search_strings));
+  }
+
+  for (gint i = 0; i < N_ABANDONED_CONNECTIONS; ++i) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      g_error("could not connect to %s: %s", (const gchar *)socket_path,
+              g_strerror(errno));
+    }
+    g_autoptr(GError) error = NULL;
+    if (!protocol_write_all(fd, requests->str, requests->len, &error)) {
+      g_error("could not send requests: %s", error->message);
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+/* Removes everything the mock created in dir, including passwords.d. */
+static void remove_files(const gchar *dir) {
+  GDir *d = g_dir_open(dir, 0, NULL);
+  if (d == NULL) {
+    return;
+  }
+  const gchar *name;
+  while ((name = g_dir_read_name(d)) != NULL) {
+    g_autofree gchar *path = g_build_filename(dir, name, NULL);
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+      remove_files(path);
+      g_rmdir(path);
+    } else {
+      g_unlink(path);
+    }
+  }
+  g_dir_close(d);
+}
+
+static gpointer worker(gpointer data) {
+  const guint id = GPOINTER_TO_UINT(data);
+  // NULL if the account is not stored
+  gchar *expected[N_ACCOUNTS] = {NULL};
+
+  GHashTable *attributes = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_insert(attributes, "service", SERVICE);
+
+  for (gint i = 0; i < iterations; ++i) {
+    const guint n = (guint)g_random_int_range(0, N_ACCOUNTS);
+    gchar account[32];
+    snprintf(account, sizeof(account), "t%u-a%u", id, n);
+
+    switch (i % 4) {
+    case 0: {
+      g_free(expected[n]);
+      expected[n] = g_strdup_printf("t%u-%d", id, i);
+      store(account, expected[n]);
+      break;
+    }
+    case 1: {
+      gchar *password = lookup(account);
+      if (g_strcmp0(password, expected[n]) != 0) {
+        g_error("%s: expected %s, got %s", account, expected[n], password);
+      }
+      secret_password_free(password);
+      break;
+    }
+    case 2: {
+      gchar *password = lookup(SHARED_ACCOUNT);
+      if (g_strcmp0(password, SHARED_PASSWORD) != 0) {
+        g_error("shared account: got %s", password);
+      }
+      secret_password_free(password);
+      break;
+    }
+    case 3:
+      if (i % 16 == 3) {
+        search(attributes);
+      } else {
+        clear(account, expected[n] != NULL);
+        g_clear_pointer(&expected[n], g_free);
+      }
+      break;
+    }
+  }
+
+  for (guint n = 0; n < N_ACCOUNTS; ++n) {
+    if (expected[n] != NULL) {
+      gchar account[32];
+      snprintf(account, sizeof(account), "t%u-a%u", id, n);
+      clear(account, TRUE);
+      g_free(expected[n]);
+    }
+  }
+  g_hash_table_unref(attributes);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  g_autoptr(GOptionContext) context =
+      g_option_context_new("- stress test mocklibsecret from many threads");
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_autoptr(GError) error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+
+  g_autofree gchar *home =
+      g_dir_make_tmp("mocklibsecret-stress-XXXXXX", &error);
+  if (home == NULL) {
+    g_printerr("%s\n", error->message);
+    return EXIT_FAILURE;
+  }
+  g_setenv("HOME", home, TRUE);
+  const GPid daemon = daemon_path != NULL ? start_daemon(home) : 0;
+
+  store(SHARED_ACCOUNT, SHARED_PASSWORD);
+
+  const gint64 start = g_get_monotonic_time();
+  GPtrArray *threads = g_ptr_array_new();
+  for (gint t = 0; t < MAX(n_threads, 1); ++t) {
+    g_ptr_array_add(threads, g_thread_new("stress", worker,
+                                          GUINT_TO_POINTER((guint)t)));
+  }
+  GThread *abandoning =
+      daemon_path != NULL
+          ? g_thread_new("abandon", abandon_connections,
+                         (gpointer)g_getenv("MOCKLIBSECRET_DAEMON"))
+          : NULL;
+  for (guint t = 0; t < threads->len; ++t) {
+    g_thread_join(g_ptr_array_index(threads, t));
+  }
+  if (abandoning != NULL) {
+    g_thread_join(abandoning);
+  }
+  const gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+  // a password that is too long for the size classes of the buffer pool
+  g_autofree gchar *long_password = g_strnfill(5000, 'x');
+  store("long", long_password);
+  gchar *long_lookup = lookup("long");
+  g_assert_cmpstr(long_lookup, ==, long_password);
+  secret_password_free(long_lookup);
+  clear("long", TRUE);
+
+  // all threads removed their accounts again
+  gchar *shared = lookup(SHARED_ACCOUNT);
+  g_assert_cmpstr(shared, ==, SHARED_PASSWORD);
+  secret_password_free(shared);
+  clear(SHARED_ACCOUNT, TRUE);
+
+  printf("%u threads, %d operations each in %.2f s\n", threads->len,
+         iterations, seconds);
+  g_ptr_array_free(threads, TRUE);
+
+  // write deferred changes now and not once the library gets unloaded
+  if (daemon_path != NULL) {
+    stop_daemon(daemon);
+  } else {
+    mocklibsecret_reinit();
+  }
+
+  remove_files(home);
+  g_rmdir(home);
+
+  return EXIT_SUCCESS;
+}
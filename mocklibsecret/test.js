@@ -25,6 +25,7 @@
 const keytar = require("keytar");
 const assert = require("assert");
 const fsPromises = require("fs").promises;
+const { fork } = require("child_process");
 const { tmpdir } = require("os");
 const { join } = require("path");
 
@@ -38,6 +39,70 @@ const PW2 = `pw_${ACC2}`;
 
 const FAIL_FILE = join(tmpdir(), "mocklibsecret_error_message");
 
+/** With sharding every service has its own files in HOME/passwords.d */
+const SHARDED = process.env.MOCKLIBSECRET_SHARDING === "service";
+
+/** The file of service in home with the extension ext, e.g. "ini" */
+const storePath = (home, ext, service = SERVICE_NAME) =>
+  SHARDED
+    ? join(home, "passwords.d", `${encodeURIComponent(service)}.${ext}`)
+    : join(home, `passwords.${ext}`);
+
+const PASSWORDS_INI = storePath(process.env.HOME, "ini");
+
+const BINARY_BACKEND = process.env.MOCKLIBSECRET_BACKEND === "binary";
+/** The extension of the file that the backend writes to */
+const STORE_EXT = BINARY_BACKEND ? "bin" : "ini";
+
+const DEFERRED_WRITEBACK = process.env.MOCKLIBSECRET_WRITEBACK === "deferred";
+const WRITEBACK_DELAY_MS = parseInt(
+  process.env.MOCKLIBSECRET_WRITEBACK_DELAY_MS || "100",
+  10
+);
+
+/** Modifications only go to passwords.journal until it gets compacted */
+const JOURNAL_WRITEBACK = process.env.MOCKLIBSECRET_WRITEBACK === "journal";
+const JOURNAL_MAX_KB = parseInt(
+  process.env.MOCKLIBSECRET_JOURNAL_MAX_KB || "256",
+  10
+);
+/** How an account and its password appear in the store file */
+const storedEntry = (account, password) =>
+  BINARY_BACKEND ? `${account}\0${password}` : `${account}=${password}`;
+
+/**
+ * Everything that was written to disk in home: the store file and, since it
+ * might not have been compacted yet, the journal. With sharding, the store
+ * file is only created once something is written to it.
+ */
+const readWritten = async (home) => {
+  let contents = "";
+  for (const ext of [STORE_EXT, ...(JOURNAL_WRITEBACK ? ["journal"] : [])]) {
+    try {
+      contents += await fsPromises.readFile(storePath(home, ext), "utf-8");
+    } catch (err) {
+      if (ext === STORE_EXT && !SHARDED) {
+        throw err;
+      }
+    }
+  }
+  return contents;
+};
+
+/** Whether contents from readWritten() contain account with password */
+const isWritten = (contents, account, password) =>
+  contents.includes(storedEntry(account, password)) ||
+  (JOURNAL_WRITEBACK && contents.includes(`${account}\0${password}`));
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+/** Wait until all deferred modifications must have been written to disk */
+const waitForWriteback = async () => {
+  if (DEFERRED_WRITEBACK) {
+    await sleep(5 * WRITEBACK_DELAY_MS);
+  }
+};
+
 const ensureFailFileGone = async () => {
   try {
     await fsPromises.unlink(FAIL_FILE);
@@ -64,6 +129,11 @@ const successTest = async function () {
   let newCreds = await keytar.findCredentials(SERVICE_NAME);
   assert(newCreds.length === 2);
 
+  // like libsecret: missing passwords are not an error
+  assert((await keytar.getPassword(SERVICE_NAME, "nonexistent")) === null);
+  assert(!(await keytar.deletePassword(SERVICE_NAME, "nonexistent")));
+  assert((await keytar.getPassword("other_service", ACC1)) === null);
+
   assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
 
   newCreds = await keytar.findCredentials(SERVICE_NAME);
@@ -71,8 +141,249 @@ const successTest = async function () {
   assert(newCreds[0].account === ACC2);
   assert(newCreds[0].password === PW2);
 
-  // this fails due to limitations of mocklibsecret
-  // console.log(await keytar.findPassword(SERVICE_NAME));
+  // lookups with only the service return the first match
+  assert((await keytar.findPassword(SERVICE_NAME)) === PW2);
+  await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+  assert((await keytar.findPassword(SERVICE_NAME)) === PW2);
+  assert((await keytar.findPassword("other_service")) === null);
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+};
+
+const externalModificationTest = async function () {
+  await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+  assert((await keytar.getPassword(SERVICE_NAME, ACC1)) === PW1);
+  await waitForWriteback();
+
+  // modify passwords.ini behind the back of mocklibsecret, the cached copy
+  // must not be used anymore
+  const newPw = "changed_on_disk";
+  await fsPromises.writeFile(
+    PASSWORDS_INI,
+    `[${SERVICE_NAME}]\n${ACC1}=${newPw}\n${ACC2}=${PW2}\n`
+  );
+  assert((await keytar.getPassword(SERVICE_NAME, ACC1)) === newPw);
+  assert((await keytar.findCredentials(SERVICE_NAME)).length === 2);
+
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC2));
+  assert((await keytar.findCredentials(SERVICE_NAME)).length === 0);
+};
+
+const writebackTest = async function () {
+  await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+  await keytar.setPassword(SERVICE_NAME, ACC2, PW2);
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC2));
+  await waitForWriteback();
+
+  let contents = await readWritten(process.env.HOME);
+  assert(isWritten(contents, ACC1, PW1));
+  // the journal still contains the removed entries
+  assert(JOURNAL_WRITEBACK || !contents.includes(ACC2));
+
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+  await waitForWriteback();
+  contents = await readWritten(process.env.HOME);
+  assert(JOURNAL_WRITEBACK || !contents.includes(ACC1));
+};
+
+const journalCompactionTest = async function () {
+  if (!JOURNAL_WRITEBACK) {
+    return;
+  }
+  const journal = storePath(process.env.HOME, "journal");
+  const storeFile = storePath(process.env.HOME, STORE_EXT);
+  const fileSize = async (path) => {
+    try {
+      return (await fsPromises.stat(path)).size;
+    } catch (_err) {
+      return 0;
+    }
+  };
+  // the shard of a service only gets a store file on the first compaction
+  const inodeOf = async (path) => {
+    try {
+      return (await fsPromises.stat(path)).ino;
+    } catch (_err) {
+      return 0;
+    }
+  };
+
+  // every store appends to the journal, the store file is only rewritten
+  // when it is compacted
+  let compactions = 0;
+  let inode = await inodeOf(storeFile);
+  let maxSize = 0;
+  const count = 200;
+  for (let i = 0; i < count; ++i) {
+    await keytar.setPassword(SERVICE_NAME, ACC1, `${PW1}_${i}`);
+    const newInode = await inodeOf(storeFile);
+    compactions += newInode !== inode ? 1 : 0;
+    inode = newInode;
+    maxSize = Math.max(maxSize, await fileSize(journal));
+  }
+
+  const recordSize = 64;
+  assert(maxSize <= JOURNAL_MAX_KB * 1024 + recordSize);
+  assert(compactions > 0 && compactions < count / 10);
+  assert((await keytar.getPassword(SERVICE_NAME, ACC1)) === `${PW1}_199`);
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+};
+
+const homeChangeTest = async function () {
+  const oldHome = process.env.HOME;
+  const newHome = join(oldHome, "other-home");
+  await fsPromises.mkdir(newHome, { recursive: true });
+
+  try {
+    process.env.HOME = newHome;
+    await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+    assert((await keytar.getPassword(SERVICE_NAME, ACC1)) === PW1);
+    await waitForWriteback();
+    assert(isWritten(await readWritten(newHome), ACC1, PW1));
+  } finally {
+    process.env.HOME = oldHome;
+  }
+
+  assert((await keytar.findCredentials(SERVICE_NAME)).length === 0);
+  await fsPromises.rmdir(newHome, { recursive: true });
+};
+
+const noLeftoverTempFilesTest = async function () {
+  await waitForWriteback();
+  const dir = SHARDED
+    ? join(process.env.HOME, "passwords.d")
+    : process.env.HOME;
+  // temporary files are named like the file they replace plus a suffix
+  const leftovers = (await fsPromises.readdir(dir)).filter((name) =>
+    /\.(ini|bin|journal)\.[0-9a-f]{8}$/.test(name)
+  );
+  assert(leftovers.length === 0, `found leftovers: ${leftovers.join(", ")}`);
+};
+
+/**
+ * With sharding, modifying the passwords of one service must not rewrite the
+ * files of another one
+ */
+const shardIsolationTest = async function () {
+  if (!SHARDED || JOURNAL_WRITEBACK) {
+    return;
+  }
+  const otherService = "other service/with a slash";
+  await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+  await waitForWriteback();
+  const storeFile = storePath(process.env.HOME, STORE_EXT);
+  const inode = (await fsPromises.stat(storeFile)).ino;
+
+  await keytar.setPassword(otherService, ACC2, PW2);
+  await waitForWriteback();
+  assert((await fsPromises.stat(storeFile)).ino === inode);
+  assert(
+    (
+      await fsPromises.readFile(
+        storePath(process.env.HOME, STORE_EXT, otherService),
+        "utf-8"
+      )
+    ).includes(storedEntry(ACC2, PW2))
+  );
+  assert((await keytar.getPassword(otherService, ACC2)) === PW2);
+  assert((await keytar.getPassword(SERVICE_NAME, ACC2)) === null);
+  assert((await keytar.findCredentials(otherService)).length === 1);
+
+  assert(await keytar.deletePassword(otherService, ACC2));
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+};
+
+const manyCredentialsTest = async function () {
+  const count = 500;
+  const account = (i) => `account_${i}`;
+  for (let i = 0; i < count; ++i) {
+    await keytar.setPassword(SERVICE_NAME, account(i), `password_${i}`);
+  }
+
+  const creds = await keytar.findCredentials(SERVICE_NAME);
+  assert(creds.length === count);
+  creds.forEach((cred, i) => {
+    assert(cred.account === account(i));
+    assert(cred.password === `password_${i}`);
+  });
+
+  await Promise.all(
+    creds.map((cred) => keytar.deletePassword(SERVICE_NAME, cred.account))
+  );
+  assert((await keytar.findCredentials(SERVICE_NAME)).length === 0);
+};
+
+const WRITER_PROCESSES = 4;
+const ACCOUNTS_PER_WRITER = 25;
+
+const writerAccount = (writer, i) => `writer${writer}_${i}`;
+
+/** Entry point of the child processes spawned by concurrentWritersTest */
+const writer = async function (id) {
+  for (let i = 0; i < ACCOUNTS_PER_WRITER; ++i) {
+    await keytar.setPassword(SERVICE_NAME, writerAccount(id, i), `pw${i}`);
+  }
+};
+
+const concurrentWritersTest = async function () {
+  await Promise.all(
+    [...Array(WRITER_PROCESSES).keys()].map(
+      (id) =>
+        new Promise((resolve, reject) =>
+          fork(__filename, ["--writer", id.toString()]).on("exit", (code) =>
+            code === 0
+              ? resolve()
+              : reject(new Error(`writer ${id} exited with ${code}`))
+          )
+        )
+    )
+  );
+
+  // no write of any of the processes may have been lost
+  const creds = await keytar.findCredentials(SERVICE_NAME);
+  assert(creds.length === WRITER_PROCESSES * ACCOUNTS_PER_WRITER);
+  for (let id = 0; id < WRITER_PROCESSES; ++id) {
+    for (let i = 0; i < ACCOUNTS_PER_WRITER; ++i) {
+      assert(
+        (await keytar.getPassword(SERVICE_NAME, writerAccount(id, i))) ===
+          `pw${i}`
+      );
+    }
+  }
+
+  await Promise.all(
+    creds.map((cred) => keytar.deletePassword(SERVICE_NAME, cred.account))
+  );
+};
+
+const statsTest = async function () {
+  const statsFile = join(process.env.HOME, "mocklibsecret-stats-%p.json");
+  // use an id that does not clash with concurrentWritersTest
+  const id = WRITER_PROCESSES;
+  const child = fork(__filename, ["--writer", id.toString()], {
+    env: { ...process.env, MOCKLIBSECRET_STATS: statsFile }
+  });
+  const code = await new Promise((resolve) => child.on("exit", resolve));
+  assert(code === 0);
+
+  // the statistics are written when the library is unloaded
+  const path = statsFile.replace("%p", child.pid.toString());
+  const stats = JSON.parse(await fsPromises.readFile(path, "utf8"));
+  await fsPromises.unlink(path);
+
+  assert(stats.pid === child.pid);
+  const store = stats.symbols.secret_password_store_sync;
+  assert(store.count === ACCOUNTS_PER_WRITER);
+  assert(store.errors === 0);
+  assert(store.max_us > 0 && store.total_us >= store.max_us);
+  assert(stats.symbols.secret_password_lookup_sync.count === 0);
+  assert(stats.io.write.count > 0 && stats.io.write.bytes > 0);
+
+  for (let i = 0; i < ACCOUNTS_PER_WRITER; ++i) {
+    assert(
+      await keytar.deletePassword(SERVICE_NAME, writerAccount(id, i))
+    );
+  }
 };
 
 const expectFailure = async (func, regex) => {
@@ -117,18 +428,49 @@ const failViaEmptyFileTest = async function () {
   await failInnerTest(err);
 };
 
-(async () => {
-  await successTest();
-  await failTest();
-  await failViaFileTest();
-  await failViaEmptyFileTest();
-})()
-  .catch((err) => {
-    console.error(`Test failed with: ${err}`);
-    console.error(`${err.stack}`);
+const failFileRemovedTest = async function () {
+  delete process.env.MOCKLIBSECRET_ERROR_MESSAGE;
+  await fsPromises.writeFile(FAIL_FILE, "");
+  await expectFailure(
+    () => keytar.getPassword(SERVICE_NAME, ACC1),
+    "libsecret call failed"
+  );
+
+  await ensureFailFileGone();
+  await keytar.setPassword(SERVICE_NAME, ACC1, PW1);
+  assert((await keytar.getPassword(SERVICE_NAME, ACC1)) === PW1);
+  assert(await keytar.deletePassword(SERVICE_NAME, ACC1));
+};
+
+if (process.argv[2] === "--writer") {
+  writer(parseInt(process.argv[3], 10)).catch((err) => {
+    console.error(`Writer failed with: ${err}`);
     process.exitCode = 1;
-  })
-  .finally(() => {
-    delete process.env.MOCKLIBSECRET_ERROR_MESSAGE;
-    return ensureFailFileGone();
   });
+} else {
+  (async () => {
+    await successTest();
+    await externalModificationTest();
+    await writebackTest();
+    await journalCompactionTest();
+    await manyCredentialsTest();
+    await concurrentWritersTest();
+    await statsTest();
+    await homeChangeTest();
+    await shardIsolationTest();
+    await noLeftoverTempFilesTest();
+    await failTest();
+    await failViaFileTest();
+    await failViaEmptyFileTest();
+    await failFileRemovedTest();
+  })()
+    .catch((err) => {
+      console.error(`Test failed with: ${err}`);
+      console.error(`${err.stack}`);
+      process.exitCode = 1;
+    })
+    .finally(() => {
+      delete process.env.MOCKLIBSECRET_ERROR_MESSAGE;
+      return ensureFailFileGone();
+    });
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Runs the performance tests against the OBS instance started by
+# start-mini-obs.sh and writes the results to ${PERF_REPORT} (defaults to
+# perf-report.json).
+#
+# The size of the test setup can be adjusted via PERF_ACCOUNTS, PERF_BOOKMARKS,
+# PERF_PACKAGES and PERF_ITERATIONS.
+
+set -eox pipefail
+
+export EXTENSION_DEBUG=1
+
+yarn run compile
+yarn run webpack
+yarn run mocklibsecret
+
+node ./out/perf-tests/runPerfTests.js
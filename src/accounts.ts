@@ -626,6 +626,17 @@ class RuntimeAccountConfiguration extends LoggingBase {
         .join("; ")
     );
 
+    // fetch all passwords at once instead of querying the keyring for every
+    // account separately
+    const passwords = new Map<string, string>(
+      accounts.length === 0
+        ? []
+        : (await keytar.findCredentials(KEYTAR_SERVICE_NAME)).map((cred) => [
+            cred.account,
+            cred.password
+          ])
+    );
+
     let addedAccounts = 0;
     const accountsWithoutPw: AccountStorage[] = [];
     const errorMessages: string[] = [];
@@ -644,15 +655,12 @@ class RuntimeAccountConfiguration extends LoggingBase {
 
       /* eslint-disable-next-line @typescript-eslint/no-unnecessary-condition */
       assert(account.apiUrl !== "" && account.accountName !== undefined);
-      const password = await keytar.getPassword(
-        KEYTAR_SERVICE_NAME,
-        account.apiUrl
-      );
+      const password = passwords.get(account.apiUrl);
       assert(
-        password === null || typeof password === "string",
-        `got an invalid password from keytar, expected a string or null, but got '${typeof password}'`
+        password === undefined || typeof password === "string",
+        `got an invalid password from keytar, expected a string, but got '${typeof password}'`
       );
-      if (password === null) {
+      if (password === undefined) {
         this.logger.trace(
           "Account %s is missing a password",
           account.accountName
@@ -103,13 +103,20 @@ export const BRANCH_AND_BOOKMARK_AND_CHECKOUT_PACKAGE_COMMAND = `${cmdPrefix}.${
 
 export const SUBMIT_PACKAGE_COMMAND = `${cmdPrefix}.${cmdId}.submitPackage`;
 
+/** ID of the command to show the next page of a project's packages */
+export const SHOW_MORE_PACKAGES_COMMAND = `${cmdPrefix}.${cmdId}.showMorePackages`;
+
+/** Number of packages that are shown initially and added by "Show more" */
+export const PACKAGE_PAGE_SIZE = 100;
+
 export type BookmarkTreeItem =
   | BookmarkedProjectTreeElement
   | BookmarkedPackageTreeElement
   | FileTreeElement
   | ObsServerTreeElement
   | MyBookmarksElement
-  | AddBookmarkElement;
+  | AddBookmarkElement
+  | ShowMorePackagesElement;
 
 export class BookmarkedProjectTreeElement extends vscode.TreeItem {
   public readonly project: ProjectBookmark;
@@ -228,6 +235,37 @@ function isAddBookmarkElement(
   return element.contextValue === "AddBookmarkElement";
 }
 
+/**
+ * Element at the end of a project's package list that is only shown if not
+ * all packages are displayed. Clicking it shows the next page of packages.
+ */
+export class ShowMorePackagesElement extends vscode.TreeItem {
+  public readonly contextValue = "ShowMorePackagesElement";
+
+  public readonly iconPath = new vscode.ThemeIcon("ellipsis");
+
+  constructor(
+    public readonly parentElement: BookmarkedProjectTreeElement,
+    hiddenPackages: number
+  ) {
+    super(
+      `Show more (${hiddenPackages} more packages)`,
+      vscode.TreeItemCollapsibleState.None
+    );
+    this.command = {
+      arguments: [parentElement],
+      command: SHOW_MORE_PACKAGES_COMMAND,
+      title: "Show more packages"
+    };
+  }
+}
+
+function isShowMorePackagesElement(
+  element: BookmarkTreeItem
+): element is ShowMorePackagesElement {
+  return element.contextValue === "ShowMorePackagesElement";
+}
+
 /** This class represents the tree element under which all bookmarks are put */
 export class MyBookmarksElement extends vscode.TreeItem {
   public readonly contextValue = "MyBookmarksElement";
@@ -247,12 +285,28 @@ const BOOKMARK_ICON = new vscode.ThemeIcon("bookmark");
 
 const BROKEN_BOOKMARK_ICON = makeThemedIconPath("broken_image.svg", false);
 
+/** Key of the project or package element in [[childFetches]] */
+function treeElementKey(
+  element: BookmarkedProjectTreeElement | BookmarkedPackageTreeElement
+): string {
+  return isBookmarkedProjectTreeElement(element)
+    ? `${element.project.apiUrl}/${element.project.name}`
+    : `${element.pkg.apiUrl}/${element.pkg.projectName}/${element.pkg.name}`;
+}
+
+/**
+ * Returns the children of `element`, which belongs to the `rootProject`.
+ *
+ * Only tree elements for the first `shownPackages` packages of a project are
+ * created, followed by a [[ShowMorePackagesElement]] if there are more.
+ */
 function getChildrenOfBookmaredProjectTreeItem(
   rootProject: ProjectBookmark,
   element?:
     | BookmarkedProjectTreeElement
     | BookmarkedPackageTreeElement
-    | FileTreeElement
+    | FileTreeElement,
+  shownPackages = PACKAGE_PAGE_SIZE
 ): BookmarkTreeItem[] {
   // root element
   if (element === undefined) {
@@ -260,11 +314,16 @@ function getChildrenOfBookmaredProjectTreeItem(
   }
 
   if (isBookmarkedProjectTreeElement(element)) {
-    return (
-      rootProject.packages?.map(
-        (pkg) => new BookmarkedPackageTreeElement(pkg)
-      ) ?? []
-    );
+    const packages = rootProject.packages ?? [];
+    const children: BookmarkTreeItem[] = packages
+      .slice(0, shownPackages)
+      .map((pkg) => new BookmarkedPackageTreeElement(pkg));
+    if (packages.length > shownPackages) {
+      children.push(
+        new ShowMorePackagesElement(element, packages.length - shownPackages)
+      );
+    }
+    return children;
   }
 
   if (isBookmarkedPackageTreeElement(element)) {
@@ -290,6 +349,21 @@ export class BookmarkedProjectsTreeProvider
     BookmarkTreeItem | undefined
   > = new vscode.EventEmitter<BookmarkTreeItem | undefined>();
 
+  /** Number of shown packages of the projects that did not show the default */
+  private readonly shownPackages = new Map<string, number>();
+
+  /** Retrievals of the children of project and package elements */
+  private readonly childFetches = new Map<
+    string,
+    { tokenSource: vscode.CancellationTokenSource; result: Promise<unknown> }
+  >();
+
+  /**
+   * Retrievals that were abandoned because their element got collapsed, they
+   * are picked up again if the element is expanded before they finish.
+   */
+  private readonly abandonedFetches = new Map<string, Promise<unknown>>();
+
   constructor(
     accountManager: AccountManager,
     private readonly bookmarkMngr: ProjectBookmarkManager,
@@ -332,6 +406,11 @@ export class BookmarkedProjectsTreeProvider
         this.submitPackage,
         this
       ),
+      vscode.commands.registerCommand(
+        SHOW_MORE_PACKAGES_COMMAND,
+        this.showMorePackages,
+        this
+      ),
 
       bookmarkMngr.onBookmarkUpdate(
         ({ changeType, changedObject, element }) => {
@@ -376,6 +455,102 @@ export class BookmarkedProjectsTreeProvider
     this.onDidChangeTreeDataEmitter.fire(undefined);
   }
 
+  public dispose(): void {
+    this.childFetches.forEach(({ tokenSource }) => tokenSource.cancel());
+    this.childFetches.clear();
+    this.abandonedFetches.clear();
+    super.dispose();
+  }
+
+  /**
+   * Stop waiting for the children of `element` once it has been collapsed and
+   * forget how many packages it showed.
+   *
+   * The fetch itself keeps running in the background and ends up in the
+   * bookmark cache. Expanding the element again while it is still running
+   * waits for it instead of starting another one.
+   */
+  public onDidCollapseElement(element: BookmarkTreeItem): void {
+    if (
+      !isBookmarkedProjectTreeElement(element) &&
+      !isBookmarkedPackageTreeElement(element)
+    ) {
+      return;
+    }
+    const key = treeElementKey(element);
+    const childFetch = this.childFetches.get(key);
+    const wasPaged = this.shownPackages.delete(key);
+    if (childFetch !== undefined) {
+      const { tokenSource, result } = childFetch;
+      tokenSource.cancel();
+      this.childFetches.delete(key);
+      this.abandonedFetches.set(key, result);
+      result
+        .finally(() => {
+          if (this.abandonedFetches.get(key) === result) {
+            this.abandonedFetches.delete(key);
+          }
+        })
+        .catch(() => undefined);
+    }
+    // the tree has to ask for the children again once it is expanded
+    if (childFetch !== undefined || wasPaged) {
+      this.onDidChangeTreeDataEmitter.fire(element);
+    }
+  }
+
+  public showMorePackages(element?: BookmarkTreeItem): void {
+    if (element === undefined || !isBookmarkedProjectTreeElement(element)) {
+      this.logger.error(
+        "showMorePackages called on undefined or on a wrong element: %s",
+        element?.contextValue
+      );
+      return;
+    }
+    const key = treeElementKey(element);
+    this.shownPackages.set(
+      key,
+      (this.shownPackages.get(key) ?? PACKAGE_PAGE_SIZE) + PACKAGE_PAGE_SIZE
+    );
+    this.onDidChangeTreeDataEmitter.fire(element);
+  }
+
+  /**
+   * Retrieve the children of `element` via `fetch`, unless the element gets
+   * collapsed before that finished.
+   *
+   * A retrieval that was abandoned by collapsing `element` and that is still
+   * running is reused instead of invoking `fetch` again.
+   *
+   * @return The result of `fetch` or `undefined` if the element was collapsed.
+   */
+  private async fetchChildren<T>(
+    element: BookmarkedProjectTreeElement | BookmarkedPackageTreeElement,
+    fetch: () => Promise<T>
+  ): Promise<T | undefined> {
+    const key = treeElementKey(element);
+    this.childFetches.get(key)?.tokenSource.cancel();
+    const result =
+      (this.abandonedFetches.get(key) as Promise<T> | undefined) ?? fetch();
+    this.abandonedFetches.delete(key);
+    const tokenSource = new vscode.CancellationTokenSource();
+    this.childFetches.set(key, { tokenSource, result });
+
+    try {
+      return await Promise.race([
+        result,
+        new Promise<undefined>((resolve) =>
+          tokenSource.token.onCancellationRequested(() => resolve(undefined))
+        )
+      ]);
+    } finally {
+      if (this.childFetches.get(key)?.tokenSource === tokenSource) {
+        this.childFetches.delete(key);
+      }
+      tokenSource.dispose();
+    }
+  }
+
   public getTreeItem(element: BookmarkTreeItem): vscode.TreeItem {
     if (!isProjectTreeItem(element)) {
       return element;
@@ -413,7 +588,7 @@ export class BookmarkedProjectsTreeProvider
     if (element === undefined) {
       return [new AddBookmarkElement(), new MyBookmarksElement()];
     }
-    if (isAddBookmarkElement(element)) {
+    if (isAddBookmarkElement(element) || isShowMorePackagesElement(element)) {
       return undefined;
     } else if (isMyBookmarksElement(element)) {
       return dropUndefined(
@@ -446,10 +621,11 @@ export class BookmarkedProjectsTreeProvider
     assert(
       !isMyBookmarksElement(element) &&
         !isObsServerTreeElement(element) &&
-        !isAddBookmarkElement(element),
+        !isAddBookmarkElement(element) &&
+        !isShowMorePackagesElement(element),
       `Invalid element: ${
         element.contextValue ?? "no context value"
-      }. Must not be a MyBookmarksElement, ObsServerTreeElement or a AddBookmarkElement`
+      }. Must not be a MyBookmarksElement, ObsServerTreeElement, AddBookmarkElement or a ShowMorePackagesElement`
     );
 
     const projTreeItem:
@@ -458,34 +634,42 @@ export class BookmarkedProjectsTreeProvider
       | FileTreeElement = element;
 
     if (isProjectTreeElement(projTreeItem)) {
-      const projFromBookmark = await logException(
-        this.logger,
-        () =>
-          this.bookmarkMngr.getBookmarkedProject(
-            projTreeItem.project.apiUrl,
-            projTreeItem.project.name,
-            RefreshBehavior.FetchWhenMissing
-          ),
-        `Retrieving the bookmarked project ${projTreeItem.project.name}`
+      const projFromBookmark = await this.fetchChildren(projTreeItem, () =>
+        logException(
+          this.logger,
+          () =>
+            this.bookmarkMngr.getBookmarkedProject(
+              projTreeItem.project.apiUrl,
+              projTreeItem.project.name,
+              RefreshBehavior.FetchWhenMissing
+            ),
+          `Retrieving the bookmarked project ${projTreeItem.project.name}`
+        )
       );
 
       return projFromBookmark === undefined
         ? []
-        : getChildrenOfBookmaredProjectTreeItem(projFromBookmark, projTreeItem);
+        : getChildrenOfBookmaredProjectTreeItem(
+            projFromBookmark,
+            projTreeItem,
+            this.shownPackages.get(treeElementKey(projTreeItem))
+          );
     }
 
     if (isBookmarkedPackageTreeElement(projTreeItem)) {
       const apiUrl = projTreeItem.parentProject.apiUrl;
-      const pkg = await logException(
-        this.logger,
-        () =>
-          this.bookmarkMngr.getBookmarkedPackage(
-            apiUrl,
-            projTreeItem.parentProject.name,
-            projTreeItem.pkg.name,
-            RefreshBehavior.FetchWhenMissing
-          ),
-        `Retrieving the bookmarked package ${projTreeItem.pkg.name}`
+      const pkg = await this.fetchChildren(projTreeItem, () =>
+        logException(
+          this.logger,
+          () =>
+            this.bookmarkMngr.getBookmarkedPackage(
+              apiUrl,
+              projTreeItem.parentProject.name,
+              projTreeItem.pkg.name,
+              RefreshBehavior.FetchWhenMissing
+            ),
+          `Retrieving the bookmarked package ${projTreeItem.pkg.name}`
+        )
       );
       return pkg === undefined
         ? []
@@ -25,6 +25,7 @@ import {
   Arch,
   BuildResult,
   BuildStatusView,
+  Connection,
   fetchBuildLog,
   fetchBuildResults,
   fetchJobStatus,
@@ -40,10 +41,12 @@ import {
   BookmarkTreeItem,
   isBookmarkedPackageTreeElement
 } from "./bookmark-tree-view";
+import { BuildLogBuffer } from "./build-log-buffer";
 import { cmdPrefix, ignoreFocusOut, URI_AUTHORITY } from "./constants";
 import { logAndReportExceptions } from "./decorators";
 import { VscodeWindow } from "./dependency-injection";
 import { isPackageTreeElement, ProjectTreeItem } from "./project-view";
+import { RequestScheduler } from "./request-scheduler";
 import { promptUserForPackage } from "./util";
 
 const OBS_BUILD_STATUS_SCHEME = "vscodeObsBuildStatus";
@@ -267,12 +270,21 @@ interface PackageRepoArch extends BasePackage {
 }
 
 interface PkgBuildLog {
-  log: string;
+  buffer: BuildLogBuffer;
+  /** Was the build still running when the log was fetched? */
   running: boolean;
+  /** The fetch of the log that is currently in progress */
+  fetch?: Promise<void>;
   deletionTimeout: NodeJS.Timeout;
   finishedTime?: Date;
 }
 
+/** Time after which build logs that are not updated are dropped */
+const LOG_RETENTION_MS = 300 * 1000;
+
+/** Minimum time between two change events of a build log that is streamed */
+const LOG_CHANGE_INTERVAL_MS = 500;
+
 export class BuildLogDisplay
   extends ConnectionListenerLoggerBase
   implements vscode.TextDocumentContentProvider {
@@ -281,6 +293,10 @@ export class BuildLogDisplay
 
   private readonly logMap = new Map<string, PkgBuildLog>();
 
+  /** Logs that received new chunks since the last change event */
+  private readonly changedLogs = new Map<string, vscode.Uri>();
+  private changeTimer: NodeJS.Timeout | undefined;
+
   private static getKeyFromUri(uri: vscode.Uri): string {
     assert(
       uri.authority === URI_AUTHORITY && uri.scheme === OBS_BUILD_LOG_SCHEME
@@ -288,44 +304,63 @@ export class BuildLogDisplay
     return `${uri.path}/${uri.query}`;
   }
 
+  /**
+   * Returns the part of the log that is kept in memory, prefixed by a note
+   * where to find the older part if it has been swapped to disk.
+   */
   private getLogFromMap(uri: vscode.Uri): undefined | string {
-    return this.logMap.get(BuildLogDisplay.getKeyFromUri(uri))?.log;
+    const buffer = this.logMap.get(BuildLogDisplay.getKeyFromUri(uri))?.buffer;
+    if (buffer === undefined) {
+      return undefined;
+    }
+    if (buffer.swappedBytes === 0) {
+      return buffer.tail();
+    }
+    const location =
+      buffer.swapError !== undefined
+        ? `could not be saved: ${buffer.swapError}`
+        : `are in ${buffer.swapFile ?? "a temporary file"}`;
+    return `[The first ${
+      buffer.swappedBytes
+    } bytes of this log ${location}]\n${buffer.tail()}`;
   }
 
-  private setFinishedLogInMap(uri: vscode.Uri, log: string): void {
-    const key = BuildLogDisplay.getKeyFromUri(uri);
-    const deletionTimeout = this.logMap.get(key)?.deletionTimeout;
-    if (deletionTimeout !== undefined) {
-      deletionTimeout.refresh();
-    }
-    this.logMap.set(key, {
-      log,
-      running: false,
-      finishedTime: new Date(),
-      deletionTimeout:
-        deletionTimeout ??
-        setTimeout(this.deletionCallback, 300 * 1000, uri, this)
+  private disposeBuffer(buffer: BuildLogBuffer): void {
+    buffer.dispose().catch((err) => {
+      this.logger.error(
+        "Removing the temporary file of a build log failed with %s",
+        err
+      );
     });
   }
 
-  // FIXME: enable this eventually
-  // private cleanupLogMap(): void {
-  //   let mapSize = 0;
-  //   for (const buildLog of this.logMap.values()) {
-  //     mapSize += buildLog.log.length;
-  //   }
-  //   if (mapSize)
-  // }
-
   private deleteLogFromMap(uri: vscode.Uri): void {
     const key = BuildLogDisplay.getKeyFromUri(uri);
-    const timer = this.logMap.get(key)?.deletionTimeout;
-    if (timer !== undefined) {
-      clearTimeout(timer);
+    const entry = this.logMap.get(key);
+    if (entry !== undefined) {
+      clearTimeout(entry.deletionTimeout);
+      this.disposeBuffer(entry.buffer);
     }
     this.logMap.delete(key);
   }
 
+  /**
+   * Fire a change event for the log with the given `uri`, but not more often
+   * than every [[LOG_CHANGE_INTERVAL_MS]], as a running build can produce
+   * thousands of chunks.
+   */
+  private scheduleChange(uri: vscode.Uri): void {
+    this.changedLogs.set(BuildLogDisplay.getKeyFromUri(uri), uri);
+    if (this.changeTimer === undefined) {
+      this.changeTimer = setTimeout(() => {
+        this.changeTimer = undefined;
+        const uris = [...this.changedLogs.values()];
+        this.changedLogs.clear();
+        uris.forEach((changedUri) => this.onDidChangeEmitter.fire(changedUri));
+      }, LOG_CHANGE_INTERVAL_MS);
+    }
+  }
+
   public static uriToPkgRepoArch(uri: vscode.Uri): PackageRepoArch {
     if (
       uri.scheme !== OBS_BUILD_LOG_SCHEME ||
@@ -384,7 +419,8 @@ export class BuildLogDisplay
   constructor(
     accountManager: AccountManager,
     logger: IVSCodeExtLogger,
-    private readonly vscodeWindow: VscodeWindow = vscode.window
+    private readonly vscodeWindow: VscodeWindow = vscode.window,
+    private readonly requestScheduler = new RequestScheduler()
   ) {
     super(accountManager, logger);
     this.disposables.push(
@@ -400,10 +436,25 @@ export class BuildLogDisplay
     );
   }
 
-  private deletionCallback(uri: vscode.Uri): void {
-    this.logMap.delete(BuildLogDisplay.getKeyFromUri(uri));
+  public dispose(): void {
+    if (this.changeTimer !== undefined) {
+      clearTimeout(this.changeTimer);
+    }
+    for (const entry of this.logMap.values()) {
+      clearTimeout(entry.deletionTimeout);
+      this.disposeBuffer(entry.buffer);
+    }
+    this.logMap.clear();
+    super.dispose();
   }
 
+  /**
+   * Start fetching the build log of `uri` unless it is already present.
+   *
+   * The log is streamed into a [[BuildLogBuffer]] and a change event is fired
+   * as new chunks arrive, so that the document fills up while the build runs
+   * instead of only once the whole log has been downloaded.
+   */
   private async fetchLogForPkg(
     uri: vscode.Uri,
     {
@@ -414,106 +465,136 @@ export class BuildLogDisplay
     }
   ): Promise<void> {
     const pkgRepoArch = BuildLogDisplay.uriToPkgRepoArch(uri);
-    const hasUri = this.logMap.has(BuildLogDisplay.getKeyFromUri(uri));
-    if (!hasUri || !!forceRefresh) {
-      const multibuildName = pkgRepoArch.multibuildName;
-      const con = this.activeAccounts.getConfig(pkgRepoArch.apiUrl)?.connection;
-      if (con === undefined) {
-        throw new Error(
-          `no valid account found for the API ${pkgRepoArch.apiUrl}`
-        );
-      }
-      const jobStatus = await fetchJobStatus(
-        con,
-        pkgRepoArch,
-        pkgRepoArch.arch,
-        pkgRepoArch.repository,
-        multibuildName
-      );
-      if (token?.isCancellationRequested ?? false) {
-        return;
-      }
+    const key = BuildLogDisplay.getKeyFromUri(uri);
+    const previous = this.logMap.get(key);
+    // a log that is currently streamed is always up to date
+    if (
+      previous !== undefined &&
+      (!forceRefresh || previous.fetch !== undefined)
+    ) {
+      return;
+    }
 
-      // no job is running
-      if (jobStatus === undefined) {
-        const fetchLogPromise = fetchBuildLog(
+    const con = this.activeAccounts.getConfig(pkgRepoArch.apiUrl)?.connection;
+    if (con === undefined) {
+      throw new Error(
+        `no valid account found for the API ${pkgRepoArch.apiUrl}`
+      );
+    }
+    const jobStatus = await this.requestScheduler.run(
+      pkgRepoArch.apiUrl,
+      () =>
+        fetchJobStatus(
           con,
           pkgRepoArch,
           pkgRepoArch.arch,
           pkgRepoArch.repository,
-          { noStream: true, multibuildName }
-        );
-        if (!hasUri) {
-          this.setFinishedLogInMap(uri, await fetchLogPromise);
-        } else if (forceRefresh) {
-          fetchLogPromise
-            .then((log) => {
-              this.setFinishedLogInMap(uri, log);
-            })
-            .catch((reason) => {
-              this.logger.error(
-                "Fetching the build log of %s/%s for the repository %s & architecture %s asynchronously failed with %s",
-                pkgRepoArch.projectName,
-                pkgRepoArch.name,
-                pkgRepoArch.repository,
-                pkgRepoArch.arch,
-                reason
-              );
-            });
+          pkgRepoArch.multibuildName
+        ),
+      `jobStatus${key}`
+    );
+    // bail if we got cancelled or someone else started a fetch in the meantime
+    if (
+      (token?.isCancellationRequested ?? false) ||
+      this.logMap.get(key) !== previous
+    ) {
+      return;
+    }
+
+    // The log of a build that is still running only grows, so we continue
+    // where the last fetch stopped. Otherwise the package might have been
+    // rebuild since and the log is fetched anew.
+    const resumeAt =
+      previous !== undefined && previous.running && jobStatus !== undefined
+        ? previous.buffer.length
+        : 0;
+    let buffer: BuildLogBuffer;
+    if (previous !== undefined && resumeAt > 0) {
+      clearTimeout(previous.deletionTimeout);
+      buffer = previous.buffer;
+    } else {
+      if (previous !== undefined) {
+        this.deleteLogFromMap(uri);
+      }
+      buffer = new BuildLogBuffer();
+    }
+
+    const entry: PkgBuildLog = {
+      buffer,
+      running: jobStatus !== undefined,
+      // keep logs of builds that are silent for a while
+      deletionTimeout: setTimeout(() => {
+        if (entry.fetch !== undefined) {
+          entry.deletionTimeout.refresh();
+        } else {
+          this.deleteLogFromMap(uri);
         }
-      } else {
-        this.logMap.set(BuildLogDisplay.getKeyFromUri(uri), {
-          log: "",
-          running: true,
-          deletionTimeout: setTimeout(
-            this.deletionCallback,
-            300 * 1000,
-            uri,
-            this
-          )
-        });
-        let log = "";
-        fetchBuildLog(
-          con,
-          pkgRepoArch,
-          pkgRepoArch.arch,
-          pkgRepoArch.repository,
-          {
-            noStream: false,
-            multibuildName,
-            streamCallback: function (this: BuildLogDisplay, logChunk) {
-              if (!token?.isCancellationRequested) {
-                log = log.concat(logChunk.toString());
-
-                const key = BuildLogDisplay.getKeyFromUri(uri);
-                const deletionTimeout = this.logMap.get(key)!.deletionTimeout;
-                deletionTimeout.refresh();
-                this.logMap.set(key, {
-                  log,
-                  running: true,
-                  deletionTimeout
-                });
-                this.onDidChangeEmitter.fire(uri);
-              }
-            },
-            streamCallbackThisArg: this
-          }
-        )
-          .then((log) => {
-            this.setFinishedLogInMap(uri, log);
-          })
-          .catch((reason) => {
-            this.logger.error(
-              "Fetching the build log of %s/%s for the repository %s & architecture %s asynchronously failed with %s",
-              pkgRepoArch.projectName,
-              pkgRepoArch.name,
-              pkgRepoArch.repository,
-              pkgRepoArch.arch,
-              reason
+      }, LOG_RETENTION_MS)
+    };
+    this.logMap.set(key, entry);
+    entry.fetch = this.streamLog(con, uri, entry, resumeAt);
+  }
+
+  /**
+   * Fetch the build log of `uri` into `entry.buffer`, starting at the byte
+   * offset `resumeAt`.
+   */
+  private async streamLog(
+    con: Connection,
+    uri: vscode.Uri,
+    entry: PkgBuildLog,
+    resumeAt: number
+  ): Promise<void> {
+    const pkgRepoArch = BuildLogDisplay.uriToPkgRepoArch(uri);
+    // fetchBuildLog always starts at the beginning of the log, so drop
+    // everything that we have already received
+    let received = 0;
+    const fetchLog = (): Promise<unknown> =>
+      fetchBuildLog(
+        con,
+        pkgRepoArch,
+        pkgRepoArch.arch,
+        pkgRepoArch.repository,
+        {
+          noStream: false,
+          multibuildName: pkgRepoArch.multibuildName,
+          streamCallback: (logChunk) => {
+            const chunk = Buffer.isBuffer(logChunk)
+              ? logChunk
+              : Buffer.from(logChunk);
+            const skip = Math.min(
+              Math.max(resumeAt - received, 0),
+              chunk.length
             );
-          });
-      }
+            received += chunk.length;
+            if (skip < chunk.length) {
+              entry.buffer.append(chunk.slice(skip));
+              entry.deletionTimeout.refresh();
+              this.scheduleChange(uri);
+            }
+          }
+        }
+      );
+    try {
+      // the log of a running build is streamed until the build finishes,
+      // which would block a request slot for an unbounded time
+      await (entry.running
+        ? fetchLog()
+        : this.requestScheduler.run(pkgRepoArch.apiUrl, fetchLog));
+      entry.running = false;
+      entry.finishedTime = new Date();
+    } catch (err) {
+      this.logger.error(
+        "Fetching the build log of %s/%s for the repository %s & architecture %s asynchronously failed with %s",
+        pkgRepoArch.projectName,
+        pkgRepoArch.name,
+        pkgRepoArch.repository,
+        pkgRepoArch.arch,
+        err
+      );
     }
+    entry.fetch = undefined;
+    this.scheduleChange(uri);
   }
 
   @logAndReportExceptions(true)
@@ -564,11 +645,16 @@ export class BuildLogDisplay
       let arch: Arch | undefined = undefined;
       let multibuildName: string | undefined = undefined;
 
-      const buildRes = await fetchBuildResults(con, pkg.projectName, {
-        packages: [pkg],
-        views: [BuildStatusView.Status],
-        multiBuild: true
-      });
+      const buildRes = await this.requestScheduler.run(
+        pkg.apiUrl,
+        () =>
+          fetchBuildResults(con, pkg.projectName, {
+            packages: [pkg],
+            views: [BuildStatusView.Status],
+            multiBuild: true
+          }),
+        `buildStatus/${pkg.projectName}/${pkg.name}`
+      );
 
       if (buildRes.length === 0) {
         throw new Error(
@@ -709,7 +795,8 @@ export class BuildStatusDisplay
     accountManager: AccountManager,
     logger: IVSCodeExtLogger,
     private readonly fileMap = new Map<string, PackageBuildDisplay>(),
-    private readonly vscodeWindow: VscodeWindow = vscode.window
+    private readonly vscodeWindow: VscodeWindow = vscode.window,
+    private readonly requestScheduler = new RequestScheduler()
   ) {
     super(accountManager, logger);
 
@@ -762,11 +849,16 @@ export class BuildStatusDisplay
           `cannot show the build results of the package ${pkg.name} because there is no account available for the API ${pkg.apiUrl}`
         );
       }
-      const buildResultsPromise = fetchBuildResults(con, pkg.projectName, {
-        packages: [pkg],
-        views: [BuildStatusView.Status, BuildStatusView.BinaryList],
-        multiBuild: true
-      });
+      const buildResultsPromise = this.requestScheduler.run(
+        pkg.apiUrl,
+        () =>
+          fetchBuildResults(con, pkg.projectName, {
+            packages: [pkg],
+            views: [BuildStatusView.Status, BuildStatusView.BinaryList],
+            multiBuild: true
+          }),
+        `buildResults/${BuildStatusDisplay.uriToKey(uri)}`
+      );
 
       if (!uriInMap) {
         const buildResults = await buildResultsPromise;
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { promises as fsPromises } from "fs";
+import { rmRf } from "open-build-service-api";
+import { tmpdir } from "os";
+import { join } from "path";
+
+/** Default size of the part of a build log that is kept in memory */
+export const DEFAULT_IN_MEMORY_LOG_SIZE = 4 * 1024 * 1024;
+
+/**
+ * Storage for a build log that is received in chunks.
+ *
+ * Only the newest `maxInMemoryBytes` of the log are kept in memory, everything
+ * older is appended to a file in a temporary directory, so that the memory
+ * consumption stays bounded even for logs of hundreds of MB.
+ */
+export class BuildLogBuffer {
+  /** the newest chunks of the log */
+  private chunks: Buffer[] = [];
+  private inMemoryBytes = 0;
+
+  /** Number of bytes of the log that were moved to [[swapFile]] */
+  public swappedBytes = 0;
+
+  /** Path to the file with the older part of the log, if there is one */
+  public swapFile: string | undefined;
+
+  /** The first error that occurred while writing to [[swapFile]] */
+  public swapError: Error | undefined;
+
+  /** all writes to the swap file, in the order in which they were issued */
+  private swapWrites: Promise<void> = Promise.resolve();
+
+  private swapDir: string | undefined;
+
+  constructor(
+    private readonly maxInMemoryBytes: number = DEFAULT_IN_MEMORY_LOG_SIZE,
+    private readonly tmpPrefix: string = join(tmpdir(), "vscode-obs-log-")
+  ) {}
+
+  /** Total number of bytes of the log that have been received */
+  public get length(): number {
+    return this.swappedBytes + this.inMemoryBytes;
+  }
+
+  /**
+   * Append the next chunk of the log and move the oldest chunks to the swap
+   * file if the in memory part grows too large.
+   */
+  public append(chunk: Buffer): void {
+    if (chunk.length === 0) {
+      return;
+    }
+    this.chunks.push(chunk);
+    this.inMemoryBytes += chunk.length;
+
+    const toSwap: Buffer[] = [];
+    // keep at least the newest chunk, even if it is larger than the limit
+    while (
+      this.inMemoryBytes > this.maxInMemoryBytes &&
+      this.chunks.length > 1
+    ) {
+      const oldest = this.chunks.shift()!;
+      this.inMemoryBytes -= oldest.length;
+      this.swappedBytes += oldest.length;
+      toSwap.push(oldest);
+    }
+    if (toSwap.length > 0) {
+      const data = Buffer.concat(toSwap);
+      this.swapWrites = this.swapWrites.then(() => this.writeToSwap(data));
+    }
+  }
+
+  /** The part of the log that is still in memory, decoded as UTF-8 */
+  public tail(): string {
+    const data = Buffer.concat(this.chunks, this.inMemoryBytes);
+    if (this.swappedBytes === 0) {
+      return data.toString();
+    }
+    // the oldest chunk in memory can start in the middle of a multibyte
+    // character, skip its continuation bytes
+    let start = 0;
+    while (start < data.length && (data[start] & 0xc0) === 0x80) {
+      start++;
+    }
+    return data.toString("utf8", start);
+  }
+
+  /** Resolves once everything that was swapped out has been written. */
+  public flush(): Promise<void> {
+    return this.swapWrites;
+  }
+
+  /** Drops the in memory part of the log and removes the swap file. */
+  public async dispose(): Promise<void> {
+    this.chunks = [];
+    this.inMemoryBytes = 0;
+    await this.flush();
+    if (this.swapDir !== undefined) {
+      await rmRf(this.swapDir);
+      this.swapDir = undefined;
+      this.swapFile = undefined;
+    }
+  }
+
+  private async writeToSwap(data: Buffer): Promise<void> {
+    // once a write failed, the swap file has a hole and further writes to it
+    // are pointless
+    if (this.swapError !== undefined) {
+      return;
+    }
+    try {
+      if (this.swapFile === undefined) {
+        this.swapDir = await fsPromises.mkdtemp(this.tmpPrefix);
+        this.swapFile = join(this.swapDir, "_log");
+      }
+      await fsPromises.appendFile(this.swapFile, data);
+    } catch (err) {
+      this.swapError = err;
+    }
+  }
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import * as vscode from "vscode";
+
+interface PendingRun {
+  timer: NodeJS.Timeout;
+  /** callbacks of everyone who scheduled this run */
+  waiters: { resolve: () => void; reject: (err: any) => void }[];
+}
+
+/**
+ * Coalesces bursts of requests to run a task for the same key.
+ *
+ * The task is run once `delayMs` have passed without a new request for its
+ * key. If a task for the key is still in progress at that point, then its
+ * cancellation token is triggered, as its result is superseded by the new run.
+ */
+export class CoalescingScheduler<K> implements vscode.Disposable {
+  private readonly pending = new Map<K, PendingRun>();
+
+  private readonly running = new Map<K, vscode.CancellationTokenSource>();
+
+  constructor(
+    private readonly delayMs: number,
+    private readonly task: (
+      key: K,
+      token: vscode.CancellationToken
+    ) => Promise<void>
+  ) {}
+
+  /**
+   * Request a run of the task for `key`.
+   *
+   * @return A promise that resolves once the run that handles this request
+   *     has finished or rejects with the error that the task threw.
+   */
+  public schedule(key: K): Promise<void> {
+    return new Promise((resolve, reject) => {
+      const pendingRun = this.pending.get(key);
+      const timer = setTimeout(() => {
+        // run() reports errors via the waiters
+        void this.run(key);
+      }, this.delayMs);
+      if (pendingRun === undefined) {
+        this.pending.set(key, { timer, waiters: [{ resolve, reject }] });
+      } else {
+        clearTimeout(pendingRun.timer);
+        pendingRun.timer = timer;
+        pendingRun.waiters.push({ resolve, reject });
+      }
+    });
+  }
+
+  /** Drop all pending runs and cancel the ones that are in progress. */
+  public dispose(): void {
+    for (const { timer, waiters } of this.pending.values()) {
+      clearTimeout(timer);
+      waiters.forEach(({ resolve }) => resolve());
+    }
+    this.pending.clear();
+    for (const tokenSource of this.running.values()) {
+      tokenSource.cancel();
+    }
+    this.running.clear();
+  }
+
+  private async run(key: K): Promise<void> {
+    const pendingRun = this.pending.get(key);
+    if (pendingRun === undefined) {
+      return;
+    }
+    this.pending.delete(key);
+
+    this.running.get(key)?.cancel();
+    const tokenSource = new vscode.CancellationTokenSource();
+    this.running.set(key, tokenSource);
+
+    try {
+      await this.task(key, tokenSource.token);
+      pendingRun.waiters.forEach(({ resolve }) => resolve());
+    } catch (err) {
+      pendingRun.waiters.forEach(({ reject }) => reject(err));
+    } finally {
+      if (this.running.get(key) === tokenSource) {
+        this.running.delete(key);
+      }
+      tokenSource.dispose();
+    }
+  }
+}
@@ -44,6 +44,7 @@ import {
   PackageBookmark,
   ProjectBookmark
 } from "./bookmarks";
+import { CoalescingScheduler } from "./coalescing-scheduler";
 import { debounce } from "./decorators";
 import {
   DEFAULT_OBS_FETCHERS,
@@ -65,6 +66,12 @@ import { getPkgPathFromVcsUri } from "./vcs";
 
 export const EDITOR_CHANGE_DELAY_MS = 100;
 
+/**
+ * Time in which file system events of the same package or project are
+ * coalesced into a single reload.
+ */
+export const WATCHER_EVENT_DELAY_MS = 100;
+
 /** Currently active project of the current text editor window. */
 export interface CurrentPackage {
   /**
@@ -288,6 +295,24 @@ export class CurrentPackageWatcherImpl
 
   private onDidChangeCurrentPackageEmitter = new vscode.EventEmitter<CurrentPackage>();
 
+  /** Reloads of local packages, keyed by the package's path */
+  private readonly packageReloads = new CoalescingScheduler<string>(
+    WATCHER_EVENT_DELAY_MS,
+    (pkgPath, token) => this.reloadLocalPackage(pkgPath, token)
+  );
+
+  /** Reloads of checked out projects, keyed by the project's path */
+  private readonly projectReloads = new CoalescingScheduler<string>(
+    WATCHER_EVENT_DELAY_MS,
+    (projKey, token) => this.reloadWatchedProject(projKey, token)
+  );
+
+  /**
+   * Incremented on each change of the active editor, so that the results of
+   * changes that have been superseded are dropped.
+   */
+  private activeEditorGeneration = 0;
+
   private constructor(
     accountManager: AccountManager,
     logger: IVSCodeExtLogger,
@@ -300,6 +325,8 @@ export class CurrentPackageWatcherImpl
     this.onDidChangeCurrentPackage = this.onDidChangeCurrentPackageEmitter.event;
     this.disposables.push(
       this.onDidChangeCurrentPackageEmitter,
+      this.packageReloads,
+      this.projectReloads,
       this.vscodeWindow.onDidChangeActiveTextEditor(
         this.onActiveEditorChange,
         this
@@ -530,12 +557,18 @@ export class CurrentPackageWatcherImpl
       );
       return;
     }
-    const projKey = fsPath.substring(0, dotOscIndex);
+    // `osc up` touches a lot of files in .osc, only reload once afterwards
+    return this.projectReloads.schedule(fsPath.substring(0, dotOscIndex));
+  }
+
+  private async reloadWatchedProject(
+    projKey: string,
+    token: vscode.CancellationToken
+  ): Promise<void> {
     const watchedProj = this.watchedProjects.get(projKey);
     if (watchedProj === undefined) {
       this.logger.error(
-        "Could not find a watched project for the uri %s and the key %s",
-        uri,
+        "Could not find a watched project for the key %s",
         projKey
       );
       return;
@@ -549,6 +582,9 @@ export class CurrentPackageWatcherImpl
         );
       }
       const project = await readInAndUpdateCheckedoutProject(con, projKey);
+      if (token.isCancellationRequested) {
+        return;
+      }
       this.watchedProjects.set(projKey, { project, watcher, con });
       if (this._currentPackage.currentProject !== undefined) {
         const isCur = isCheckedOutProject(this._currentPackage.currentProject)
@@ -561,6 +597,9 @@ export class CurrentPackageWatcherImpl
         }
       }
     } catch (err) {
+      if (token.isCancellationRequested) {
+        return;
+      }
       this.logger.error(
         "Tried to read in the project from %s, but got the error %s",
         projKey,
@@ -589,9 +628,7 @@ export class CurrentPackageWatcherImpl
       dotOscIndex === -1 ? dirname(fsPath) : fsPath.substring(0, dotOscIndex)
     );
 
-    const localPkg = this.localPackages.get(pkgPath);
-
-    if (localPkg === undefined) {
+    if (!this.localPackages.has(pkgPath)) {
       this.logger.trace(
         "A package watcher got triggered on the uri %s, but no package is registered under this location.",
         uri
@@ -599,6 +636,24 @@ export class CurrentPackageWatcherImpl
       return;
     }
 
+    // operations like `osc up` fire hundreds of events, read the package in
+    // only once they are done
+    return this.packageReloads.schedule(pkgPath);
+  }
+
+  private async reloadLocalPackage(
+    pkgPath: string,
+    token: vscode.CancellationToken
+  ): Promise<void> {
+    const localPkg = this.localPackages.get(pkgPath);
+    if (localPkg === undefined) {
+      this.logger.trace(
+        "The package in %s got removed before it could be reloaded",
+        pkgPath
+      );
+      return;
+    }
+
     this.logger.trace(
       "Found the already checked out package %s",
       localPkg.pkg.name
@@ -606,6 +661,9 @@ export class CurrentPackageWatcherImpl
 
     try {
       const pkg = await readInModifiedPackageFromDir(pkgPath);
+      if (token.isCancellationRequested) {
+        return;
+      }
       const { project, projectCheckedOut, packageWatcher } = localPkg;
       this.localPackages.set(pkgPath, {
         pkg,
@@ -628,9 +686,12 @@ export class CurrentPackageWatcherImpl
         });
       }
     } catch (err) {
+      if (token.isCancellationRequested) {
+        return;
+      }
       this.logger.error(
         "Tried reading in a package from %s, but got the following error: %s",
-        fsPath,
+        pkgPath,
         (err as Error).toString()
       );
       this.localPackages.get(pkgPath)?.packageWatcher.dispose();
@@ -657,6 +718,17 @@ export class CurrentPackageWatcherImpl
 
     const currentFilename =
       editor !== undefined ? basename(editor.document.fileName) : undefined;
+    const generation = ++this.activeEditorGeneration;
+    const superseded = (): boolean => {
+      if (generation === this.activeEditorGeneration) {
+        return false;
+      }
+      this.logger.trace(
+        "Dropping the result for '%s', the active editor changed again",
+        editor?.document.fileName ?? "undefined"
+      );
+      return true;
+    };
 
     try {
       const newCurPkg = await (async (): Promise<CurrentPackage> => {
@@ -740,8 +812,13 @@ export class CurrentPackageWatcherImpl
         }
         return EMPTY_CURRENT_PACKAGE;
       })();
-      this.fireCurrentPackageEvent(newCurPkg);
+      if (!superseded()) {
+        this.fireCurrentPackageEvent(newCurPkg);
+      }
     } catch (err) {
+      if (superseded()) {
+        return;
+      }
       this.logger.error(
         "Changing the active editor to '%s' resulted in the following error: %s",
         editor?.document.fileName ?? "undefined",
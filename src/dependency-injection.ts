@@ -25,6 +25,7 @@ import {
   checkOutPackage,
   checkOutProject,
   fetchFileContents,
+  fetchHistory,
   fetchPackage,
   fetchProject,
   fetchServerCaCertificate,
@@ -63,8 +64,13 @@ export interface VscodeWorkspace {
   textDocuments: typeof vscode.workspace.textDocuments;
 }
 
+export interface VscodeScm {
+  createSourceControl: typeof vscode.scm.createSourceControl;
+}
+
 export interface ObsFetchers {
   readonly fetchFileContents: typeof fetchFileContents;
+  readonly fetchHistory: typeof fetchHistory;
   readonly fetchPackage: typeof fetchPackage;
   readonly fetchProject: typeof fetchProject;
   readonly branchPackage: typeof branchPackage;
@@ -80,6 +86,7 @@ export interface ObsFetchers {
 export const DEFAULT_OBS_FETCHERS: ObsFetchers = {
   fetchProject,
   fetchFileContents,
+  fetchHistory,
   fetchPackage,
   branchPackage,
   readInUnifiedPackage,
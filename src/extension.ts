@@ -34,6 +34,7 @@ import { OscBuildTaskProvider } from "./osc-build-task";
 import { RemotePackageFileContentProvider } from "./package-file-contents";
 import { ProjectBookmarkManager } from "./project-bookmarks";
 import { RepositoryTreeProvider } from "./repository";
+import { RequestScheduler } from "./request-scheduler";
 import { PackageScmHistoryTree } from "./scm-history";
 import { PackageScm } from "./vcs";
 
@@ -71,6 +72,12 @@ export async function activate(
     }
   );
 
+  bookmarkedProjectsTree.onDidCollapseElement(
+    ({ element }) => bookmarkedProjectsTreeProvider.onDidCollapseElement(element),
+    undefined,
+    context.subscriptions
+  );
+
   const currentProjectTreeProvider = new CurrentProjectTreeProvider(
     currentPackageWatcher,
     accountManager,
@@ -111,6 +118,9 @@ export async function activate(
     { showCollapseAll, treeDataProvider: packageScmHistoryTreeProvider }
   );
 
+  // shared by the build views, so that the request limit applies to both
+  const requestScheduler = new RequestScheduler();
+
   const pkgFileProv = new RemotePackageFileContentProvider(
     accountManager,
     logger
@@ -129,8 +139,14 @@ export async function activate(
     new EmptyDocumentForDiffProvider(),
     new CheckOutHandler(accountManager, logger),
     new ErrorPageDocumentProvider(logger),
-    new BuildStatusDisplay(accountManager, logger),
-    new BuildLogDisplay(accountManager, logger)
+    new BuildStatusDisplay(
+      accountManager,
+      logger,
+      undefined,
+      vscode.window,
+      requestScheduler
+    ),
+    new BuildLogDisplay(accountManager, logger, vscode.window, requestScheduler)
   );
   if (oscBuildTaskProvider !== undefined) {
     context.subscriptions.push(oscBuildTaskProvider);
@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { promises as fsPromises } from "fs";
+
+/** The size of the test setup, configurable via environment variables */
+export interface PerfParameters {
+  /** number of configured accounts (`PERF_ACCOUNTS`) */
+  readonly accounts: number;
+  /** number of bookmarked projects (`PERF_BOOKMARKS`) */
+  readonly bookmarks: number;
+  /** number of packages per bookmarked project (`PERF_PACKAGES`) */
+  readonly packages: number;
+  /** number of samples per measurement (`PERF_ITERATIONS`) */
+  readonly iterations: number;
+}
+
+function positiveIntFromEnv(name: string, defaultValue: number): number {
+  const value = process.env[name];
+  if (value === undefined) {
+    return defaultValue;
+  }
+  const parsed = parseInt(value, 10);
+  if (isNaN(parsed) || parsed < 1) {
+    throw new Error(`${name} must be a positive integer, but got '${value}'`);
+  }
+  return parsed;
+}
+
+export function perfParameters(): PerfParameters {
+  return {
+    accounts: positiveIntFromEnv("PERF_ACCOUNTS", 10),
+    bookmarks: positiveIntFromEnv("PERF_BOOKMARKS", 3),
+    packages: positiveIntFromEnv("PERF_PACKAGES", 50),
+    iterations: positiveIntFromEnv("PERF_ITERATIONS", 10)
+  };
+}
+
+/** Summary of the samples of one measurement, all times in milliseconds */
+export interface PerfResult {
+  readonly samples: number;
+  readonly minMs: number;
+  readonly medianMs: number;
+  readonly p90Ms: number;
+  readonly maxMs: number;
+  readonly meanMs: number;
+}
+
+/**
+ * Collects the timings of the perf suite, so that they can be written into a
+ * report that is compared against a baseline.
+ */
+export class PerfReport {
+  public readonly results: { [name: string]: PerfResult } = {};
+
+  /** Measurements that could not be run together with the reason */
+  public readonly skipped: { [name: string]: string } = {};
+
+  /** Add the `samples` (in milliseconds) of the measurement `name` */
+  public record(name: string, samples: number[]): void {
+    if (samples.length === 0) {
+      return;
+    }
+    const sorted = [...samples].sort((a, b) => a - b);
+    const at = (fraction: number): number =>
+      sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * fraction))];
+    this.results[name] = {
+      samples: sorted.length,
+      minMs: sorted[0],
+      medianMs: at(0.5),
+      p90Ms: at(0.9),
+      maxMs: sorted[sorted.length - 1],
+      meanMs: sorted.reduce((sum, s) => sum + s, 0) / sorted.length
+    };
+  }
+
+  /**
+   * Run `fn` `iterations` times and record how long each run took.
+   *
+   * `setUp` and `tearDown` are invoked before respectively after each run and
+   * are not included in the timing.
+   */
+  public async measure<T>(
+    name: string,
+    iterations: number,
+    fn: (iteration: number) => Promise<T>,
+    {
+      setUp,
+      tearDown
+    }: {
+      setUp?: (iteration: number) => Promise<void>;
+      tearDown?: (result: T, iteration: number) => Promise<void>;
+    } = {}
+  ): Promise<void> {
+    const samples: number[] = [];
+    for (let i = 0; i < iterations; i++) {
+      if (setUp !== undefined) {
+        await setUp(i);
+      }
+      const start = process.hrtime.bigint();
+      const result = await fn(i);
+      samples.push(Number(process.hrtime.bigint() - start) / 1e6);
+      if (tearDown !== undefined) {
+        await tearDown(result, i);
+      }
+    }
+    this.record(name, samples);
+  }
+
+  public skip(name: string, reason: string): void {
+    this.skipped[name] = reason;
+  }
+
+  public async write(
+    path: string,
+    extraInfo: { [key: string]: unknown } = {}
+  ): Promise<void> {
+    await fsPromises.writeFile(
+      path,
+      JSON.stringify(
+        {
+          date: new Date().toISOString(),
+          ...extraInfo,
+          parameters: perfParameters(),
+          results: this.results,
+          skipped: this.skipped
+        },
+        undefined,
+        2
+      )
+    );
+  }
+}
+
+/** The report into which all perf tests record their results */
+export const perfReport = new PerfReport();
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs the performance tests in a VSCode instance with a fresh HOME and user
+ * data directory, using mocklibsecret as the OS keyring.
+ *
+ * The tests expect the OBS instance from start-mini-obs.sh to be running.
+ */
+
+import { promises as fsPromises } from "fs";
+import { normalizeUrl } from "open-build-service-api";
+import { tmpdir, userInfo } from "os";
+import * as path from "path";
+import { runTests } from "vscode-test";
+import { testUser } from "../ui-tests/testEnv";
+import { perfParameters } from "./perf";
+
+/**
+ * API URLs of the configured accounts: all of them point to the same OBS
+ * instance via different loopback addresses, as the accounts are identified by
+ * their URL.
+ */
+function perfApiUrls(accounts: number): string[] {
+  const url = new URL(testUser.apiUrl);
+  return [...Array(accounts).keys()].map((i) => {
+    if (i === 0) {
+      return testUser.apiUrl;
+    }
+    url.hostname = `127.0.0.${i + 1}`;
+    return normalizeUrl(url.toString());
+  });
+}
+
+async function setUpHome(home: string, userDataDir: string): Promise<void> {
+  const apiUrls = perfApiUrls(perfParameters().accounts);
+
+  // the service name and the setting keys are copied from accounts.ts, which
+  // cannot be imported here, as it requires vscode
+  await fsPromises.writeFile(
+    path.join(home, "passwords.ini"),
+    "[vscode-obs.accounts]\n".concat(
+      ...apiUrls.map((apiUrl) => `${apiUrl} = ${testUser.password}\n`)
+    )
+  );
+
+  const settingsDir = path.join(userDataDir, "User");
+  await fsPromises.mkdir(settingsDir, { recursive: true });
+  await fsPromises.writeFile(
+    path.join(settingsDir, "settings.json"),
+    JSON.stringify({
+      "telemetry.enableCrashReporter": false,
+      "telemetry.enableTelemetry": false,
+      "vscode-obs.accounts": apiUrls.map((apiUrl, i) => ({
+        accountName: `${testUser.accountName}${i}`,
+        apiUrl,
+        username: testUser.username
+      })),
+      "vscode-obs.checkUnimportedAccounts": false,
+      "vscode-obs.forceHttps": false,
+      "vscode-obs.logLevel": "error"
+    })
+  );
+}
+
+async function main() {
+  let retval = 0;
+  const extensionDevelopmentPath = path.resolve(__dirname, "../../");
+  const home = await fsPromises.mkdtemp(path.join(tmpdir(), "obs-perf-"));
+
+  try {
+    const userDataDir = path.join(home, "user-data");
+    await setUpHome(home, userDataDir);
+
+    const launchArgs = [
+      "--disable-extensions",
+      "--disable-gpu",
+      `--user-data-dir=${userDataDir}`
+    ];
+    if (userInfo().uid === 0) {
+      launchArgs.push("--no-sandbox");
+    }
+
+    retval = await runTests({
+      extensionDevelopmentPath,
+      extensionTestsPath: path.resolve(__dirname, "./suite/index"),
+      extensionTestsEnv: {
+        HOME: home,
+        LD_PRELOAD: path.join(
+          extensionDevelopmentPath,
+          "mocklibsecret",
+          "build",
+          "libsecret.so"
+        ),
+        PERF_REPORT: path.resolve(
+          process.env.PERF_REPORT ?? "perf-report.json"
+        )
+      },
+      launchArgs,
+      version: process.env.VSCODE_VERSION
+    });
+  } catch (err) {
+    console.error(err);
+    retval = 1;
+  } finally {
+    await fsPromises.rmdir(home, { recursive: true });
+  }
+  process.exit(retval);
+}
+
+if (require.main === module) {
+  main();
+}
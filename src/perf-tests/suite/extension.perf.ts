@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect } from "chai";
+import { promises as fsPromises } from "fs";
+import { after, before, describe, it } from "mocha";
+import {
+  Arch,
+  checkOutPackage,
+  createPackage,
+  createProject,
+  deleteProject,
+  fetchProject,
+  Project,
+  ProjectMeta,
+  setFileContentsAndCommit
+} from "open-build-service-api";
+import { join } from "path";
+import * as vscode from "vscode";
+import { AccountManagerImpl } from "../../accounts";
+import {
+  BookmarkedProjectsTreeProvider,
+  BookmarkedProjectTreeElement,
+  MyBookmarksElement,
+  ObsServerTreeElement
+} from "../../bookmark-tree-view";
+import { BuildLogDisplay } from "../../build-control";
+import { ProjectBookmarkManager } from "../../project-bookmarks";
+import { testLogger } from "../../test/suite/test-utils";
+import { getTmpPrefix, safeRmRf } from "../../test/suite/utilities";
+import { testCon, testUser } from "../../ui-tests/testEnv";
+import { perfParameters, perfReport } from "../perf";
+
+const EXTENSION_ID = "SUSE.open-build-service-connector";
+
+const params = perfParameters();
+
+const projectMeta = (i: number): ProjectMeta => ({
+  description: "Test project for the performance tests of vscode-obs",
+  name: `home:${testUser.username}:vscode_obs_perf_${i}`,
+  title: `Performance test project ${i}`,
+  repository: [
+    {
+      name: "openSUSE_Tumbleweed",
+      path: [{ project: "openSUSE:Factory", repository: "snapshot" }],
+      arch: [Arch.X86_64]
+    }
+  ]
+});
+
+/** Memento that only keeps its values in memory */
+class InMemoryMemento implements vscode.Memento {
+  private readonly values = new Map<string, any>();
+
+  public get<T>(key: string, defaultValue?: T): T | undefined {
+    return this.values.has(key) ? this.values.get(key) : defaultValue;
+  }
+
+  public update(key: string, value: any): Thenable<void> {
+    this.values.set(key, value);
+    return Promise.resolve();
+  }
+}
+
+async function createTestProjects(): Promise<Project[]> {
+  const projects: Project[] = [];
+  for (let i = 0; i < params.bookmarks; i++) {
+    const meta = projectMeta(i);
+    await createProject(testCon, meta);
+    const proj: Project = { apiUrl: testUser.apiUrl, meta, name: meta.name };
+    for (let p = 0; p < params.packages; p++) {
+      await createPackage(
+        testCon,
+        proj,
+        `pkg${p}`,
+        `Package ${p}`,
+        "Package for the performance tests"
+      );
+    }
+    await setFileContentsAndCommit(
+      testCon,
+      {
+        name: "pkg0.spec",
+        packageName: "pkg0",
+        projectName: meta.name,
+        contents: Buffer.from("Name: pkg0\n")
+      },
+      "Add pkg0.spec"
+    );
+    projects.push(proj);
+  }
+  return projects;
+}
+
+describe("Extension performance", function () {
+  let projects: Project[] = [];
+  let tmpDir: string;
+
+  before(async () => {
+    tmpDir = await fsPromises.mkdtemp(join(getTmpPrefix(), "obs-perf"));
+    projects = await createTestProjects();
+  });
+
+  after(async () => {
+    await Promise.all(
+      projects.map((proj) => deleteProject(testCon, proj.name))
+    );
+    await safeRmRf(tmpDir);
+  });
+
+  it(`loads ${params.accounts} accounts`, async () => {
+    await perfReport.measure(
+      "accounts.load",
+      params.iterations,
+      () => AccountManagerImpl.createAccountManager(testLogger),
+      {
+        tearDown: async (mngr) => {
+          expect(mngr.activeAccounts.getAllApis()).to.have.length(
+            params.accounts
+          );
+          mngr.dispose();
+        }
+      }
+    );
+  });
+
+  it(`expands ${params.bookmarks} bookmarked projects`, async () => {
+    const accountManager = await AccountManagerImpl.createAccountManager(
+      testLogger
+    );
+    const globalStorageUri = vscode.Uri.file(join(tmpDir, "globalStorage"));
+    const ctx = {
+      globalState: new InMemoryMemento(),
+      globalStorageUri
+    } as unknown as vscode.ExtensionContext;
+    const bookmarkMngr = await ProjectBookmarkManager.createProjectBookmarkManager(
+      ctx,
+      accountManager,
+      testLogger
+    );
+    const tree = new BookmarkedProjectsTreeProvider(
+      accountManager,
+      bookmarkMngr,
+      testLogger
+    );
+
+    try {
+      for (const proj of projects) {
+        await bookmarkMngr.addProjectToBookmarks(
+          await fetchProject(testCon, proj.name, { fetchPackageList: false })
+        );
+      }
+
+      const servers = (await tree.getChildren(new MyBookmarksElement())) ?? [];
+      const server = servers.find(
+        (elem) =>
+          elem instanceof ObsServerTreeElement &&
+          elem.account.account.apiUrl === testUser.apiUrl
+      );
+      expect(server).to.not.equal(undefined);
+
+      let projectElements: BookmarkedProjectTreeElement[] = [];
+      await perfReport.measure(
+        "bookmarkTree.expandServer",
+        params.iterations,
+        async () => {
+          projectElements = ((await tree.getChildren(server)) ??
+            []) as BookmarkedProjectTreeElement[];
+        }
+      );
+      expect(projectElements).to.have.length(params.bookmarks);
+
+      // the first expansion has to fetch the package list, all following ones
+      // are served from the bookmark cache
+      for (const [name, iterations] of [
+        ["bookmarkTree.expandProject.first", 1],
+        ["bookmarkTree.expandProject", params.iterations]
+      ] as [string, number][]) {
+        await perfReport.measure(name, iterations, () =>
+          Promise.all(projectElements.map((elem) => tree.getChildren(elem)))
+        );
+      }
+    } finally {
+      tree.dispose();
+      bookmarkMngr.dispose();
+      accountManager.dispose();
+      await safeRmRf(globalStorageUri.fsPath);
+    }
+  });
+
+  it("opens build logs", async () => {
+    const accountManager = await AccountManagerImpl.createAccountManager(
+      testLogger
+    );
+    const uri = BuildLogDisplay.pkgRepoArchToUri({
+      apiUrl: testUser.apiUrl,
+      projectName: projects[0].name,
+      name: "pkg0",
+      repository: "openSUSE_Tumbleweed",
+      arch: Arch.X86_64
+    });
+    const tokenSource = new vscode.CancellationTokenSource();
+
+    try {
+      let display: BuildLogDisplay | undefined;
+      // every sample uses a new display, so that the log is not cached
+      await perfReport.measure(
+        "buildLog.open",
+        params.iterations,
+        () => display!.provideTextDocumentContent(uri, tokenSource.token),
+        {
+          setUp: () => {
+            display = new BuildLogDisplay(accountManager, testLogger);
+            return Promise.resolve();
+          },
+          tearDown: () => {
+            display?.dispose();
+            return Promise.resolve();
+          }
+        }
+      );
+    } finally {
+      tokenSource.dispose();
+      accountManager.dispose();
+    }
+  });
+
+  it("checks out packages", async () => {
+    await perfReport.measure(
+      "package.checkOut",
+      params.iterations,
+      (i) =>
+        checkOutPackage(
+          testCon,
+          projects[0].name,
+          "pkg0",
+          join(tmpDir, `checkout${i}`)
+        ),
+      { tearDown: (_res, i) => safeRmRf(join(tmpDir, `checkout${i}`)) }
+    );
+  });
+
+  // activating registers all commands, so this has to run after all the
+  // other tests have disposed their components
+  it("activates the extension", async () => {
+    const ext = vscode.extensions.getExtension(EXTENSION_ID);
+    if (ext === undefined) {
+      perfReport.skip("extension.activate", `${EXTENSION_ID} is not present`);
+      return;
+    }
+    if (ext.isActive) {
+      perfReport.skip("extension.activate", "already activated");
+      return;
+    }
+    await perfReport.measure("extension.activate", 1, () => ext.activate());
+  });
+});
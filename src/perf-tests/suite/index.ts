@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import * as glob from "glob";
+import * as Mocha from "mocha";
+import * as path from "path";
+import * as vscode from "vscode";
+import { perfReport } from "../perf";
+
+export async function run(): Promise<void> {
+  const mocha = new Mocha({
+    ui: "tdd",
+    color: true,
+    // creating the test projects on the OBS instance takes a while
+    timeout: 10 * 60 * 1000
+  });
+
+  const testsRoot = path.resolve(__dirname);
+  // run the perf tests always in the same order, so that reports are comparable
+  for (const file of glob.sync("**/**.perf.js", { cwd: testsRoot }).sort()) {
+    mocha.addFile(path.resolve(testsRoot, file));
+  }
+
+  try {
+    await new Promise((resolve, reject) => {
+      mocha.run((failures) => {
+        failures > 0
+          ? reject(new Error(`${failures} tests failed.`))
+          : resolve(undefined);
+      });
+    });
+  } finally {
+    const reportPath = process.env.PERF_REPORT ?? "perf-report.json";
+    await perfReport.write(reportPath, { vscodeVersion: vscode.version });
+    console.log(`Wrote the performance report to ${reportPath}`);
+  }
+}
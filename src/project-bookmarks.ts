@@ -20,6 +20,7 @@
  */
 
 import { IVSCodeExtLogger } from "@vscode-logging/logger";
+import { createHash } from "crypto";
 import { promises as fsPromises } from "fs";
 import {
   ModifiedPackage,
@@ -27,7 +28,8 @@ import {
   PackageFile,
   pathExists,
   PathType,
-  Project
+  Project,
+  rmRf
 } from "open-build-service-api";
 import { join } from "path";
 import { inspect } from "util";
@@ -62,6 +64,11 @@ import {
 
 const projectBookmarkStorageKey: string = "vscodeObs.ProjectTree.Projects";
 
+/** Hexadecimal md5 hash of `data`, like OBS reports it for files */
+function md5(data: Buffer): string {
+  return createHash("md5").update(data).digest("hex");
+}
+
 const cmdId = "ProjectBookmarks";
 
 /**
@@ -197,39 +204,77 @@ class UpdateEvent implements BookmarkUpdate {
   }
 }
 
+/**
+ * The cached projects of one API, serialized to JSON and ordered by the time
+ * of their last use (least recently used first).
+ */
+type CachedProjects = Map<string, string>;
+
+/** Upper limit of the size of the serialized cached projects of one API */
+export const MAX_CACHED_PROJECT_BYTES_PER_API = 16 * 1024 * 1024;
+
+/** Time after which modifications of the cache are written to disk */
+const CACHE_FLUSH_DELAY_MS = 1000;
+
 class MetadataCache extends ConnectionListenerLoggerBase {
   public static async createMetadataCache(
     extensionContext: vscode.ExtensionContext,
     accountManager: AccountManager,
     logger: IVSCodeExtLogger,
     initialProjects = new Map<ApiUrl, ProjectBookmark[]>(),
-    obsFetchers: ObsFetchers = DEFAULT_OBS_FETCHERS
+    obsFetchers: ObsFetchers = DEFAULT_OBS_FETCHERS,
+    maxBytesPerApi: number = MAX_CACHED_PROJECT_BYTES_PER_API
   ): Promise<MetadataCache> {
     const cache = new MetadataCache(
       extensionContext,
       accountManager,
       logger,
-      obsFetchers
+      obsFetchers,
+      maxBytesPerApi
     );
     await fsPromises.mkdir(cache.baseStoragePath, { recursive: true });
 
-    await Promise.all(
-      [...initialProjects.values()].map((bookmarks) =>
-        Promise.all(bookmarks.map((b) => cache.saveProject(b)))
-      )
-    );
+    // this only modifies the in memory copy, so we end up with one write per
+    // API and not one per bookmark
+    for (const bookmarks of initialProjects.values()) {
+      for (const bookmark of bookmarks) {
+        await cache.saveProject(bookmark);
+      }
+    }
     return cache;
   }
 
-  private static readonly PROJECT_STORAGE_FILE = "project.json";
+  /** Name of the file in which the projects of one API are stored */
+  private static readonly API_STORAGE_FILE = "projects.json";
+
+  /**
+   * Name of the file in which projects were stored by previous versions,
+   * one per project.
+   */
+  private static readonly LEGACY_PROJECT_STORAGE_FILE = "project.json";
 
   private readonly baseStoragePath: string;
 
+  /** The cached projects of every API, once they have been loaded */
+  private readonly projects = new Map<ApiUrl, Promise<CachedProjects>>();
+
+  /** Size of the serialized projects of every loaded API in bytes */
+  private readonly cachedBytes = new Map<ApiUrl, number>();
+
+  /** APIs whose projects have been modified since they were last written */
+  private readonly dirtyApis = new Set<ApiUrl>();
+
+  private flushTimer: NodeJS.Timeout | undefined;
+
+  /** the write of the dirty APIs that has been issued last */
+  private lastFlush: Promise<void> = Promise.resolve();
+
   private constructor(
     extensionContext: vscode.ExtensionContext,
     accountManager: AccountManager,
     logger: IVSCodeExtLogger,
-    private readonly obsFetchers: ObsFetchers
+    private readonly obsFetchers: ObsFetchers,
+    private readonly maxBytesPerApi: number
   ) {
     super(accountManager, logger);
     this.baseStoragePath = join(
@@ -249,6 +294,33 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     );
   }
 
+  public dispose(): void {
+    // write everything that is still pending
+    this.flush().catch((err) => {
+      this.logger.error(
+        "Writing the project cache failed with %s",
+        (err as Error).toString()
+      );
+    });
+    super.dispose();
+  }
+
+  /**
+   * Write the projects of all APIs that were modified since the last flush to
+   * disk.
+   *
+   * Flushes are serialized, the returned promise resolves once this one is
+   * done.
+   */
+  public flush(): Promise<void> {
+    if (this.flushTimer !== undefined) {
+      clearTimeout(this.flushTimer);
+      this.flushTimer = undefined;
+    }
+    this.lastFlush = this.lastFlush.then(() => this.writeDirtyApis());
+    return this.lastFlush;
+  }
+
   // public async addPackageFile(
   //   pkgFile: PackageFile,
   //   pkg: Package
@@ -285,9 +357,25 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     const file: PackageFile =
       pkg.files?.find((f) => f.name === pkgFile.name) ?? pkgFile;
 
+    // the cached contents are only valid if they match the md5 hash from the
+    // file list, which has just been refetched if refreshBehavior is Always
+    let contentsRevalidated = false;
     if (await pathExists(fileContentsPath, PathType.File)) {
       try {
-        file.contents = await fsPromises.readFile(fileContentsPath);
+        const contents = await fsPromises.readFile(fileContentsPath);
+        if (file.md5Hash === undefined) {
+          file.contents = contents;
+        } else if (md5(contents) === file.md5Hash) {
+          file.contents = contents;
+          contentsRevalidated = true;
+        } else {
+          this.logger.trace(
+            "Cached contents of %s/%s/%s are outdated",
+            pkgFile.projectName,
+            pkgFile.packageName,
+            pkgFile.name
+          );
+        }
       } catch (err) {
         this.logger.error(
           "Failed to read the file contents from %s",
@@ -298,9 +386,9 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     }
 
     if (
-      refreshBehavior === RefreshBehavior.Always ||
+      (refreshBehavior === RefreshBehavior.Always && !contentsRevalidated) ||
       (file.contents === undefined &&
-        refreshBehavior === RefreshBehavior.FetchWhenMissing)
+        refreshBehavior !== RefreshBehavior.Never)
     ) {
       const account = this.activeAccounts.getConfig(apiUrl);
 
@@ -401,6 +489,9 @@ class MetadataCache extends ConnectionListenerLoggerBase {
           }/${pkg.name}, but got ${inspect(newPkg.files)} instead`
         );
 
+        if (cachedPkg.md5Hash !== newPkg.md5Hash) {
+          await this.removeOutdatedFileContents(cachedPkg, newPkg);
+        }
         if (saveInProject) {
           insertPackageIntoProject(newPkg, proj);
           await this.saveProject(proj);
@@ -424,6 +515,37 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     }
   }
 
+  /**
+   * Remove the cached contents of all files of `cachedPkg` that are no longer
+   * part of `newPkg` or whose contents changed.
+   */
+  private async removeOutdatedFileContents(
+    cachedPkg: Package,
+    newPkg: Package
+  ): Promise<void> {
+    const newHashes = new Map(
+      (newPkg.files ?? []).map((f) => [f.name, f.md5Hash])
+    );
+    const fileContentsDir = join(
+      this.getProjectBasePath({
+        apiUrl: cachedPkg.apiUrl,
+        name: cachedPkg.projectName
+      }),
+      cachedPkg.name
+    );
+    for (const file of cachedPkg.files ?? []) {
+      if (
+        file.md5Hash === undefined ||
+        file.md5Hash !== newHashes.get(file.name)
+      ) {
+        const fileContentsPath = join(fileContentsDir, file.name);
+        if ((await pathExists(fileContentsPath, PathType.File)) !== undefined) {
+          await this.unlinkFile(fileContentsPath);
+        }
+      }
+    }
+  }
+
   public async addProject(proj: ProjectBookmark): Promise<void> {
     const projFromCache = await this.getProject(proj, RefreshBehavior.Never);
     const mergedProject = { ...projFromCache, ...proj };
@@ -435,29 +557,18 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     refreshBehavior: RefreshBehavior = RefreshBehavior.FetchWhenMissing
   ): Promise<ProjectBookmark> {
     let projectFromCache: ProjectBookmark | undefined;
-    let projectJsonContents: string | undefined;
-    const projJson = join(
-      this.getProjectBasePath(proj),
-      MetadataCache.PROJECT_STORAGE_FILE
-    );
-
-    if (await pathExists(projJson, PathType.File)) {
-      try {
-        projectJsonContents = await fsPromises.readFile(projJson, {
-          encoding: "utf8"
-        });
-      } catch (err) {
-        this.logger.error(
-          "Tried to read file %s, but got the error %s",
-          projJson,
-          (err as Error).toString()
-        );
-
-        await this.unlinkFile(projJson);
-      }
-    }
+    const cachedProjects = await this.getCachedProjects(proj.apiUrl);
+    const projectJsonContents = cachedProjects.get(proj.name);
 
     if (projectJsonContents !== undefined) {
+      // this project is now the most recently used one, the order has to be
+      // written to disk too, otherwise it is lost on the next activation
+      const names = [...cachedProjects.keys()];
+      if (names[names.length - 1] !== proj.name) {
+        cachedProjects.delete(proj.name);
+        cachedProjects.set(proj.name, projectJsonContents);
+        this.markDirty(proj.apiUrl);
+      }
       try {
         // FIXME: we should verify that this is actually the correct thing
         projectFromCache = JSON.parse(projectJsonContents);
@@ -468,7 +579,8 @@ class MetadataCache extends ConnectionListenerLoggerBase {
           proj.apiUrl,
           (err as Error).toString()
         );
-        await this.unlinkFile(projJson);
+        this.dropCachedProject(proj.apiUrl, cachedProjects, proj.name);
+        this.markDirty(proj.apiUrl);
       }
     }
 
@@ -632,13 +744,227 @@ class MetadataCache extends ConnectionListenerLoggerBase {
     }
   }
 
+  /**
+   * Put the project into the cache, evicting the least recently used projects
+   * of its API if their serialized size exceeds `maxBytesPerApi`.
+   *
+   * The project itself is always kept, even if it alone is larger than the
+   * limit. It is written to disk with the next flush.
+   */
   private async saveProject(proj: ProjectBookmark): Promise<void> {
-    const basePath = this.getProjectBasePath(proj);
-    await fsPromises.mkdir(basePath, { recursive: true });
-    await fsPromises.writeFile(
-      join(basePath, MetadataCache.PROJECT_STORAGE_FILE),
+    const cachedProjects = await this.getCachedProjects(proj.apiUrl);
+    this.dropCachedProject(proj.apiUrl, cachedProjects, proj.name);
+    this.addCachedProject(
+      proj.apiUrl,
+      cachedProjects,
+      proj.name,
       JSON.stringify(proj)
     );
+
+    for (const name of cachedProjects.keys()) {
+      if (
+        name === proj.name ||
+        this.cachedBytes.get(proj.apiUrl)! <= this.maxBytesPerApi
+      ) {
+        break;
+      }
+      this.logger.trace(
+        "Evicting the project %s from %s from the cache",
+        name,
+        proj.apiUrl
+      );
+      this.dropCachedProject(proj.apiUrl, cachedProjects, name);
+      // the cached file contents go with it
+      const basePath = this.getProjectBasePath({ apiUrl: proj.apiUrl, name });
+      rmRf(basePath).catch((err) => {
+        this.logger.error(
+          "Failed to remove %s due to: %s",
+          basePath,
+          (err as Error).toString()
+        );
+      });
+    }
+    this.markDirty(proj.apiUrl);
+  }
+
+  /** Append the serialized project `json` to the cached projects of `apiUrl` */
+  private addCachedProject(
+    apiUrl: ApiUrl,
+    cachedProjects: CachedProjects,
+    name: string,
+    json: string
+  ): void {
+    cachedProjects.set(name, json);
+    this.cachedBytes.set(
+      apiUrl,
+      (this.cachedBytes.get(apiUrl) ?? 0) + Buffer.byteLength(json)
+    );
+  }
+
+  private dropCachedProject(
+    apiUrl: ApiUrl,
+    cachedProjects: CachedProjects,
+    name: string
+  ): void {
+    const json = cachedProjects.get(name);
+    if (json !== undefined) {
+      this.cachedBytes.set(
+        apiUrl,
+        this.cachedBytes.get(apiUrl)! - Buffer.byteLength(json)
+      );
+      cachedProjects.delete(name);
+    }
+  }
+
+  private markDirty(apiUrl: ApiUrl): void {
+    this.dirtyApis.add(apiUrl);
+    if (this.flushTimer === undefined) {
+      this.flushTimer = setTimeout(() => {
+        this.flushTimer = undefined;
+        this.flush().catch((err) => {
+          this.logger.error(
+            "Writing the project cache failed with %s",
+            (err as Error).toString()
+          );
+        });
+      }, CACHE_FLUSH_DELAY_MS);
+    }
+  }
+
+  /** Returns the projects of the API, loading them from disk on first use. */
+  private getCachedProjects(apiUrl: ApiUrl): Promise<CachedProjects> {
+    let cachedProjects = this.projects.get(apiUrl);
+    if (cachedProjects === undefined) {
+      cachedProjects = this.loadCachedProjects(apiUrl);
+      this.projects.set(apiUrl, cachedProjects);
+    }
+    return cachedProjects;
+  }
+
+  private async loadCachedProjects(apiUrl: ApiUrl): Promise<CachedProjects> {
+    const cachedProjects: CachedProjects = new Map();
+    const apiDir = this.getApiBasePath(apiUrl);
+    const apiJson = join(apiDir, MetadataCache.API_STORAGE_FILE);
+
+    if ((await pathExists(apiJson, PathType.File)) === undefined) {
+      await this.importLegacyProjects(apiUrl, cachedProjects);
+      return cachedProjects;
+    }
+
+    try {
+      const projects: ProjectBookmark[] = JSON.parse(
+        await fsPromises.readFile(apiJson, { encoding: "utf8" })
+      );
+      // keep the projects serialized, they are only decoded when requested
+      projects.forEach((proj) =>
+        this.addCachedProject(
+          apiUrl,
+          cachedProjects,
+          proj.name,
+          JSON.stringify(proj)
+        )
+      );
+    } catch (err) {
+      this.logger.error(
+        "Could not read the cached projects of %s from %s, got the error: %s",
+        apiUrl,
+        apiJson,
+        (err as Error).toString()
+      );
+      await this.unlinkFile(apiJson);
+    }
+    return cachedProjects;
+  }
+
+  /**
+   * Move the projects that were stored one file per project into
+   * `cachedProjects`.
+   */
+  private async importLegacyProjects(
+    apiUrl: ApiUrl,
+    cachedProjects: CachedProjects
+  ): Promise<void> {
+    const apiDir = this.getApiBasePath(apiUrl);
+    if ((await pathExists(apiDir, PathType.Directory)) === undefined) {
+      return;
+    }
+    let projDirs: string[];
+    try {
+      projDirs = await fsPromises.readdir(apiDir);
+    } catch (err) {
+      this.logger.error(
+        "Could not read the directory %s, got the error: %s",
+        apiDir,
+        (err as Error).toString()
+      );
+      return;
+    }
+    for (const projDir of projDirs) {
+      const projJson = join(
+        apiDir,
+        projDir,
+        MetadataCache.LEGACY_PROJECT_STORAGE_FILE
+      );
+      if ((await pathExists(projJson, PathType.File)) === undefined) {
+        continue;
+      }
+      try {
+        const contents = await fsPromises.readFile(projJson, {
+          encoding: "utf8"
+        });
+        const proj: ProjectBookmark = JSON.parse(contents);
+        this.addCachedProject(apiUrl, cachedProjects, proj.name, contents);
+      } catch (err) {
+        this.logger.error(
+          "Could not import the cached project from %s, got the error: %s",
+          projJson,
+          (err as Error).toString()
+        );
+      }
+      await this.unlinkFile(projJson);
+    }
+    if (cachedProjects.size > 0) {
+      this.markDirty(apiUrl);
+    }
+  }
+
+  /** Write the cached projects of all dirty APIs to disk. */
+  private async writeDirtyApis(): Promise<void> {
+    const apiUrls = [...this.dirtyApis.values()];
+    this.dirtyApis.clear();
+
+    await Promise.all(
+      apiUrls.map(async (apiUrl) => {
+        const cachedProjects = await this.getCachedProjects(apiUrl);
+        const apiDir = this.getApiBasePath(apiUrl);
+        const apiJson = join(apiDir, MetadataCache.API_STORAGE_FILE);
+        const tmpJson = `${apiJson}.${process.pid}.tmp`;
+        try {
+          // don't create baseStoragePath, it is only missing if our storage
+          // got removed
+          if ((await pathExists(apiDir, PathType.Directory)) === undefined) {
+            await fsPromises.mkdir(apiDir);
+          }
+          // write a temporary file first, so that a crash cannot leave a
+          // truncated file behind
+          await fsPromises.writeFile(
+            tmpJson,
+            `[${[...cachedProjects.values()].join(",")}]`
+          );
+          await fsPromises.rename(tmpJson, apiJson);
+        } catch (err) {
+          this.logger.error(
+            "Failed to write the cached projects of %s to %s due to: %s",
+            apiUrl,
+            apiJson,
+            (err as Error).toString()
+          );
+          if ((await pathExists(tmpJson, PathType.File)) !== undefined) {
+            await this.unlinkFile(tmpJson);
+          }
+        }
+      })
+    );
   }
 
   /** remove the project.json file with the given file without throwing any exceptions */
@@ -655,7 +981,18 @@ class MetadataCache extends ConnectionListenerLoggerBase {
   }
 
   /**
-   * Returns the path in which the project's metadata will be stored.
+   * Returns the path in which the metadata of the API's projects are stored.
+   *
+   * The api url is encoded as hexadecimal to avoid using any invalid characters
+   * in filenames (e.g. ':' on Windows).
+   */
+  private getApiBasePath(apiUrl: ApiUrl): string {
+    return join(this.baseStoragePath, Buffer.from(apiUrl).toString("hex"));
+  }
+
+  /**
+   * Returns the path in which the contents of the project's files will be
+   * stored.
    *
    * The path is a combination of the project's api url and it's name encoded as
    * hexadecimal to avoid using any invalid characters in filenames (e.g. ':' on
@@ -663,8 +1000,7 @@ class MetadataCache extends ConnectionListenerLoggerBase {
    */
   private getProjectBasePath(proj: BaseProject): string {
     return join(
-      this.baseStoragePath,
-      Buffer.from(proj.apiUrl).toString("hex"),
+      this.getApiBasePath(proj.apiUrl),
       Buffer.from(proj.name).toString("hex")
     );
   }
@@ -775,6 +1111,7 @@ export class ProjectBookmarkManager extends LoggingDisposableBase {
 
   public async dispose(): Promise<void> {
     await this.saveBookmarkedProjects();
+    await this.metadataCache.flush();
     super.dispose();
   }
 
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** Number of requests that are sent to one API at the same time by default */
+export const MAX_CONCURRENT_REQUESTS_PER_API = 4;
+
+interface ApiQueue {
+  /** number of requests to this API that are currently in flight */
+  active: number;
+  /** requests that wait for a free slot */
+  waiting: (() => void)[];
+}
+
+/**
+ * Limits the number of concurrent requests to each API, so that views which
+ * fire off many requests at once do not overwhelm the Open Build Service
+ * instance.
+ *
+ * Requests that are scheduled with the same key while one is still in flight
+ * share the result of the first one.
+ */
+export class RequestScheduler {
+  private readonly queues = new Map<string, ApiQueue>();
+
+  private readonly inFlight = new Map<string, Promise<unknown>>();
+
+  constructor(
+    private readonly maxConcurrentRequests = MAX_CONCURRENT_REQUESTS_PER_API
+  ) {}
+
+  /**
+   * Run `request` once fewer than `maxConcurrentRequests` other requests to
+   * `apiUrl` are in flight.
+   *
+   * @param key  Identifies the request: if a request with the same key and
+   *     API is still pending, then its promise is returned instead of
+   *     scheduling `request`.
+   */
+  public run<T>(
+    apiUrl: string,
+    request: () => Promise<T>,
+    key?: string
+  ): Promise<T> {
+    const fullKey = key === undefined ? undefined : `${apiUrl}/${key}`;
+    if (fullKey !== undefined) {
+      const pending = this.inFlight.get(fullKey);
+      if (pending !== undefined) {
+        return pending as Promise<T>;
+      }
+    }
+
+    const result = this.acquire(apiUrl).then(async () => {
+      try {
+        return await request();
+      } finally {
+        this.release(apiUrl);
+      }
+    });
+
+    if (fullKey !== undefined) {
+      this.inFlight.set(fullKey, result);
+      const forget = (): void => {
+        if (this.inFlight.get(fullKey) === result) {
+          this.inFlight.delete(fullKey);
+        }
+      };
+      result.then(forget, forget);
+    }
+    return result;
+  }
+
+  private acquire(apiUrl: string): Promise<void> {
+    let queue = this.queues.get(apiUrl);
+    if (queue === undefined) {
+      queue = { active: 0, waiting: [] };
+      this.queues.set(apiUrl, queue);
+    }
+    if (queue.active < this.maxConcurrentRequests) {
+      queue.active++;
+      return Promise.resolve();
+    }
+    const q = queue;
+    return new Promise((resolve) => q.waiting.push(resolve));
+  }
+
+  private release(apiUrl: string): void {
+    const queue = this.queues.get(apiUrl);
+    if (queue === undefined) {
+      return;
+    }
+    // hand the slot over directly to the next waiting request
+    const next = queue.waiting.shift();
+    if (next !== undefined) {
+      next();
+    } else if (--queue.active === 0) {
+      this.queues.delete(apiUrl);
+    }
+  }
+}
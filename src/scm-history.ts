@@ -20,12 +20,7 @@
  */
 
 import { IVSCodeExtLogger } from "@vscode-logging/logger";
-import {
-  fetchHistory,
-  ModifiedPackage,
-  Package,
-  Revision
-} from "open-build-service-api";
+import { ModifiedPackage, Package, Revision } from "open-build-service-api";
 import * as vscode from "vscode";
 import { AccountManager } from "./accounts";
 import { assert } from "./assert";
@@ -36,6 +31,7 @@ import {
   CurrentPackageWatcher,
   isModifiedPackage
 } from "./current-package-watcher";
+import { DEFAULT_OBS_FETCHERS, ObsFetchers } from "./dependency-injection";
 
 export class HistoryRootTreeElement extends vscode.TreeItem {
   public contextValue = "historyRoot";
@@ -70,6 +66,24 @@ export class CommitTreeElement extends vscode.TreeItem {
   }
 }
 
+/** Tree element that shows the next page of older revisions on click */
+export class LoadMoreRevisionsTreeElement extends vscode.TreeItem {
+  public contextValue = "loadMoreRevisions";
+
+  public iconPath = new vscode.ThemeIcon("ellipsis");
+
+  constructor(olderRevisions: number) {
+    super(
+      `Show more (${olderRevisions} older revisions)`,
+      vscode.TreeItemCollapsibleState.None
+    );
+    this.command = {
+      command: SHOW_MORE_REVISIONS_COMMAND,
+      title: "Show older revisions"
+    };
+  }
+}
+
 function isCommitTreeElement(elem: vscode.TreeItem): elem is CommitTreeElement {
   return elem.contextValue === "commit";
 }
@@ -80,7 +94,10 @@ function isHistoryRootTreeElement(
   return elem.contextValue === "historyRoot";
 }
 
-type HistoryTreeItem = CommitTreeElement | HistoryRootTreeElement;
+type HistoryTreeItem =
+  | CommitTreeElement
+  | HistoryRootTreeElement
+  | LoadMoreRevisionsTreeElement;
 
 const cmdId = "scmHistory";
 
@@ -94,6 +111,29 @@ export function fsPathFromObsRevisionUri(uri: vscode.Uri): string | undefined {
 
 export const OPEN_COMMIT_DOCUMENT_COMMAND = `${cmdPrefix}.${cmdId}.openCommitDocument`;
 
+export const SHOW_MORE_REVISIONS_COMMAND = `${cmdPrefix}.${cmdId}.showMoreRevisions`;
+
+/** Number of revisions that are shown initially and added by "Show more" */
+export const HISTORY_PAGE_SIZE = 50;
+
+/**
+ * Upper limit of the number of revisions in the cached histories of all
+ * packages, so that a few packages with huge histories cannot take up a lot
+ * of memory. The most recently fetched history is kept regardless.
+ */
+export const MAX_CACHED_REVISIONS = 5000;
+
+/** Time after which a cached history is fetched again */
+const HISTORY_MAX_AGE_MS = 5 * 60 * 1000;
+
+interface CachedHistory {
+  readonly history: readonly Revision[];
+  readonly fetchTime: number;
+}
+
+const historyKey = (pkg: Package): string =>
+  `${pkg.apiUrl}/${pkg.projectName}/${pkg.name}`;
+
 export class PackageScmHistoryTree
   extends ConnectionListenerLoggerBase
   implements
@@ -111,12 +151,14 @@ export class PackageScmHistoryTree
   public static async createPackageScmHistoryTree(
     currentPackageWatcher: CurrentPackageWatcher,
     accountManager: AccountManager,
-    logger: IVSCodeExtLogger
+    logger: IVSCodeExtLogger,
+    obsFetchers: ObsFetchers = DEFAULT_OBS_FETCHERS
   ): Promise<PackageScmHistoryTree> {
     const historyTree = new PackageScmHistoryTree(
       currentPackageWatcher,
       accountManager,
-      logger
+      logger,
+      obsFetchers
     );
     await historyTree.setCurrentPackage(currentPackageWatcher.currentPackage);
     return historyTree;
@@ -131,10 +173,26 @@ export class PackageScmHistoryTree
   private currentPackage: ModifiedPackage | undefined = undefined;
   private currentHistory: readonly Revision[] | undefined = undefined;
 
+  /** Number of the newest revisions of [[currentHistory]] that are shown */
+  private shownRevisions = HISTORY_PAGE_SIZE;
+
+  /**
+   * The histories of the recently shown packages, the most recently used one
+   * is last.
+   */
+  private readonly historyCache = new Map<string, CachedHistory>();
+
+  /** Total number of revisions in [[historyCache]] */
+  private cachedRevisions = 0;
+
+  /** Incremented on every call of [[setCurrentPackage]] */
+  private setPackageGeneration = 0;
+
   private constructor(
     currentPackageWatcher: CurrentPackageWatcher,
     accountManager: AccountManager,
-    logger: IVSCodeExtLogger
+    logger: IVSCodeExtLogger,
+    private readonly obsFetchers: ObsFetchers
   ) {
     super(accountManager, logger);
     this.onDidChangeTreeData = this.onDidChangeTreeDataEmitter.event;
@@ -150,6 +208,11 @@ export class PackageScmHistoryTree
         this.openCommitDocument,
         this
       ),
+      vscode.commands.registerCommand(
+        SHOW_MORE_REVISIONS_COMMAND,
+        this.showMoreRevisions,
+        this
+      ),
       vscode.workspace.registerTextDocumentContentProvider(
         OBS_REVISION_FILE_SCHEME,
         this
@@ -201,10 +264,23 @@ export class PackageScmHistoryTree
       this.logger.error("currentPackage is set, but no history is present");
       return [];
     }
-    return this.currentHistory.map(
-      (_rev, index, hist) =>
-        new CommitTreeElement(hist[hist.length - 1 - index])
-    );
+    // the history is ordered from the oldest to the newest revision, but we
+    // show the newest first and only create elements for the shown ones
+    const hist = this.currentHistory;
+    const shown = Math.min(this.shownRevisions, hist.length);
+    const children: HistoryTreeItem[] = [];
+    for (let i = hist.length - 1; i >= hist.length - shown; i--) {
+      children.push(new CommitTreeElement(hist[i]));
+    }
+    if (shown < hist.length) {
+      children.push(new LoadMoreRevisionsTreeElement(hist.length - shown));
+    }
+    return children;
+  }
+
+  private showMoreRevisions(): void {
+    this.shownRevisions += HISTORY_PAGE_SIZE;
+    this.onDidChangeTreeDataEmitter.fire(undefined);
   }
 
   private commitFromUri(uri: vscode.Uri): Revision | undefined {
@@ -244,6 +320,26 @@ export class PackageScmHistoryTree
     await vscode.window.showTextDocument(document, { preview: false });
   }
 
+  private showHistory(pkg: ModifiedPackage, history: readonly Revision[]): void {
+    if (
+      this.currentPackage === undefined ||
+      historyKey(this.currentPackage) !== historyKey(pkg)
+    ) {
+      this.shownRevisions = HISTORY_PAGE_SIZE;
+    }
+    this.currentPackage = pkg;
+    this.currentHistory = history;
+    this.onDidChangeTreeDataEmitter.fire(undefined);
+  }
+
+  private dropCachedHistory(key: string): void {
+    const cached = this.historyCache.get(key);
+    if (cached !== undefined) {
+      this.cachedRevisions -= cached.history.length;
+      this.historyCache.delete(key);
+    }
+  }
+
   private async setCurrentPackage(curPkg: CurrentPackage): Promise<void> {
     const pkg = curPkg.currentPackage;
     if (pkg === undefined || !isModifiedPackage(pkg)) {
@@ -265,10 +361,39 @@ export class PackageScmHistoryTree
       return;
     }
 
+    const generation = ++this.setPackageGeneration;
+    const key = historyKey(pkg);
+    const cached = this.historyCache.get(key);
+    if (cached !== undefined) {
+      this.showHistory(pkg, cached.history);
+      // the cache is still good if it contains the checked out revision
+      if (
+        Date.now() - cached.fetchTime < HISTORY_MAX_AGE_MS &&
+        (pkg.md5Hash === undefined ||
+          cached.history.some((rev) => rev.revisionHash === pkg.md5Hash))
+      ) {
+        // mark it as the most recently used one
+        this.historyCache.delete(key);
+        this.historyCache.set(key, cached);
+        return;
+      }
+    }
+
     try {
-      this.currentHistory = await fetchHistory(con, pkg);
-      this.currentPackage = pkg;
-      this.onDidChangeTreeDataEmitter.fire(undefined);
+      const history = await this.obsFetchers.fetchHistory(con, pkg);
+      this.dropCachedHistory(key);
+      this.historyCache.set(key, { history, fetchTime: Date.now() });
+      this.cachedRevisions += history.length;
+      for (const oldKey of this.historyCache.keys()) {
+        if (this.cachedRevisions <= MAX_CACHED_REVISIONS || oldKey === key) {
+          break;
+        }
+        this.dropCachedHistory(oldKey);
+      }
+      // another package became the current one in the meantime
+      if (generation === this.setPackageGeneration) {
+        this.showHistory(pkg, history);
+      }
     } catch (err) {
       this.logger.error(
         "Failed to load history of %s/%s from %s, got error: %s",
@@ -33,12 +33,15 @@ import {
   BookmarkedProjectTreeElement,
   MyBookmarksElement,
   ObsServerTreeElement,
+  PACKAGE_PAGE_SIZE,
+  ShowMorePackagesElement,
   UPDATE_PROJECT_COMMAND
 } from "../../bookmark-tree-view";
 import {
   BookmarkState,
   isProjectBookmark,
   packageBookmarkFromPackage,
+  ProjectBookmark,
   projectBookmarkFromProject,
   ProjectBookmarkImpl
 } from "../../bookmarks";
@@ -510,6 +513,90 @@ describe("BookmarkedProjectsTreeProvider", () => {
           ).to.equal(undefined);
         })
       );
+
+      it(
+        "shows the packages of large projects in pages",
+        castToAsyncFunc<FixtureContext>(async function () {
+          const projectTree = await this.fixture.createBookmarkedProjectsTreeProvider(
+            [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]]
+          );
+
+          const pkgCount = 2 * PACKAGE_PAGE_SIZE + 1;
+          const bigProj: obs_api.Project = {
+            ...td.fooProj,
+            packages: [...Array(pkgCount).keys()].map((i) => ({
+              apiUrl: td.fooProj.apiUrl,
+              name: `pkg${i}`,
+              projectName: td.fooProj.name
+            }))
+          };
+          setupFetchProjectMocks(bigProj, this.fixture.obsFetchers);
+
+          const projElement = new BookmarkedProjectTreeElement(
+            projectBookmarkFromProject(td.fooProj)
+          );
+
+          const firstPage = await projectTree.getChildren(projElement);
+          expect(firstPage).to.have.lengthOf(PACKAGE_PAGE_SIZE + 1);
+          firstPage![0].label!.should.equal("pkg0");
+          const showMore = firstPage![PACKAGE_PAGE_SIZE];
+          showMore.should.be.an.instanceOf(ShowMorePackagesElement);
+          showMore.command!.arguments!.should.deep.equal([projElement]);
+
+          projectTree.showMorePackages(projElement);
+          const twoPages = await projectTree.getChildren(projElement);
+          expect(twoPages).to.have.lengthOf(2 * PACKAGE_PAGE_SIZE + 1);
+
+          projectTree.showMorePackages(projElement);
+          const allPackages = await projectTree.getChildren(projElement);
+          expect(allPackages).to.have.lengthOf(pkgCount);
+          allPackages![pkgCount - 1].label!.should.equal(`pkg${pkgCount - 1}`);
+
+          // collapsing the project resets it to the first page
+          projectTree.onDidCollapseElement(projElement);
+          await projectTree
+            .getChildren(projElement)
+            .should.eventually.have.lengthOf(PACKAGE_PAGE_SIZE + 1);
+        })
+      );
+
+      it(
+        "reuses the retrieval of a project that was collapsed while loading",
+        castToAsyncFunc<FixtureContext>(async function () {
+          const projectTree = await this.fixture.createBookmarkedProjectsTreeProvider(
+            [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]]
+          );
+
+          let resolveProject: (proj: ProjectBookmark) => void = () => {};
+          const getBookmarkedProject = this.fixture.sandbox
+            .stub(this.fixture.projectBookmarkManager!, "getBookmarkedProject")
+            .returns(
+              new Promise((resolve) => {
+                resolveProject = resolve;
+              })
+            );
+          const changedElementSpy = this.fixture.sandbox.spy();
+          projectTree.onDidChangeTreeData(changedElementSpy);
+
+          const projElement = new BookmarkedProjectTreeElement(
+            projectBookmarkFromProject(td.fooProj)
+          );
+
+          const firstExpansion = projectTree.getChildren(projElement);
+          projectTree.onDidCollapseElement(projElement);
+          await firstExpansion.should.eventually.deep.equal([]);
+          changedElementSpy.should.have.been.calledOnceWithExactly(
+            projElement
+          );
+
+          const secondExpansion = projectTree.getChildren(projElement);
+          resolveProject(projectBookmarkFromProject(td.fooProjWithPackages));
+          await secondExpansion.should.eventually.have.lengthOf(
+            td.fooProjWithPackages.packages!.length
+          );
+          getBookmarkedProject.should.have.been.calledOnce;
+        })
+      );
     });
 
     describe("children of the Package Element", () => {
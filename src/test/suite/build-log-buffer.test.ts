@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect, should } from "chai";
+import { promises as fsPromises } from "fs";
+import { afterEach, beforeEach, describe, it } from "mocha";
+import { pathExists } from "open-build-service-api";
+import { join } from "path";
+import { BuildLogBuffer } from "../../build-log-buffer";
+import { createTestTempDir } from "../../ui-tests/util";
+import { safeRmRf } from "./utilities";
+
+should();
+
+describe("BuildLogBuffer", () => {
+  beforeEach(async function () {
+    this.tmpdir = await createTestTempDir();
+    this.buffer = new BuildLogBuffer(16, join(this.tmpdir, "log-"));
+  });
+
+  afterEach(async function () {
+    await this.buffer.dispose();
+    await safeRmRf(this.tmpdir);
+  });
+
+  it("keeps small logs in memory", async function () {
+    this.buffer.append(Buffer.from("foo\n"));
+    this.buffer.append(Buffer.from("bar\n"));
+
+    this.buffer.tail().should.equal("foo\nbar\n");
+    this.buffer.length.should.equal(8);
+    this.buffer.swappedBytes.should.equal(0);
+    await this.buffer.flush();
+    expect(this.buffer.swapFile).to.equal(undefined);
+  });
+
+  it("swaps the oldest chunks to disk", async function () {
+    const chunks = ["0123456789\n", "abcdefghij\n", "ABCDEFGHIJ\n"];
+    chunks.forEach((chunk) => this.buffer.append(Buffer.from(chunk)));
+
+    this.buffer.length.should.equal(33);
+    this.buffer.swappedBytes.should.equal(22);
+    this.buffer.tail().should.equal(chunks[2]);
+
+    await this.buffer.flush();
+    expect(this.buffer.swapError).to.equal(undefined);
+    await fsPromises
+      .readFile(this.buffer.swapFile, "utf-8")
+      .should.eventually.equal(chunks[0] + chunks[1]);
+  });
+
+  it("keeps the newest chunk even if it exceeds the limit", function () {
+    const chunk = "a".repeat(100);
+    this.buffer.append(Buffer.from(chunk));
+    this.buffer.tail().should.equal(chunk);
+    this.buffer.swappedBytes.should.equal(0);
+  });
+
+  it("does not start the tail in the middle of a character", function () {
+    this.buffer.append(Buffer.from("0123456789abcdef"));
+    // split the two bytes of 'ä' over two chunks
+    const umlaut = Buffer.from("ä");
+    this.buffer.append(umlaut.slice(0, 1));
+    this.buffer.append(Buffer.concat([umlaut.slice(1), Buffer.from("bc")]));
+    this.buffer.append(Buffer.from("0123456789abc"));
+
+    this.buffer.tail().should.equal("bc0123456789abc");
+  });
+
+  it("removes the swap file on dispose", async function () {
+    this.buffer.append(Buffer.from("0123456789abcdef"));
+    this.buffer.append(Buffer.from("0123456789abcdef"));
+    await this.buffer.flush();
+    const swapFile = this.buffer.swapFile;
+    expect(swapFile).to.not.equal(undefined);
+
+    await this.buffer.dispose();
+    await pathExists(swapFile).should.eventually.equal(undefined);
+    this.buffer.tail().should.equal("");
+  });
+});
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect, should } from "chai";
+import { describe, it } from "mocha";
+import { sleep } from "open-build-service-api/lib/util";
+import * as vscode from "vscode";
+import { CoalescingScheduler } from "../../coalescing-scheduler";
+
+should();
+
+const DELAY_MS = 20;
+
+describe("CoalescingScheduler", () => {
+  it("runs the task once for a burst of requests", async () => {
+    const keys: string[] = [];
+    const scheduler = new CoalescingScheduler<string>(DELAY_MS, (key) => {
+      keys.push(key);
+      return Promise.resolve();
+    });
+
+    await Promise.all([
+      scheduler.schedule("foo"),
+      scheduler.schedule("foo"),
+      scheduler.schedule("bar"),
+      scheduler.schedule("foo")
+    ]);
+
+    expect(keys.sort()).to.deep.equal(["bar", "foo"]);
+    scheduler.dispose();
+  });
+
+  it("cancels a run that has been superseded", async () => {
+    const tokens: vscode.CancellationToken[] = [];
+    const scheduler = new CoalescingScheduler<string>(
+      DELAY_MS,
+      async (_key, token) => {
+        tokens.push(token);
+        await sleep(5 * DELAY_MS);
+      }
+    );
+
+    const firstRun = scheduler.schedule("foo");
+    await sleep(2 * DELAY_MS);
+    expect(tokens).to.have.length(1);
+
+    const secondRun = scheduler.schedule("foo");
+    await sleep(2 * DELAY_MS);
+    expect(tokens).to.have.length(2);
+    tokens[0].isCancellationRequested.should.equal(true);
+    tokens[1].isCancellationRequested.should.equal(false);
+
+    await Promise.all([firstRun, secondRun]);
+    scheduler.dispose();
+  });
+
+  it("rejects the requests if the task fails", async () => {
+    const scheduler = new CoalescingScheduler<string>(DELAY_MS, () =>
+      Promise.reject(new Error("Barf"))
+    );
+
+    await Promise.all([
+      scheduler.schedule("foo").should.be.rejectedWith(Error, "Barf"),
+      scheduler.schedule("foo").should.be.rejectedWith(Error, "Barf")
+    ]);
+    scheduler.dispose();
+  });
+
+  it("drops pending runs on dispose", async () => {
+    let runs = 0;
+    const scheduler = new CoalescingScheduler<string>(DELAY_MS, () => {
+      runs++;
+      return Promise.resolve();
+    });
+
+    const run = scheduler.schedule("foo");
+    scheduler.dispose();
+    await run;
+    await sleep(2 * DELAY_MS);
+    runs.should.equal(0);
+  });
+});
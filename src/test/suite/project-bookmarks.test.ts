@@ -21,6 +21,7 @@
 
 import * as assert from "assert";
 import { expect } from "chai";
+import { createHash } from "crypto";
 import { promises as fsPromises } from "fs";
 import { afterEach, beforeEach, Context, describe, it } from "mocha";
 import { Project } from "open-build-service-api";
@@ -36,6 +37,7 @@ import {
 import {
   ChangedObject,
   ChangeType,
+  GET_FILE_FROM_CACHE_COMMAND,
   ProjectBookmarkManager,
   RefreshBehavior
 } from "../../project-bookmarks";
@@ -398,6 +400,144 @@ describe("ProjectBookmarkManager", () => {
     );
   });
 
+  describe("project cache", () => {
+    it(
+      "stores all projects of an API in one file",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const mgr = await this.fixture.createProjectBookmarkManager({
+          initialAccountMap: [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]],
+          initialBookmarks: [[td.fakeAccount1.apiUrl, [td.barProj]]]
+        });
+
+        setupFetchProjectMocks(td.fooProj, this.fixture.obsFetchers);
+        await mgr.addProjectToBookmarks(td.fooProj);
+        await mgr.dispose();
+
+        assert(this.fixture.globalStorageUri !== undefined);
+        const apiDir = join(
+          this.fixture.globalStorageUri.fsPath,
+          "projectCache",
+          Buffer.from(td.fakeAccount1.apiUrl).toString("hex")
+        );
+        const cachedProjects = JSON.parse(
+          await fsPromises.readFile(join(apiDir, "projects.json"), "utf8")
+        );
+        expect(cachedProjects).to.be.an("array").and.have.length(2);
+        expect(cachedProjects.map((p: Project) => p.name)).to.deep.equal([
+          td.barProj.name,
+          td.fooProj.name
+        ]);
+      })
+    );
+
+    it(
+      "persists the order of use of cached projects",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const mgr = await this.fixture.createProjectBookmarkManager({
+          initialAccountMap: [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]],
+          initialBookmarks: [[td.fakeAccount1.apiUrl, [td.barProj]]]
+        });
+
+        setupFetchProjectMocks(td.fooProj, this.fixture.obsFetchers);
+        await mgr.addProjectToBookmarks(td.fooProj);
+
+        await mgr
+          .getBookmarkedProject(
+            td.barProj.apiUrl,
+            td.barProj.name,
+            RefreshBehavior.Never
+          )
+          .should.eventually.have.property("name", td.barProj.name);
+        await mgr.dispose();
+
+        assert(this.fixture.globalStorageUri !== undefined);
+        const apiDir = join(
+          this.fixture.globalStorageUri.fsPath,
+          "projectCache",
+          Buffer.from(td.fakeAccount1.apiUrl).toString("hex")
+        );
+        const cachedProjects = JSON.parse(
+          await fsPromises.readFile(join(apiDir, "projects.json"), "utf8")
+        );
+        expect(cachedProjects.map((p: Project) => p.name)).to.deep.equal([
+          td.fooProj.name,
+          td.barProj.name
+        ]);
+      })
+    );
+  });
+
+  describe("cached file contents", () => {
+    const contents = Buffer.from("the contents of fileA");
+    const md5Hash = createHash("md5").update(contents).digest("hex");
+
+    const getFileA = (refreshBehavior: RefreshBehavior) =>
+      vscode.commands.executeCommand(
+        GET_FILE_FROM_CACHE_COMMAND,
+        td.barPkg.apiUrl,
+        td.fileA,
+        refreshBehavior
+      );
+
+    it(
+      "does not refetch contents whose md5 hash did not change",
+      castToAsyncFunc<FixtureContext>(async function () {
+        await this.fixture.createProjectBookmarkManager({
+          initialAccountMap: [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]]
+        });
+        this.fixture.obsFetchers.fetchPackage.resolves({
+          ...td.barPkg,
+          files: [{ ...td.fileA, md5Hash }]
+        });
+        this.fixture.obsFetchers.fetchFileContents.resolves(contents);
+
+        await getFileA(RefreshBehavior.Always).should.eventually.deep.include({
+          contents
+        });
+        await getFileA(RefreshBehavior.Always).should.eventually.deep.include({
+          contents
+        });
+
+        this.fixture.obsFetchers.fetchPackage.should.have.callCount(2);
+        this.fixture.obsFetchers.fetchFileContents.should.have.been.calledOnce;
+      })
+    );
+
+    it(
+      "refetches contents whose md5 hash changed",
+      castToAsyncFunc<FixtureContext>(async function () {
+        await this.fixture.createProjectBookmarkManager({
+          initialAccountMap: [[td.fakeAccount1.apiUrl, td.fakeApi1ValidAcc]]
+        });
+        this.fixture.obsFetchers.fetchPackage.resolves({
+          ...td.barPkg,
+          md5Hash: "old",
+          files: [{ ...td.fileA, md5Hash }]
+        });
+        this.fixture.obsFetchers.fetchFileContents.resolves(contents);
+        await getFileA(RefreshBehavior.Always);
+
+        const newContents = Buffer.from("new contents of fileA");
+        this.fixture.obsFetchers.fetchPackage.resolves({
+          ...td.barPkg,
+          md5Hash: "new",
+          files: [
+            {
+              ...td.fileA,
+              md5Hash: createHash("md5").update(newContents).digest("hex")
+            }
+          ]
+        });
+        this.fixture.obsFetchers.fetchFileContents.resolves(newContents);
+
+        await getFileA(RefreshBehavior.Always).should.eventually.deep.include({
+          contents: newContents
+        });
+        this.fixture.obsFetchers.fetchFileContents.should.have.callCount(2);
+      })
+    );
+  });
+
   describe("#getBookmarkedProject", () => {
     it(
       "does not duplicate packages if the metadata cache has a slightly different package",
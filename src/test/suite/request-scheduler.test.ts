@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect, should } from "chai";
+import { describe, it } from "mocha";
+import { sleep } from "open-build-service-api/lib/util";
+import { RequestScheduler } from "../../request-scheduler";
+
+should();
+
+const API_A = "https://api.foo.org/";
+const API_B = "https://api.bar.org/";
+
+describe("RequestScheduler", () => {
+  it("limits the number of concurrent requests per API", async () => {
+    const scheduler = new RequestScheduler(2);
+    const active = new Map<string, number>();
+    const maxActive = new Map<string, number>();
+
+    const request = (api: string) => async (): Promise<void> => {
+      const cur = (active.get(api) ?? 0) + 1;
+      active.set(api, cur);
+      maxActive.set(api, Math.max(maxActive.get(api) ?? 0, cur));
+      await sleep(10);
+      active.set(api, active.get(api)! - 1);
+    };
+
+    await Promise.all(
+      [API_A, API_A, API_A, API_A, API_A, API_B, API_B, API_B].map((api) =>
+        scheduler.run(api, request(api))
+      )
+    );
+
+    expect(maxActive.get(API_A)).to.equal(2);
+    expect(maxActive.get(API_B)).to.equal(2);
+  });
+
+  it("shares the result of pending requests with the same key", async () => {
+    const scheduler = new RequestScheduler();
+    let calls = 0;
+    const request = async (): Promise<number> => {
+      await sleep(10);
+      return ++calls;
+    };
+
+    const results = await Promise.all([
+      scheduler.run(API_A, request, "foo"),
+      scheduler.run(API_A, request, "foo"),
+      scheduler.run(API_B, request, "foo")
+    ]);
+    results[0].should.equal(results[1]);
+    calls.should.equal(2);
+
+    // the first request finished, so this one is sent again
+    await scheduler.run(API_A, request, "foo").should.eventually.equal(3);
+  });
+
+  it("frees the slot of a failed request", async () => {
+    const scheduler = new RequestScheduler(1);
+
+    await scheduler
+      .run(API_A, () => Promise.reject(new Error("Barf")))
+      .should.be.rejectedWith(/barf/i);
+    await scheduler
+      .run(API_A, () => Promise.resolve("works"))
+      .should.eventually.equal("works");
+  });
+});
@@ -0,0 +1,372 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect } from "chai";
+import { afterEach, beforeEach, Context, describe, it } from "mocha";
+import { ModifiedPackage, Revision } from "open-build-service-api";
+import { createSandbox } from "sinon";
+import * as vscode from "vscode";
+import { CurrentPackage } from "../../current-package-watcher";
+import {
+  CommitTreeElement,
+  HistoryRootTreeElement,
+  HISTORY_PAGE_SIZE,
+  LoadMoreRevisionsTreeElement,
+  MAX_CACHED_REVISIONS,
+  PackageScmHistoryTree,
+  SHOW_MORE_REVISIONS_COMMAND
+} from "../../scm-history";
+import { FakeAccountManager, FakeCurrentPackageWatcher } from "./fakes";
+import { fakeAccount1, fakeApi1ValidAcc } from "./test-data";
+import {
+  castToAsyncFunc,
+  createStubbedObsFetchers,
+  LoggingFixture,
+  testLogger
+} from "./test-utils";
+
+/** Creates a history ordered from the oldest to the newest revision */
+const makeHistory = (pkgName: string, length: number): Revision[] =>
+  [...Array(length).keys()].map((i) => {
+    const rev = {
+      revision: i + 1,
+      revisionHash: `${pkgName}-${i + 1}`,
+      commitTime: new Date(2020, 0, 1, 0, i),
+      commitMessage: `commit number ${i + 1}`,
+      projectName: "devel:tools",
+      packageName: pkgName
+    };
+    return rev as Revision;
+  });
+
+const makePackage = (name: string, md5Hash?: string): ModifiedPackage => ({
+  name,
+  projectName: "devel:tools",
+  apiUrl: fakeAccount1.apiUrl,
+  md5Hash,
+  path: `/path/to/devel:tools/${name}`,
+  filesInWorkdir: [],
+  files: []
+});
+
+const currentPackageOf = (pkg: ModifiedPackage): CurrentPackage => ({
+  currentPackage: pkg,
+  currentProject: undefined,
+  currentFilename: undefined
+});
+
+class PackageScmHistoryTreeFixture extends LoggingFixture {
+  public readonly sandbox = createSandbox();
+
+  public readonly obsFetchers = createStubbedObsFetchers(this.sandbox);
+
+  public readonly fakeCurrentPackageWatcher = new FakeCurrentPackageWatcher();
+
+  private historyTree: PackageScmHistoryTree | undefined;
+
+  public async createHistoryTree(): Promise<PackageScmHistoryTree> {
+    this.historyTree = await PackageScmHistoryTree.createPackageScmHistoryTree(
+      this.fakeCurrentPackageWatcher,
+      new FakeAccountManager([[fakeAccount1.apiUrl, fakeApi1ValidAcc]]),
+      testLogger,
+      this.obsFetchers
+    );
+    return this.historyTree;
+  }
+
+  /** Makes pkg the current package and waits until its history is shown */
+  public showPackage(pkg: ModifiedPackage): Promise<void> {
+    return this.fakeCurrentPackageWatcher.setCurrentPackage(
+      currentPackageOf(pkg)
+    );
+  }
+
+  /** The number of times the history of the package `name` was fetched */
+  public fetchCount(name: string): number {
+    return this.obsFetchers.fetchHistory
+      .getCalls()
+      .filter((call) => (call.args[1] as ModifiedPackage).name === name).length;
+  }
+
+  public afterEach(ctx: Context) {
+    super.afterEach(ctx);
+    this.historyTree?.dispose();
+    this.sandbox.restore();
+  }
+}
+
+type FixtureContext = {
+  fixture: PackageScmHistoryTreeFixture;
+} & Context;
+
+/** The children of the root element of the current package */
+const getRevisionElements = (
+  historyTree: PackageScmHistoryTree
+): vscode.TreeItem[] => {
+  const roots = historyTree.getChildren();
+  expect(roots).to.have.length(1);
+  return historyTree.getChildren(roots[0] as HistoryRootTreeElement);
+};
+
+describe("PackageScmHistoryTree", () => {
+  beforeEach(function () {
+    this.fixture = new PackageScmHistoryTreeFixture(this);
+  });
+
+  afterEach(function () {
+    this.fixture.afterEach(this);
+  });
+
+  describe("#setCurrentPackage", () => {
+    it(
+      "does not fetch the history again for the same package",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const history = makeHistory("foo", 3);
+        const pkg = makePackage("foo", history[2].revisionHash);
+        this.fixture.obsFetchers.fetchHistory.resolves(history);
+        const historyTree = await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(pkg);
+        await this.fixture.showPackage(pkg);
+        await this.fixture.showPackage({ ...pkg });
+
+        this.fixture.obsFetchers.fetchHistory.should.have.been.calledOnceWith(
+          fakeApi1ValidAcc.connection,
+          pkg
+        );
+        historyTree
+          .getChildren()
+          .should.deep.equal([new HistoryRootTreeElement(pkg)]);
+        getRevisionElements(historyTree)
+          .map((elem) => (elem as CommitTreeElement).rev)
+          .should.deep.equal(history.slice().reverse());
+      })
+    );
+
+    it(
+      "fetches the history again if the md5Hash of the package changed",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const history = makeHistory("foo", 4);
+        const oldHistory = history.slice(0, 3);
+        this.fixture.obsFetchers.fetchHistory
+          .onFirstCall()
+          .resolves(oldHistory)
+          .onSecondCall()
+          .resolves(history);
+        const historyTree = await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(
+          makePackage("foo", oldHistory[2].revisionHash)
+        );
+        getRevisionElements(historyTree).should.have.length(3);
+
+        // a new revision got committed and checked out
+        await this.fixture.showPackage(
+          makePackage("foo", history[3].revisionHash)
+        );
+        this.fixture.obsFetchers.fetchHistory.should.have.been.calledTwice;
+
+        const revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(4);
+        (revisions[0] as CommitTreeElement).rev.should.deep.equal(history[3]);
+      })
+    );
+
+    it(
+      "evicts the least recently shown packages once the cache holds too many revisions",
+      castToAsyncFunc<FixtureContext>(async function () {
+        // four of these histories fill the cache
+        const historyLength = MAX_CACHED_REVISIONS / 4;
+        const pkgs = [...Array(6).keys()].map((i) =>
+          makePackage(`pkg${i}`, `pkg${i}-1`)
+        );
+        this.fixture.obsFetchers.fetchHistory.callsFake(
+          (_con, pkg: ModifiedPackage) =>
+            Promise.resolve(makeHistory(pkg.name, historyLength))
+        );
+        await this.fixture.createHistoryTree();
+
+        // fill the cache, then use the oldest entry again
+        for (const pkg of pkgs.slice(0, 4)) {
+          await this.fixture.showPackage(pkg);
+        }
+        await this.fixture.showPackage(pkgs[0]);
+        this.fixture.fetchCount("pkg0").should.equal(1);
+
+        // pkg1 is now the least recently used one and gets evicted
+        await this.fixture.showPackage(pkgs[4]);
+
+        await this.fixture.showPackage(pkgs[0]);
+        this.fixture.fetchCount("pkg0").should.equal(1);
+        await this.fixture.showPackage(pkgs[2]);
+        this.fixture.fetchCount("pkg2").should.equal(1);
+
+        await this.fixture.showPackage(pkgs[1]);
+        this.fixture.fetchCount("pkg1").should.equal(2);
+      })
+    );
+
+    it(
+      "caches a history that exceeds the limit only until another one is fetched",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const huge = makePackage("huge", "huge-1");
+        const small = makePackage("small", "small-1");
+        this.fixture.obsFetchers.fetchHistory.callsFake(
+          (_con, pkg: ModifiedPackage) =>
+            Promise.resolve(
+              makeHistory(
+                pkg.name,
+                pkg.name === "huge" ? MAX_CACHED_REVISIONS + 1 : 1
+              )
+            )
+        );
+        await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(huge);
+        await this.fixture.showPackage(huge);
+        this.fixture.fetchCount("huge").should.equal(1);
+
+        await this.fixture.showPackage(small);
+        await this.fixture.showPackage(huge);
+        this.fixture.fetchCount("huge").should.equal(2);
+        await this.fixture.showPackage(small);
+        this.fixture.fetchCount("small").should.equal(2);
+      })
+    );
+
+    it(
+      "does not replace the current history with a late response",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const fooHistory = makeHistory("foo", 2);
+        const barHistory = makeHistory("bar", 3);
+        let resolveFoo: (hist: Revision[]) => void = () => undefined;
+        this.fixture.obsFetchers.fetchHistory
+          .onFirstCall()
+          .returns(
+            new Promise<Revision[]>((resolve) => {
+              resolveFoo = resolve;
+            })
+          )
+          .onSecondCall()
+          .resolves(barHistory);
+        const historyTree = await this.fixture.createHistoryTree();
+
+        const bar = makePackage("bar", barHistory[2].revisionHash);
+        const showFoo = this.fixture.showPackage(
+          makePackage("foo", fooHistory[1].revisionHash)
+        );
+        await this.fixture.showPackage(bar);
+
+        resolveFoo(fooHistory);
+        await showFoo;
+
+        historyTree
+          .getChildren()
+          .should.deep.equal([new HistoryRootTreeElement(bar)]);
+        (getRevisionElements(
+          historyTree
+        )[0] as CommitTreeElement).rev.should.deep.equal(barHistory[2]);
+      })
+    );
+  });
+
+  describe("#getChildren", () => {
+    it(
+      "shows all revisions if they fit on one page",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const history = makeHistory("foo", HISTORY_PAGE_SIZE);
+        this.fixture.obsFetchers.fetchHistory.resolves(history);
+        const historyTree = await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(makePackage("foo"));
+
+        const revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(HISTORY_PAGE_SIZE);
+        revisions.forEach((elem) =>
+          expect(elem).to.be.an.instanceOf(CommitTreeElement)
+        );
+      })
+    );
+
+    it(
+      "shows the older revisions page by page",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const history = makeHistory("foo", 2 * HISTORY_PAGE_SIZE + 1);
+        this.fixture.obsFetchers.fetchHistory.resolves(history);
+        const historyTree = await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(makePackage("foo"));
+
+        let revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(HISTORY_PAGE_SIZE + 1);
+        (revisions[0] as CommitTreeElement).rev.should.deep.equal(
+          history[history.length - 1]
+        );
+        (revisions[
+          HISTORY_PAGE_SIZE - 1
+        ] as CommitTreeElement).rev.should.deep.equal(
+          history[history.length - HISTORY_PAGE_SIZE]
+        );
+        revisions[HISTORY_PAGE_SIZE].should.deep.equal(
+          new LoadMoreRevisionsTreeElement(HISTORY_PAGE_SIZE + 1)
+        );
+
+        await vscode.commands.executeCommand(SHOW_MORE_REVISIONS_COMMAND);
+        revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(2 * HISTORY_PAGE_SIZE + 1);
+        revisions[2 * HISTORY_PAGE_SIZE].should.deep.equal(
+          new LoadMoreRevisionsTreeElement(1)
+        );
+
+        await vscode.commands.executeCommand(SHOW_MORE_REVISIONS_COMMAND);
+        revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(history.length);
+        (revisions[
+          history.length - 1
+        ] as CommitTreeElement).rev.should.deep.equal(history[0]);
+      })
+    );
+
+    it(
+      "shows only the first page again when switching to another package",
+      castToAsyncFunc<FixtureContext>(async function () {
+        this.fixture.obsFetchers.fetchHistory.callsFake(
+          (_con, pkg: ModifiedPackage) =>
+            Promise.resolve(makeHistory(pkg.name, HISTORY_PAGE_SIZE + 1))
+        );
+        const historyTree = await this.fixture.createHistoryTree();
+
+        await this.fixture.showPackage(makePackage("foo"));
+        await vscode.commands.executeCommand(SHOW_MORE_REVISIONS_COMMAND);
+        getRevisionElements(historyTree)
+          .filter((elem) => elem instanceof CommitTreeElement)
+          .should.have.length(HISTORY_PAGE_SIZE + 1);
+
+        await this.fixture.showPackage(makePackage("bar"));
+        const revisions = getRevisionElements(historyTree);
+        revisions.should.have.length(HISTORY_PAGE_SIZE + 1);
+        revisions[HISTORY_PAGE_SIZE].should.deep.equal(
+          new LoadMoreRevisionsTreeElement(1)
+        );
+      })
+    );
+  });
+});
@@ -64,6 +64,7 @@ export const createStubbedVscodeWindow = (sandbox: SinonSandbox) => {
 export const createStubbedObsFetchers = (sandbox: SinonSandbox) => ({
   branchPackage: sandbox.stub(),
   fetchFileContents: sandbox.stub(),
+  fetchHistory: sandbox.stub(),
   fetchPackage: sandbox.stub(),
   fetchProject: sandbox.stub(),
   readInUnifiedPackage: sandbox.stub(),
@@ -0,0 +1,389 @@
+/**
+ * Copyright (c) 2020 SUSE LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+import { expect } from "chai";
+import { promises as fsPromises } from "fs";
+import { afterEach, beforeEach, Context, describe, it } from "mocha";
+import { FileState, ModifiedPackage } from "open-build-service-api";
+import { join } from "path";
+import { createSandbox, SinonSandbox, SinonSpy } from "sinon";
+import * as vscode from "vscode";
+import { CurrentPackage } from "../../current-package-watcher";
+import {
+  MAX_CACHED_ORIGINALS_BYTES,
+  OBS_FILE_AT_HEAD_SCHEME,
+  PackageScm
+} from "../../vcs";
+import { FakeAccountManager, FakeCurrentPackageWatcher } from "./fakes";
+import { fakeAccount1 } from "./test-data";
+import { castToAsyncFunc, LoggingFixture, testLogger } from "./test-utils";
+import { getTmpPrefix, safeRmRf } from "./utilities";
+
+/** A resource group that records every assignment of its resourceStates */
+const createFakeResourceGroup = (
+  sandbox: SinonSandbox,
+  id: string,
+  label: string
+) => {
+  const setResourceStates = sandbox.spy();
+  let resourceStates: vscode.SourceControlResourceState[] = [];
+  return {
+    id,
+    label,
+    hideWhenEmpty: undefined as boolean | undefined,
+    get resourceStates(): vscode.SourceControlResourceState[] {
+      return resourceStates;
+    },
+    set resourceStates(states: vscode.SourceControlResourceState[]) {
+      setResourceStates(states);
+      resourceStates = states;
+    },
+    setResourceStates,
+    dispose: sandbox.spy()
+  };
+};
+
+type FakeResourceGroup = ReturnType<typeof createFakeResourceGroup>;
+
+const createFakeSourceControl = (
+  sandbox: SinonSandbox,
+  id: string,
+  label: string
+) => {
+  const resourceGroups = new Map<string, FakeResourceGroup>();
+  return {
+    id,
+    label,
+    rootUri: undefined,
+    inputBox: { value: "", placeholder: "" },
+    count: undefined as number | undefined,
+    quickDiffProvider: undefined as vscode.QuickDiffProvider | undefined,
+    commitTemplate: undefined as string | undefined,
+    acceptInputCommand: undefined as vscode.Command | undefined,
+    statusBarCommands: undefined as vscode.Command[] | undefined,
+    resourceGroups,
+    createResourceGroup: (groupId: string, groupLabel: string) => {
+      const group = createFakeResourceGroup(sandbox, groupId, groupLabel);
+      resourceGroups.set(groupId, group);
+      return group;
+    },
+    dispose: sandbox.spy()
+  };
+};
+
+type FakeSourceControl = ReturnType<typeof createFakeSourceControl>;
+
+const fileInWorkdir = (name: string, state: FileState, md5Hash?: string) => ({
+  name,
+  state,
+  md5Hash,
+  packageName: "foo",
+  projectName: "devel:tools"
+});
+
+const currentPackageOf = (pkg: ModifiedPackage): CurrentPackage => ({
+  currentPackage: pkg,
+  currentProject: undefined,
+  currentFilename: undefined
+});
+
+class PackageScmFixture extends LoggingFixture {
+  public readonly sandbox = createSandbox();
+
+  public readonly sourceControls: FakeSourceControl[] = [];
+
+  public readonly vscodeScm = {
+    createSourceControl: this.sandbox
+      .stub()
+      .callsFake((id: string, label: string) => {
+        const scm = createFakeSourceControl(this.sandbox, id, label);
+        this.sourceControls.push(scm);
+        return scm;
+      })
+  };
+
+  public readonly fakeCurrentPackageWatcher = new FakeCurrentPackageWatcher();
+
+  public tmpPath = "";
+
+  private packageScm: PackageScm | undefined;
+
+  public createPackageScm(): PackageScm {
+    this.packageScm = new PackageScm(
+      this.fakeCurrentPackageWatcher,
+      new FakeAccountManager(),
+      testLogger,
+      this.vscodeScm
+    );
+    return this.packageScm;
+  }
+
+  /** Creates a checked out package in the temporary directory */
+  public async createPackage(
+    name: string,
+    originals: { name: string; contents: string; md5Hash: string }[]
+  ): Promise<ModifiedPackage> {
+    const path = join(this.tmpPath, name);
+    await fsPromises.mkdir(join(path, ".osc"), { recursive: true });
+    await Promise.all(
+      originals.map((f) =>
+        fsPromises.writeFile(join(path, ".osc", f.name), f.contents)
+      )
+    );
+    const files = originals.map((f) =>
+      fileInWorkdir(f.name, FileState.Unmodified, f.md5Hash)
+    );
+    return {
+      name,
+      projectName: "devel:tools",
+      apiUrl: fakeAccount1.apiUrl,
+      path,
+      files,
+      filesInWorkdir: files
+    };
+  }
+
+  public showPackage(pkg: ModifiedPackage): Promise<void> {
+    return this.fakeCurrentPackageWatcher.setCurrentPackage(
+      currentPackageOf(pkg)
+    );
+  }
+
+  public async beforeEach(): Promise<void> {
+    this.tmpPath = await fsPromises.mkdtemp(
+      join(getTmpPrefix(), "obs-connector")
+    );
+  }
+
+  public async afterEach(ctx: Context): Promise<void> {
+    this.packageScm?.dispose();
+    this.sandbox.restore();
+    await safeRmRf(this.tmpPath);
+    super.afterEach(ctx);
+  }
+}
+
+type FixtureContext = {
+  fixture: PackageScmFixture;
+} & Context;
+
+/** Reads the file `name` at HEAD of pkg through the content provider */
+const readOriginal = (
+  packageScm: PackageScm,
+  pkg: ModifiedPackage,
+  name: string
+): Promise<string | undefined> =>
+  packageScm.provideTextDocumentContent(
+    vscode.Uri.file(join(pkg.path, name)).with({
+      scheme: OBS_FILE_AT_HEAD_SCHEME
+    })
+  );
+
+/** Number of times that the file `name` of pkg was read from `.osc` */
+const readCount = (
+  readFile: SinonSpy,
+  pkg: ModifiedPackage,
+  name: string
+): number =>
+  readFile
+    .getCalls()
+    .filter((call) => call.args[0] === join(pkg.path, ".osc", name)).length;
+
+describe("PackageScm", () => {
+  beforeEach(async function () {
+    this.fixture = new PackageScmFixture(this);
+    await this.fixture.beforeEach();
+  });
+
+  afterEach(async function () {
+    await this.fixture.afterEach(this);
+  });
+
+  describe("#updateScm", () => {
+    it(
+      "keeps the source control and only updates the changed groups if the same package is reloaded",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const pkg: ModifiedPackage = {
+          name: "foo",
+          projectName: "devel:tools",
+          apiUrl: fakeAccount1.apiUrl,
+          path: join(this.fixture.tmpPath, "foo"),
+          files: [],
+          filesInWorkdir: [
+            fileInWorkdir("foo.spec", FileState.Modified),
+            fileInWorkdir("foo.changes", FileState.Unmodified),
+            fileInWorkdir("new-file", FileState.Untracked)
+          ]
+        };
+        this.fixture.createPackageScm();
+        await this.fixture.showPackage(pkg);
+
+        this.fixture.vscodeScm.createSourceControl.should.have.been.calledOnce;
+        const scm = this.fixture.sourceControls[0];
+        scm.inputBox.value = "a commit message";
+        const groups = scm.resourceGroups;
+        groups.get("changes")!.resourceStates.should.have.length(1);
+        groups.get("untracked")!.resourceStates.should.have.length(1);
+        groups.forEach((group) => group.setResourceStates.resetHistory());
+
+        // new-file got added, the rest stays the same
+        await this.fixture.showPackage({
+          ...pkg,
+          filesInWorkdir: [
+            fileInWorkdir("foo.spec", FileState.Modified),
+            fileInWorkdir("foo.changes", FileState.Unmodified),
+            fileInWorkdir("new-file", FileState.ToBeAdded)
+          ]
+        });
+
+        this.fixture.vscodeScm.createSourceControl.should.have.been.calledOnce;
+        scm.dispose.should.have.callCount(0);
+        scm.inputBox.value.should.equal("a commit message");
+
+        groups.get("changes")!.setResourceStates.should.have.been.calledOnce;
+        groups.get("untracked")!.setResourceStates.should.have.been.calledOnce;
+        groups.get("unmodified")!.setResourceStates.should.have.callCount(0);
+        groups.get("deleted")!.setResourceStates.should.have.callCount(0);
+
+        groups
+          .get("changes")!
+          .resourceStates.map((state) => state.resourceUri.fsPath)
+          .should.deep.equal([
+            join(pkg.path, "foo.spec"),
+            join(pkg.path, "new-file")
+          ]);
+        groups.get("untracked")!.resourceStates.should.have.length(0);
+
+        // nothing changed at all
+        groups.forEach((group) => group.setResourceStates.resetHistory());
+        await this.fixture.fakeCurrentPackageWatcher.reloadCurrentPackage();
+        groups.forEach((group) =>
+          group.setResourceStates.should.have.callCount(0)
+        );
+      })
+    );
+
+    it(
+      "creates a new source control for a different package",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const foo = await this.fixture.createPackage("foo", []);
+        const bar = await this.fixture.createPackage("bar", []);
+        this.fixture.createPackageScm();
+
+        await this.fixture.showPackage(foo);
+        await this.fixture.showPackage(bar);
+
+        this.fixture.vscodeScm.createSourceControl.should.have.been.calledTwice;
+        this.fixture.sourceControls[0].dispose.should.have.been.calledOnce;
+        this.fixture.sourceControls[1].dispose.should.have.callCount(0);
+      })
+    );
+  });
+
+  describe("#provideTextDocumentContent", () => {
+    it(
+      "reads an original only once as long as its md5Hash is unchanged",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const readFile = this.fixture.sandbox.spy(fsPromises, "readFile");
+        const pkg = await this.fixture.createPackage("foo", [
+          { name: "foo.spec", contents: "Name: foo", md5Hash: "md5-1" }
+        ]);
+        const packageScm = this.fixture.createPackageScm();
+        await this.fixture.showPackage(pkg);
+
+        await readOriginal(packageScm, pkg, "foo.spec").should.eventually.equal(
+          "Name: foo"
+        );
+        await readOriginal(packageScm, pkg, "foo.spec").should.eventually.equal(
+          "Name: foo"
+        );
+        readCount(readFile, pkg, "foo.spec").should.equal(1);
+
+        // a new revision got checked out, the same package is reloaded
+        await fsPromises.writeFile(
+          join(pkg.path, ".osc", "foo.spec"),
+          "Name: foo\nVersion: 2"
+        );
+        const updatedPkg = {
+          ...pkg,
+          files: [fileInWorkdir("foo.spec", FileState.Unmodified, "md5-2")]
+        };
+        await this.fixture.showPackage(updatedPkg);
+
+        await readOriginal(
+          packageScm,
+          updatedPkg,
+          "foo.spec"
+        ).should.eventually.equal("Name: foo\nVersion: 2");
+        readCount(readFile, pkg, "foo.spec").should.equal(2);
+      })
+    );
+
+    it(
+      "drops the cached originals when another package is opened",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const readFile = this.fixture.sandbox.spy(fsPromises, "readFile");
+        const foo = await this.fixture.createPackage("foo", [
+          { name: "foo.spec", contents: "Name: foo", md5Hash: "md5-1" }
+        ]);
+        const bar = await this.fixture.createPackage("bar", []);
+        const packageScm = this.fixture.createPackageScm();
+
+        await this.fixture.showPackage(foo);
+        await readOriginal(packageScm, foo, "foo.spec");
+        await this.fixture.showPackage(bar);
+        await this.fixture.showPackage(foo);
+        await readOriginal(packageScm, foo, "foo.spec").should.eventually.equal(
+          "Name: foo"
+        );
+
+        readCount(readFile, foo, "foo.spec").should.equal(2);
+      })
+    );
+
+    it(
+      "evicts the least recently read originals once the cache gets too large",
+      castToAsyncFunc<FixtureContext>(async function () {
+        const readFile = this.fixture.sandbox.spy(fsPromises, "readFile");
+        // "ä" takes two bytes in UTF-8, so this fills the whole cache although
+        // it only has half as many characters
+        const large = "ä".repeat(MAX_CACHED_ORIGINALS_BYTES / 2);
+        const pkg = await this.fixture.createPackage("foo", [
+          { name: "large", contents: large, md5Hash: "md5-large" },
+          { name: "small", contents: "small", md5Hash: "md5-small" }
+        ]);
+        const packageScm = this.fixture.createPackageScm();
+        await this.fixture.showPackage(pkg);
+
+        expect(await readOriginal(packageScm, pkg, "large")).to.equal(large);
+        await readOriginal(packageScm, pkg, "large");
+        readCount(readFile, pkg, "large").should.equal(1);
+
+        await readOriginal(packageScm, pkg, "small");
+        await readOriginal(packageScm, pkg, "small");
+        readCount(readFile, pkg, "small").should.equal(1);
+
+        expect(await readOriginal(packageScm, pkg, "large")).to.equal(large);
+        readCount(readFile, pkg, "large").should.equal(2);
+      })
+    );
+  });
+});
@@ -42,6 +42,7 @@ import {
   isModifiedPackage
 } from "./current-package-watcher";
 import { logAndReportExceptions } from "./decorators";
+import { VscodeScm } from "./dependency-injection";
 import {
   EmptyDocumentForDiffProvider,
   fsPathFromEmptyDocumentUri
@@ -110,6 +111,46 @@ export function getPkgPathFromVcsUri(uri: vscode.Uri): string | undefined {
   return fsPath;
 }
 
+/** Upper limit of the size of the cached original files of a package */
+export const MAX_CACHED_ORIGINALS_BYTES = 16 * 1024 * 1024;
+
+interface CachedOriginal {
+  /** md5 hash of the file in `.osc/_files` when it was read */
+  readonly md5Hash: string;
+  readonly contents: string;
+  /** size of `contents` in UTF-8 */
+  readonly bytes: number;
+}
+
+interface ScmResourceGroups {
+  readonly untracked: vscode.SourceControlResourceGroup;
+  readonly removed: vscode.SourceControlResourceGroup;
+  readonly unmodified: vscode.SourceControlResourceGroup;
+  readonly changed: vscode.SourceControlResourceGroup;
+}
+
+type ResourceGroupId = keyof ScmResourceGroups;
+
+/** Returns the resource group of files with `state` (if they are shown) */
+function resourceGroupOfFileState(
+  state: FileState
+): ResourceGroupId | undefined {
+  switch (state) {
+    case FileState.Unmodified:
+      return "unmodified";
+    case FileState.Untracked:
+      return "untracked";
+    case FileState.ToBeDeleted:
+    case FileState.Missing:
+      return "removed";
+    case FileState.Modified:
+    case FileState.ToBeAdded:
+      return "changed";
+    default:
+      return undefined;
+  }
+}
+
 export class PackageScm
   extends ConnectionListenerLoggerBase
   implements vscode.QuickDiffProvider, vscode.TextDocumentContentProvider {
@@ -117,6 +158,22 @@ export class PackageScm
 
   private curScm: vscode.SourceControl | undefined;
 
+  private resourceGroups: ScmResourceGroups | undefined;
+
+  /**
+   * The files and their states that are shown by each resource group, so that
+   * only the groups with changes have to be updated.
+   */
+  private readonly resourceGroupStates = new Map<ResourceGroupId, string>();
+
+  /**
+   * Contents of the files in the `.osc` directory of the current package, the
+   * most recently used one is last.
+   */
+  private readonly originalsCache = new Map<string, CachedOriginal>();
+
+  private originalsCacheBytes = 0;
+
   private scmStatusBar: vscode.StatusBarItem | undefined;
 
   private scmDisposable: vscode.Disposable | undefined;
@@ -124,7 +181,8 @@ export class PackageScm
   constructor(
     private readonly currentPackageWatcher: CurrentPackageWatcher,
     accountManager: AccountManager,
-    logger: IVSCodeExtLogger
+    logger: IVSCodeExtLogger,
+    private readonly vscodeScm: VscodeScm = vscode.scm
   ) {
     super(accountManager, logger);
 
@@ -198,7 +256,57 @@ export class PackageScm
     const path = this.getPathOfOriginalResource(uri);
     return token?.isCancellationRequested
       ? Promise.resolve(undefined)
-      : fsPromises.readFile(path, { encoding: "utf-8" });
+      : this.readOriginalResource(path);
+  }
+
+  /**
+   * Read the file at `path` from the `.osc` directory of the current package.
+   *
+   * The files in there only change if their md5 hash in `.osc/_files` does,
+   * so the contents are cached and reused as long as the hash stays the same.
+   */
+  private async readOriginalResource(path: string): Promise<string> {
+    const pkg = this.currentPackage;
+    const md5Hash =
+      pkg !== undefined && join(pkg.path, ".osc") === dirname(path)
+        ? pkg.files.find((f) => f.name === basename(path))?.md5Hash
+        : undefined;
+
+    const cached = this.originalsCache.get(path);
+    if (cached !== undefined && cached.md5Hash === md5Hash) {
+      this.originalsCache.delete(path);
+      this.originalsCache.set(path, cached);
+      return cached.contents;
+    }
+
+    const contents = await fsPromises.readFile(path, { encoding: "utf-8" });
+    // the package could have been changed while we were reading the file
+    if (md5Hash !== undefined && this.currentPackage === pkg) {
+      this.dropCachedOriginal(path);
+      const bytes = Buffer.byteLength(contents);
+      this.originalsCache.set(path, { md5Hash, contents, bytes });
+      this.originalsCacheBytes += bytes;
+      for (const oldPath of this.originalsCache.keys()) {
+        if (this.originalsCacheBytes <= MAX_CACHED_ORIGINALS_BYTES) {
+          break;
+        }
+        this.dropCachedOriginal(oldPath);
+      }
+    }
+    return contents;
+  }
+
+  private dropCachedOriginal(path: string): void {
+    const cached = this.originalsCache.get(path);
+    if (cached !== undefined) {
+      this.originalsCacheBytes -= cached.bytes;
+      this.originalsCache.delete(path);
+    }
+  }
+
+  private clearOriginalsCache(): void {
+    this.originalsCache.clear();
+    this.originalsCacheBytes = 0;
   }
 
   public dispose(): void {
@@ -712,7 +820,7 @@ ${msg}
   }
 
   private updateScm(): void {
-    this.scmDisposable?.dispose();
+    const previousPackage = this.currentPackage;
 
     this.currentPackage =
       this.currentPackageWatcher.currentPackage.currentPackage !== undefined &&
@@ -722,6 +830,24 @@ ${msg}
         ? this.currentPackageWatcher.currentPackage.currentPackage
         : undefined;
 
+    // the same package got reloaded: keep the source control (and the commit
+    // message that the user might have entered) and only update what changed
+    if (
+      this.currentPackage !== undefined &&
+      previousPackage?.path === this.currentPackage.path &&
+      this.curScm !== undefined
+    ) {
+      this.updateResourceGroups(this.currentPackage);
+      return;
+    }
+
+    this.scmDisposable?.dispose();
+    this.scmDisposable = undefined;
+    this.curScm = undefined;
+    this.resourceGroups = undefined;
+    this.resourceGroupStates.clear();
+    this.clearOriginalsCache();
+
     if (this.currentPackage === undefined) {
       return;
     }
@@ -737,68 +863,104 @@ ${msg}
     this.scmDisposable = vscode.Disposable.from(this.curScm, this.scmStatusBar);
   }
 
+  private resourceStateFromFile(
+    pkg: ModifiedPackage,
+    fileName: string,
+    state: FileState
+  ): vscode.SourceControlResourceState {
+    const resourceUri = vscode.Uri.file(join(pkg.path, fileName));
+    switch (resourceGroupOfFileState(state)) {
+      case "removed":
+        return {
+          resourceUri,
+          decorations: {
+            strikeThrough: state === FileState.ToBeDeleted,
+            ...makeThemedIconPath("diff_deleted_outlined.svg", true)
+          }
+        };
+      case "changed":
+        return {
+          command: {
+            arguments: [resourceUri],
+            command: SHOW_DIFF_FROM_URI_COMMAND,
+            title: "Show the diff to HEAD"
+          },
+          decorations: makeThemedIconPath(
+            state === FileState.ToBeAdded
+              ? "diff_new_outlined.svg"
+              : "diff_modified_outlined.svg",
+            true
+          ),
+          resourceUri
+        };
+      default:
+        return { resourceUri };
+    }
+  }
+
+  /**
+   * Set the resource states of the groups whose files or file states differ
+   * from the ones that they currently show.
+   */
+  private updateResourceGroups(pkg: ModifiedPackage): void {
+    const groups = this.resourceGroups;
+    assert(groups !== undefined, "resource groups must have been created");
+
+    const filesOfGroup = new Map<
+      ResourceGroupId,
+      { name: string; state: FileState }[]
+    >();
+    for (const { name, state } of pkg.filesInWorkdir) {
+      const id = resourceGroupOfFileState(state);
+      if (id === undefined) {
+        continue;
+      }
+      const files = filesOfGroup.get(id);
+      if (files === undefined) {
+        filesOfGroup.set(id, [{ name, state }]);
+      } else {
+        files.push({ name, state });
+      }
+    }
+
+    for (const id of Object.keys(groups) as ResourceGroupId[]) {
+      const files = filesOfGroup.get(id) ?? [];
+      const groupState = files.map((f) => `${f.state}:${f.name}`).join("/");
+      if (this.resourceGroupStates.get(id) === groupState) {
+        continue;
+      }
+      this.resourceGroupStates.set(id, groupState);
+      groups[id].resourceStates = files.map((f) =>
+        this.resourceStateFromFile(pkg, f.name, f.state)
+      );
+    }
+  }
+
   private scmFromModifiedPackage(pkg: ModifiedPackage): vscode.SourceControl {
-    const obsScm = vscode.scm.createSourceControl(
+    const obsScm = this.vscodeScm.createSourceControl(
       "obs",
       "OBS package " + pkg.projectName + "/" + pkg.name
     );
 
-    const untrackedFiles = obsScm.createResourceGroup(
+    const untracked = obsScm.createResourceGroup(
       "untracked",
       "untracked files"
     );
-    untrackedFiles.hideWhenEmpty = true;
-    untrackedFiles.resourceStates = pkg.filesInWorkdir
-      .filter((f) => f.state === FileState.Untracked)
-      .map((f) => ({ resourceUri: vscode.Uri.file(join(pkg.path, f.name)) }));
-
-    const removedFiles = obsScm.createResourceGroup("deleted", "removed files");
-    removedFiles.hideWhenEmpty = true;
-    removedFiles.resourceStates = pkg.filesInWorkdir
-      .filter(
-        (f) =>
-          f.state === FileState.ToBeDeleted || f.state === FileState.Missing
-      )
-      .map((f) => ({
-        resourceUri: vscode.Uri.file(join(pkg.path, f.name)),
-        decorations: {
-          strikeThrough: f.state === FileState.ToBeDeleted,
-          ...makeThemedIconPath("diff_deleted_outlined.svg", true)
-        }
-      }));
+    untracked.hideWhenEmpty = true;
+
+    const removed = obsScm.createResourceGroup("deleted", "removed files");
+    removed.hideWhenEmpty = true;
 
-    const unmodifiedFiles = obsScm.createResourceGroup(
+    const unmodified = obsScm.createResourceGroup(
       "unmodified",
       "unmodified files"
     );
-    unmodifiedFiles.hideWhenEmpty = true;
-    unmodifiedFiles.resourceStates = pkg.filesInWorkdir
-      .filter((f) => f.state === FileState.Unmodified)
-      .map((f) => ({ resourceUri: vscode.Uri.file(join(pkg.path, f.name)) }));
+    unmodified.hideWhenEmpty = true;
 
     const changed = obsScm.createResourceGroup("changes", "Changed files");
 
-    changed.resourceStates = pkg.filesInWorkdir
-      .filter(
-        (f) => f.state === FileState.Modified || f.state === FileState.ToBeAdded
-      )
-      .map((f) => {
-        const resourceUri = vscode.Uri.file(join(pkg.path, f.name));
-        return {
-          command: {
-            arguments: [resourceUri],
-            command: SHOW_DIFF_FROM_URI_COMMAND,
-            title: "Show the diff to HEAD"
-          },
-          decorations: makeThemedIconPath(
-            f.state === FileState.ToBeAdded
-              ? "diff_new_outlined.svg"
-              : "diff_modified_outlined.svg",
-            true
-          ),
-          resourceUri
-        };
-      });
+    this.resourceGroups = { untracked, removed, unmodified, changed };
+    this.updateResourceGroups(pkg);
 
     obsScm.quickDiffProvider = this;
     obsScm.inputBox.placeholder = "Commit message";